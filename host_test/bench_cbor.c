@@ -0,0 +1,149 @@
+// Size and encode cost of the CBOR status request, status and telemetry keyframe against the
+// same payloads as unformatted JSON. The firmware builds its JSON with cJSON_PrintUnformatted,
+// which is not available to the host build; the JSON side here is snprintf into a fixed buffer,
+// which produces the same text without cJSON's per-node allocations, so it is the cheapest
+// JSON could be. Not a test; run it by hand, e.g. build/host_test/bench_cbor
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "cbor.h"
+
+#define ITERATIONS 1000000
+#define FRAME_MAX 2048
+#define TELEMETRY_GAUGES 24
+#define TELEMETRY_HISTOGRAMS 4
+#define HISTOGRAM_BUCKETS 12
+
+typedef struct {
+    const char *name;
+    size_t (*cbor)(uint8_t *buf, size_t cap);
+    size_t (*json)(char *buf, size_t cap);
+} payload_t;
+
+static volatile uint32_t seq = 1234;  // Keeps the encoders from being folded away
+
+static size_t request_cbor(uint8_t *buf, size_t cap) {
+    cbor_writer_t writer;
+    cbor_writer_init(&writer, buf, cap);
+    cbor_put_map(&writer, 2);
+    cbor_put_text(&writer, "message");
+    cbor_put_text(&writer, "status_request");
+    cbor_put_text(&writer, "accept");
+    cbor_put_text(&writer, "cbor");
+    return writer.len;
+}
+
+static size_t request_json(char *buf, size_t cap) {
+    return snprintf(buf, cap, "{\"message\":\"%s\",\"accept\":\"%s\"}", "status_request", "cbor");
+}
+
+// As the backend sends it; the snooper only decodes these
+static size_t status_cbor(uint8_t *buf, size_t cap) {
+    cbor_writer_t writer;
+    cbor_writer_init(&writer, buf, cap);
+    cbor_put_map(&writer, 4);
+    cbor_put_text(&writer, "LED");
+    cbor_put_text(&writer, "LED_SOLID_GREEN");
+    cbor_put_text(&writer, "seq");
+    cbor_put_uint(&writer, seq);
+    cbor_put_text(&writer, "boot");
+    cbor_put_uint(&writer, 7);
+    cbor_put_text(&writer, "ts");
+    cbor_put_uint(&writer, 1760000000);
+    return writer.len;
+}
+
+static size_t status_json(char *buf, size_t cap) {
+    return snprintf(buf, cap, "{\"LED\":\"%s\",\"seq\":%" PRIu32 ",\"boot\":%d,\"ts\":%d}", "LED_SOLID_GREEN", seq, 7,
+                    1760000000);
+}
+
+static char metric_names[TELEMETRY_GAUGES + TELEMETRY_HISTOGRAMS][32];
+
+// A metrics keyframe the size of the firmware's registry
+static size_t telemetry_cbor(uint8_t *buf, size_t cap) {
+    cbor_writer_t writer;
+    cbor_writer_init(&writer, buf, cap);
+    cbor_put_map(&writer, 3);
+    cbor_put_text(&writer, "seq");
+    cbor_put_uint(&writer, seq);
+    cbor_put_text(&writer, "kf");
+    cbor_put_uint(&writer, 1);
+    cbor_put_text(&writer, "metrics");
+    cbor_put_map(&writer, TELEMETRY_GAUGES + TELEMETRY_HISTOGRAMS);
+    for (int i = 0; i < TELEMETRY_GAUGES; i++) {
+        cbor_put_text(&writer, metric_names[i]);
+        cbor_put_int(&writer, (int)(seq * (i + 1)) % 50000);
+    }
+    for (int i = 0; i < TELEMETRY_HISTOGRAMS; i++) {
+        cbor_put_text(&writer, metric_names[TELEMETRY_GAUGES + i]);
+        cbor_put_array(&writer, 2 + HISTOGRAM_BUCKETS);
+        cbor_put_int(&writer, seq);
+        cbor_put_uint(&writer, seq * 300u);
+        for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+            cbor_put_uint(&writer, (seq >> b) & 0xff);
+        }
+    }
+    return writer.overflow ? 0 : writer.len;
+}
+
+static size_t telemetry_json(char *buf, size_t cap) {
+    size_t len = snprintf(buf, cap, "{\"seq\":%" PRIu32 ",\"kf\":1,\"metrics\":{", seq);
+    for (int i = 0; i < TELEMETRY_GAUGES; i++) {
+        len += snprintf(buf + len, cap - len, "%s\"%s\":%d", i ? "," : "", metric_names[i],
+                        (int)(seq * (i + 1)) % 50000);
+    }
+    for (int i = 0; i < TELEMETRY_HISTOGRAMS; i++) {
+        len += snprintf(buf + len, cap - len, ",\"%s\":[%" PRIu32 ",%" PRIu32, metric_names[TELEMETRY_GAUGES + i],
+                        seq, seq * 300u);
+        for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+            len += snprintf(buf + len, cap - len, ",%" PRIu32, (seq >> b) & 0xff);
+        }
+        len += snprintf(buf + len, cap - len, "]");
+    }
+    len += snprintf(buf + len, cap - len, "}}");
+    return len < cap ? len : 0;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void) {
+    static const payload_t payloads[] = {
+        {"request", request_cbor, request_json},
+        {"status", status_cbor, status_json},
+        {"telemetry", telemetry_cbor, telemetry_json},
+    };
+    static uint8_t cbor_buf[FRAME_MAX];
+    static char json_buf[FRAME_MAX];
+
+    for (int i = 0; i < TELEMETRY_GAUGES + TELEMETRY_HISTOGRAMS; i++) {
+        snprintf(metric_names[i], sizeof(metric_names[i]), i < TELEMETRY_GAUGES ? "stack.task_%d" : "mqtt.hist_%d",
+                 i);
+    }
+    for (size_t p = 0; p < sizeof(payloads) / sizeof(payloads[0]); p++) {
+        size_t cbor_len = 0;
+        size_t json_len = 0;
+
+        double start = now_s();
+        for (int i = 0; i < ITERATIONS; i++) {
+            cbor_len = payloads[p].cbor(cbor_buf, sizeof(cbor_buf));
+        }
+        double cbor_s = now_s() - start;
+        start = now_s();
+        for (int i = 0; i < ITERATIONS; i++) {
+            json_len = payloads[p].json(json_buf, sizeof(json_buf));
+        }
+        double json_s = now_s() - start;
+
+        printf("%-9s cbor %4zu bytes %7.1f ns   json %4zu bytes %7.1f ns   %.0f%% of the bytes, %.1fx faster\n",
+               payloads[p].name, cbor_len, cbor_s * 1e9 / ITERATIONS, json_len, json_s * 1e9 / ITERATIONS,
+               100.0 * cbor_len / json_len, json_s / cbor_s);
+    }
+    return 0;
+}
@@ -0,0 +1,94 @@
+// Cost and size of a log line on the text path (ESP_LOGx formatted by the cloud log's vprintf
+// hook) against the same line as a deferred-log record (DLOGx). Both end in a log ring push, as
+// cloud_log_append() does on target. The text path's console output is left out, so on the
+// device it costs more than shown here. Not a test; run it by hand, e.g.
+// build/host_test/bench_deferred_log
+//
+// Built with DEFERRED_LOGGING=1.
+#include "../main/deferred_log.c"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "log_ring.h"
+
+#define ITERATIONS 1000000
+#define RING_BYTES 2048  // CLOUD_LOG_RING_BYTES
+#define LINE_MAX 192     // CLOUD_LOG_LINE_MAX
+
+static const char *TAG = "SNOOPER";
+
+static uint32_t ring_storage[RING_BYTES / sizeof(uint32_t)];
+static log_ring_t ring = LOG_RING_INITIALIZER(ring_storage);
+static uint64_t appended_bytes;
+static uint64_t appended_records;
+
+// A full ring is emptied, standing in for the log task shipping a batch
+void cloud_log_append(const void *data, size_t len, bool urgent) {
+    if (!log_ring_push(&ring, data, len)) {
+        ring = (log_ring_t)LOG_RING_INITIALIZER(ring_storage);
+        log_ring_push(&ring, data, len);
+    }
+    appended_bytes += len;
+    appended_records++;
+}
+
+static pthread_mutex_t line_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// cloud_log_vprintf() without the console
+static int text_vprintf(const char *format, va_list args) {
+    static char line[LINE_MAX];
+
+    pthread_mutex_lock(&line_mutex);
+    int len = vsnprintf(line, sizeof(line), format, args);
+    if (len > 0) {
+        if (len >= (int)sizeof(line)) {
+            len = sizeof(line) - 1;
+            line[len - 1] = '\n';
+        }
+        cloud_log_append(line, len, false);
+    }
+    pthread_mutex_unlock(&line_mutex);
+    return len;
+}
+
+// Typical DLOGx sites in main/
+static void text_lines(int i) {
+    ESP_LOGI(TAG, "Custom handler: MQTT_EVENT_SUBSCRIBED, msg_id=%d", i);
+    ESP_LOGI(TAG, "Subscribed to %d topics, msg_id=%d", 5, i);
+    ESP_LOGD(TAG, "Received topic %s", "coop/status");
+}
+
+static void deferred_lines(int i) {
+    DLOGI(TAG, "Custom handler: MQTT_EVENT_SUBSCRIBED, msg_id=%d", i);
+    DLOGI(TAG, "Subscribed to %d topics, msg_id=%d", 5, i);
+    DLOGD(TAG, "Received topic %s", "coop/status");
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(const char *name, void (*lines)(int)) {
+    appended_bytes = 0;
+    appended_records = 0;
+
+    double start = now_s();
+    for (int i = 0; i < ITERATIONS; i++) {
+        lines(i);
+    }
+    double elapsed = now_s() - start;
+    printf("%-8s %6.1f ns per line, %5.1f bytes per line\n", name, elapsed * 1e9 / appended_records,
+           (double)appended_bytes / appended_records);
+}
+
+int main(void) {
+    esp_log_set_vprintf(text_vprintf);
+    run("text", text_lines);
+    run("deferred", deferred_lines);
+    return 0;
+}
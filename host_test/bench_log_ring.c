@@ -0,0 +1,155 @@
+// Throughput of the cloud log ring against the fixed-slot queue it replaced for log lines: a
+// queue of log_message_t sized items behind a lock, which is what xQueueSend does on target.
+// Not a test; run it by hand, e.g. build/host_test/bench_log_ring [producers]
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "log_ring.h"
+
+#define RECORDS_PER_PRODUCER 200000
+#define RING_BYTES 4096
+#define QUEUE_ITEM_BYTES 256  // sizeof(log_message_t)
+#define QUEUE_LENGTH (RING_BYTES / QUEUE_ITEM_BYTES)
+
+typedef struct {
+    const char *name;
+    bool (*push)(const void *data, size_t len);
+    // Returns the number of records drained
+    size_t (*drain)(void);
+    void (*reset)(void);
+} contender_t;
+
+static uint32_t ring_storage[RING_BYTES / sizeof(uint32_t)];
+static log_ring_t ring;
+
+static void ring_reset(void) { ring = (log_ring_t)LOG_RING_INITIALIZER(ring_storage); }
+
+static bool ring_push(const void *data, size_t len) { return log_ring_push(&ring, data, len); }
+
+static size_t ring_drain(void) {
+    static char sink[QUEUE_ITEM_BYTES];
+    const void *data;
+    size_t len;
+    size_t drained = 0;
+
+    while ((len = log_ring_peek(&ring, &data)) > 0) {
+        memcpy(sink, data, len);
+        log_ring_pop(&ring);
+        drained++;
+    }
+    return drained;
+}
+
+static char queue_storage[QUEUE_LENGTH][QUEUE_ITEM_BYTES];
+static size_t queue_head, queue_tail;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void queue_reset(void) { queue_head = queue_tail = 0; }
+
+// Like xQueueSend with no wait: the whole item is copied under the lock whatever the line length
+static bool queue_push(const void *data, size_t len) {
+    static __thread char item[QUEUE_ITEM_BYTES];
+    bool queued = false;
+
+    memcpy(item, data, len);
+    pthread_mutex_lock(&queue_lock);
+    if (queue_head - queue_tail < QUEUE_LENGTH) {
+        memcpy(queue_storage[queue_head % QUEUE_LENGTH], item, QUEUE_ITEM_BYTES);
+        queue_head++;
+        queued = true;
+    }
+    pthread_mutex_unlock(&queue_lock);
+    return queued;
+}
+
+static size_t queue_drain(void) {
+    static char sink[QUEUE_ITEM_BYTES];
+    size_t drained = 0;
+
+    pthread_mutex_lock(&queue_lock);
+    while (queue_tail != queue_head) {
+        memcpy(sink, queue_storage[queue_tail % QUEUE_LENGTH], QUEUE_ITEM_BYTES);
+        queue_tail++;
+        drained++;
+    }
+    pthread_mutex_unlock(&queue_lock);
+    return drained;
+}
+
+static const contender_t *current;
+static atomic_int producers_done;
+static atomic_uint dropped;
+
+static void *producer(void *arg) {
+    char line[QUEUE_ITEM_BYTES];
+
+    for (uint32_t i = 0; i < RECORDS_PER_PRODUCER; i++) {
+        // Typical log lines, 40 to 167 bytes
+        int len = snprintf(line, sizeof(line), "I (%lu) BENCH: line %lu %.*s\n", (unsigned long)i, (unsigned long)i,
+                           (int)(i % 128), "................................................................"
+                                           "................................................................");
+        if (!current->push(line, (size_t)len)) {
+            atomic_fetch_add(&dropped, 1);
+            sched_yield();
+        }
+    }
+    atomic_fetch_add(&producers_done, 1);
+    return NULL;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(const contender_t *contender, int producers) {
+    pthread_t threads[producers];
+    size_t drained = 0;
+
+    current = contender;
+    contender->reset();
+    atomic_store(&producers_done, 0);
+    atomic_store(&dropped, 0);
+
+    double start = now_s();
+    for (int i = 0; i < producers; i++) {
+        pthread_create(&threads[i], NULL, producer, NULL);
+    }
+    while (atomic_load(&producers_done) < producers) {
+        size_t n = contender->drain();
+        drained += n;
+        if (n == 0) {
+            sched_yield();
+        }
+    }
+    drained += contender->drain();
+    double elapsed = now_s() - start;
+    for (int i = 0; i < producers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    unsigned offered = (unsigned)(producers * RECORDS_PER_PRODUCER);
+    printf("%-6s %d producers: %8.0f records/s delivered, %6.1f ns per offered record, %u of %u dropped\n",
+           contender->name, producers, drained / elapsed, elapsed * 1e9 / offered, (unsigned)atomic_load(&dropped),
+           offered);
+}
+
+int main(int argc, char **argv) {
+    static const contender_t contenders[] = {
+        {"ring", ring_push, ring_drain, ring_reset},
+        {"queue", queue_push, queue_drain, queue_reset},
+    };
+    int producers = argc > 1 ? atoi(argv[1]) : 4;
+
+    for (size_t i = 0; i < sizeof(contenders) / sizeof(contenders[0]); i++) {
+        run(&contenders[i], 1);
+        run(&contenders[i], producers);
+    }
+    return 0;
+}
@@ -0,0 +1,91 @@
+// Cost of metric updates against the counters-under-a-mutex they replace, uncontended and with
+// several threads updating the same metric. Not a test; run it by hand, e.g.
+// build/host_test/bench_metrics [threads]
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "metrics.h"
+
+#define UPDATES_PER_THREAD 2000000
+
+typedef struct {
+    const char *name;
+    void (*update)(uint32_t value);
+} contender_t;
+
+static metric_t *counter;
+static metric_t *histogram;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+    uint32_t count;
+    uint64_t sum;
+    uint32_t max;
+} stats;
+
+static void counter_update(uint32_t value) { metric_inc(counter); }
+
+static void histogram_update(uint32_t value) { metric_observe(histogram, value); }
+
+static void mutex_update(uint32_t value) {
+    pthread_mutex_lock(&stats_lock);
+    stats.count++;
+    stats.sum += value;
+    if (value > stats.max) {
+        stats.max = value;
+    }
+    pthread_mutex_unlock(&stats_lock);
+}
+
+static const contender_t *current;
+
+static void *updater(void *arg) {
+    uint32_t value = (uint32_t)(intptr_t)arg;
+
+    for (uint32_t i = 0; i < UPDATES_PER_THREAD; i++) {
+        // Cheap spread of handler-time-like values over the buckets
+        value = value * 1103515245u + 12345u;
+        current->update(value >> 18);
+    }
+    return NULL;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(const contender_t *contender, int threads) {
+    pthread_t ids[threads];
+
+    current = contender;
+    double start = now_s();
+    for (int i = 0; i < threads; i++) {
+        pthread_create(&ids[i], NULL, updater, (void *)(intptr_t)(i + 1));
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(ids[i], NULL);
+    }
+    double elapsed = now_s() - start;
+    printf("%-10s %d threads: %6.1f ns per update\n", contender->name, threads,
+           elapsed * 1e9 / ((double)threads * UPDATES_PER_THREAD));
+}
+
+int main(int argc, char **argv) {
+    static const contender_t contenders[] = {
+        {"counter", counter_update},
+        {"histogram", histogram_update},
+        {"mutex", mutex_update},
+    };
+    int threads = argc > 1 ? atoi(argv[1]) : 4;
+
+    counter = metrics_counter("bench.counter");
+    histogram = metrics_histogram("bench.histogram");
+    for (size_t i = 0; i < sizeof(contenders) / sizeof(contenders[0]); i++) {
+        run(&contenders[i], 1);
+        run(&contenders[i], threads);
+    }
+    return 0;
+}
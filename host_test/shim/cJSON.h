@@ -0,0 +1,19 @@
+#ifndef SNOOPER_HOST_CJSON_H
+#define SNOOPER_HOST_CJSON_H
+
+// cJSON is not installed on the host. Every constructor returns NULL, so JSON encoders fail
+// cleanly and tests exercise the CBOR paths.
+
+typedef struct cJSON cJSON;
+
+cJSON *cJSON_CreateObject(void);
+cJSON *cJSON_CreateArray(void);
+cJSON *cJSON_CreateNumber(double number);
+cJSON *cJSON_AddNumberToObject(cJSON *object, const char *name, double number);
+cJSON *cJSON_AddObjectToObject(cJSON *object, const char *name);
+int cJSON_AddItemToObject(cJSON *object, const char *name, cJSON *item);
+int cJSON_AddItemToArray(cJSON *array, cJSON *item);
+char *cJSON_PrintUnformatted(const cJSON *item);
+void cJSON_Delete(cJSON *item);
+
+#endif  // SNOOPER_HOST_CJSON_H
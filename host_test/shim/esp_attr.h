@@ -0,0 +1,7 @@
+#ifndef SNOOPER_HOST_ESP_ATTR_H
+#define SNOOPER_HOST_ESP_ATTR_H
+
+// Plain .bss on the host; tests keep it across a simulated reboot by not clearing it
+#define RTC_NOINIT_ATTR
+
+#endif  // SNOOPER_HOST_ESP_ATTR_H
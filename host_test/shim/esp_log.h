@@ -0,0 +1,40 @@
+#ifndef SNOOPER_HOST_ESP_LOG_H
+#define SNOOPER_HOST_ESP_LOG_H
+
+#include <stdarg.h>
+#include <stdint.h>
+
+// Lines are formatted like ESP-IDF's without colours: "E (1234) TAG: message\n"
+
+typedef int (*vprintf_like_t)(const char *format, va_list args);
+
+typedef enum {
+    ESP_LOG_NONE = 0,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+#ifndef LOG_LOCAL_LEVEL
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+#endif
+
+uint32_t esp_log_timestamp(void);
+// Every tag logs at ESP_LOG_VERBOSE
+esp_log_level_t esp_log_level_get(const char *tag);
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func);
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+#define SHIM_LOG(level, letter, tag, format, ...) \
+    esp_log_write(level, tag, letter " (%lu) %s: " format "\n", (unsigned long)esp_log_timestamp(), tag, ##__VA_ARGS__)
+
+#define ESP_LOGE(tag, format, ...) SHIM_LOG(ESP_LOG_ERROR, "E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) SHIM_LOG(ESP_LOG_WARN, "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) SHIM_LOG(ESP_LOG_INFO, "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) SHIM_LOG(ESP_LOG_DEBUG, "D", tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) SHIM_LOG(ESP_LOG_VERBOSE, "V", tag, format, ##__VA_ARGS__)
+
+#endif  // SNOOPER_HOST_ESP_LOG_H
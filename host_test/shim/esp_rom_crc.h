@@ -0,0 +1,9 @@
+#ifndef SNOOPER_HOST_ESP_ROM_CRC_H
+#define SNOOPER_HOST_ESP_ROM_CRC_H
+
+#include <stdint.h>
+
+// Same CRC-32 as the ROM function
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+#endif  // SNOOPER_HOST_ESP_ROM_CRC_H
@@ -0,0 +1,25 @@
+#ifndef SNOOPER_HOST_ESP_SYSTEM_H
+#define SNOOPER_HOST_ESP_SYSTEM_H
+
+#include "esp_err.h"
+
+typedef enum {
+    ESP_RST_UNKNOWN,
+    ESP_RST_POWERON,
+    ESP_RST_EXT,
+    ESP_RST_SW,
+    ESP_RST_PANIC,
+    ESP_RST_INT_WDT,
+    ESP_RST_TASK_WDT,
+    ESP_RST_WDT,
+    ESP_RST_DEEPSLEEP,
+    ESP_RST_BROWNOUT,
+    ESP_RST_SDIO,
+} esp_reset_reason_t;
+
+// Counts into shim_restarts and returns
+void esp_restart(void);
+
+esp_reset_reason_t esp_reset_reason(void);
+
+#endif  // SNOOPER_HOST_ESP_SYSTEM_H
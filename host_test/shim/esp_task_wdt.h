@@ -0,0 +1,24 @@
+#ifndef SNOOPER_HOST_ESP_TASK_WDT_H
+#define SNOOPER_HOST_ESP_TASK_WDT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/task.h"
+
+typedef struct {
+    uint32_t timeout_ms;
+    uint32_t idle_core_mask;
+    bool trigger_panic;
+} esp_task_wdt_config_t;
+
+typedef void *esp_task_wdt_user_handle_t;
+
+esp_err_t esp_task_wdt_init(const esp_task_wdt_config_t *config);
+esp_err_t esp_task_wdt_add(TaskHandle_t task);
+esp_err_t esp_task_wdt_add_user(const char *name, esp_task_wdt_user_handle_t *user);
+esp_err_t esp_task_wdt_reset(void);
+esp_err_t esp_task_wdt_reset_user(esp_task_wdt_user_handle_t user);
+
+#endif  // SNOOPER_HOST_ESP_TASK_WDT_H
@@ -0,0 +1,9 @@
+#ifndef SNOOPER_HOST_ESP_TIMER_H
+#define SNOOPER_HOST_ESP_TIMER_H
+
+#include <stdint.h>
+
+// Returns shim_time_us
+int64_t esp_timer_get_time(void);
+
+#endif  // SNOOPER_HOST_ESP_TIMER_H
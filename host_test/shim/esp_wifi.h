@@ -0,0 +1,10 @@
+#ifndef SNOOPER_HOST_ESP_WIFI_H
+#define SNOOPER_HOST_ESP_WIFI_H
+
+#include "esp_err.h"
+
+// Defined by the tests that call them
+esp_err_t esp_wifi_connect(void);
+esp_err_t esp_wifi_disconnect(void);
+
+#endif  // SNOOPER_HOST_ESP_WIFI_H
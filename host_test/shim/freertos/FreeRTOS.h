@@ -0,0 +1,34 @@
+#ifndef SNOOPER_HOST_FREERTOS_H
+#define SNOOPER_HOST_FREERTOS_H
+
+#include <stdint.h>
+
+// One recursive lock stands in for every critical section
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0}
+#define portMAX_DELAY ((TickType_t)0xffffffffu)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+
+void shim_enter_critical(portMUX_TYPE *mux);
+void shim_exit_critical(portMUX_TYPE *mux);
+
+#define taskENTER_CRITICAL(mux) shim_enter_critical(mux)
+#define taskEXIT_CRITICAL(mux) shim_exit_critical(mux)
+
+// Tests run as tasks, never as interrupts
+BaseType_t xPortInIsrContext(void);
+
+#endif  // SNOOPER_HOST_FREERTOS_H
@@ -0,0 +1,6 @@
+#ifndef SNOOPER_HOST_EVENT_GROUPS_H
+#define SNOOPER_HOST_EVENT_GROUPS_H
+
+#include "freertos/FreeRTOS.h"
+
+#endif  // SNOOPER_HOST_EVENT_GROUPS_H
@@ -0,0 +1,19 @@
+#ifndef SNOOPER_HOST_QUEUE_H
+#define SNOOPER_HOST_QUEUE_H
+
+#include "freertos/FreeRTOS.h"
+
+// Tests set the number of waiting items directly. Queues carry no items: sends fail and
+// receives time out, so tests call the consuming code themselves.
+typedef struct shim_queue {
+    UBaseType_t waiting;
+} *QueueHandle_t;
+
+typedef struct shim_queue StaticQueue_t;
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t *storage, StaticQueue_t *queue);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks);
+
+#endif  // SNOOPER_HOST_QUEUE_H
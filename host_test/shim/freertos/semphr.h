@@ -0,0 +1,19 @@
+#ifndef SNOOPER_HOST_SEMPHR_H
+#define SNOOPER_HOST_SEMPHR_H
+
+#include <pthread.h>
+
+#include "freertos/FreeRTOS.h"
+
+// Mutexes only
+typedef struct {
+    pthread_mutex_t mutex;
+} StaticSemaphore_t;
+
+typedef StaticSemaphore_t *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+
+#endif  // SNOOPER_HOST_SEMPHR_H
@@ -0,0 +1,26 @@
+#ifndef SNOOPER_HOST_TASK_H
+#define SNOOPER_HOST_TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+typedef struct {
+    int unused;
+} StaticTask_t;
+
+#define taskSCHEDULER_RUNNING 2
+
+TaskHandle_t xTaskGetHandle(const char *name);
+void vTaskDelay(TickType_t ticks);
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority);
+BaseType_t xTaskGetSchedulerState(void);
+
+// Tasks are never run: the handle is the TCB, and the test drives the task's work itself
+TaskHandle_t xTaskCreateStatic(TaskFunction_t function, const char *name, uint32_t stack_bytes, void *param,
+                               UBaseType_t priority, StackType_t *stack, StaticTask_t *tcb);
+void xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+
+#endif  // SNOOPER_HOST_TASK_H
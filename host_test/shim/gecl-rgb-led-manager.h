@@ -0,0 +1,12 @@
+#ifndef SNOOPER_HOST_GECL_RGB_LED_MANAGER_H
+#define SNOOPER_HOST_GECL_RGB_LED_MANAGER_H
+
+// Only the states the tests use; the values have no meaning here
+typedef enum {
+    LED_OFF = 0,
+    LED_RED,
+    LED_GREEN,
+    LED_BLUE,
+} led_state_t;
+
+#endif  // SNOOPER_HOST_GECL_RGB_LED_MANAGER_H
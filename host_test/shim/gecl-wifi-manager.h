@@ -0,0 +1,10 @@
+#ifndef SNOOPER_HOST_GECL_WIFI_MANAGER_H
+#define SNOOPER_HOST_GECL_WIFI_MANAGER_H
+
+#include <stdbool.h>
+
+// Defined by the tests that call them
+void wifi_init_sta(void);
+bool wifi_active(void);
+
+#endif  // SNOOPER_HOST_GECL_WIFI_MANAGER_H
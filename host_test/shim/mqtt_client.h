@@ -0,0 +1,51 @@
+#ifndef SNOOPER_HOST_MQTT_CLIENT_H
+#define SNOOPER_HOST_MQTT_CLIENT_H
+
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+typedef struct esp_mqtt_client *esp_mqtt_client_handle_t;
+
+typedef enum {
+    MQTT_EVENT_ERROR = 0,
+    MQTT_EVENT_CONNECTED,
+    MQTT_EVENT_DISCONNECTED,
+    MQTT_EVENT_SUBSCRIBED,
+    MQTT_EVENT_DATA = 6,
+} esp_mqtt_event_id_t;
+
+// The fields the snooper reads
+typedef struct {
+    esp_mqtt_event_id_t event_id;
+    esp_mqtt_client_handle_t client;
+    char *data;
+    int data_len;
+    int total_data_len;
+    char *topic;
+    int topic_len;
+    int msg_id;
+    bool session_present;
+} esp_mqtt_event_t;
+
+typedef esp_mqtt_event_t *esp_mqtt_event_handle_t;
+
+typedef enum {
+    MQTT_ERROR_TYPE_NONE = 0,
+    MQTT_ERROR_TYPE_TCP_TRANSPORT,
+    MQTT_ERROR_TYPE_CONNECTION_REFUSED,
+    MQTT_ERROR_TYPE_SUBSCRIBE_FAILED,
+} esp_mqtt_error_type_t;
+
+#define MQTT_ERROR_TYPE_ESP_TLS MQTT_ERROR_TYPE_TCP_TRANSPORT
+
+typedef struct {
+    esp_mqtt_error_type_t error_type;
+} esp_mqtt_error_codes_t;
+
+// Defined by the tests that call them
+esp_err_t esp_mqtt_client_reconnect(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client);
+
+#endif  // SNOOPER_HOST_MQTT_CLIENT_H
@@ -0,0 +1,204 @@
+#define _GNU_SOURCE  // Recursive mutex initializer
+
+#include "shim.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cJSON.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "esp_task_wdt.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "mqtt_publish.h"
+
+#define SHIM_TASKS_MAX 16
+
+int64_t shim_time_us = 0;
+int shim_restarts = 0;
+int shim_reset_reason = ESP_RST_SW;
+shim_publish_t shim_published[SHIM_PUBLISH_MAX];
+int shim_publish_count = 0;
+int shim_publish_result = 0;
+
+static pthread_mutex_t critical = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static const char *tasks[SHIM_TASKS_MAX];
+
+// FreeRTOS
+
+void shim_enter_critical(portMUX_TYPE *mux) { pthread_mutex_lock(&critical); }
+
+void shim_exit_critical(portMUX_TYPE *mux) { pthread_mutex_unlock(&critical); }
+
+void shim_task_add(const char *name) {
+    for (int i = 0; i < SHIM_TASKS_MAX; i++) {
+        if (tasks[i] == NULL) {
+            tasks[i] = name;
+            return;
+        }
+    }
+    abort();
+}
+
+void shim_task_remove(const char *name) {
+    for (int i = 0; i < SHIM_TASKS_MAX; i++) {
+        if (tasks[i] != NULL && strcmp(tasks[i], name) == 0) {
+            tasks[i] = NULL;
+        }
+    }
+}
+
+TaskHandle_t xTaskGetHandle(const char *name) {
+    for (int i = 0; i < SHIM_TASKS_MAX; i++) {
+        if (tasks[i] != NULL && strcmp(tasks[i], name) == 0) {
+            return (TaskHandle_t)&tasks[i];
+        }
+    }
+    return NULL;
+}
+
+void vTaskDelay(TickType_t ticks) { shim_time_us += (int64_t)ticks * portTICK_PERIOD_MS * 1000; }
+
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority) {}
+
+BaseType_t xTaskGetSchedulerState(void) { return taskSCHEDULER_RUNNING; }
+
+BaseType_t xPortInIsrContext(void) { return pdFALSE; }
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t function, const char *name, uint32_t stack_bytes, void *param,
+                               UBaseType_t priority, StackType_t *stack, StaticTask_t *tcb) {
+    return tcb;
+}
+
+void xTaskNotifyGive(TaskHandle_t task) {}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) { return 0; }
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) { return queue->waiting; }
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t *storage, StaticQueue_t *queue) {
+    queue->waiting = 0;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks) { return pdFALSE; }
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) { return pdFALSE; }
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer) {
+    pthread_mutex_init(&buffer->mutex, NULL);
+    return buffer;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    return pthread_mutex_lock(&semaphore->mutex) == 0 ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    return pthread_mutex_unlock(&semaphore->mutex) == 0 ? pdTRUE : pdFALSE;
+}
+
+// ESP-IDF
+
+int64_t esp_timer_get_time(void) { return shim_time_us; }
+
+const char *esp_err_to_name(esp_err_t code) { return code == ESP_OK ? "ESP_OK" : "ESP_FAIL"; }
+
+void esp_restart(void) { shim_restarts++; }
+
+esp_reset_reason_t esp_reset_reason(void) { return (esp_reset_reason_t)shim_reset_reason; }
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+    crc = ~crc;
+    while (len-- > 0) {
+        crc ^= *buf++;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xedb88320u & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+esp_err_t esp_task_wdt_init(const esp_task_wdt_config_t *config) { return ESP_OK; }
+
+esp_err_t esp_task_wdt_add(TaskHandle_t task) { return ESP_OK; }
+
+esp_err_t esp_task_wdt_add_user(const char *name, esp_task_wdt_user_handle_t *user) {
+    *user = (esp_task_wdt_user_handle_t)name;
+    return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_reset(void) { return ESP_OK; }
+
+esp_err_t esp_task_wdt_reset_user(esp_task_wdt_user_handle_t user) { return ESP_OK; }
+
+static int default_vprintf(const char *format, va_list args) {
+    return getenv("SHIM_VERBOSE") != NULL ? vfprintf(stderr, format, args) : 0;
+}
+
+static vprintf_like_t log_vprintf = default_vprintf;
+
+uint32_t esp_log_timestamp(void) { return (uint32_t)(shim_time_us / 1000); }
+
+esp_log_level_t esp_log_level_get(const char *tag) { return ESP_LOG_VERBOSE; }
+
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func) {
+    vprintf_like_t previous = log_vprintf;
+    log_vprintf = func;
+    return previous;
+}
+
+void shim_log_reset(void) { log_vprintf = default_vprintf; }
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    log_vprintf(format, args);
+    va_end(args);
+}
+
+// Application modules that talk to the broker
+
+void shim_publish_reset(void) {
+    shim_publish_count = 0;
+    shim_publish_result = 0;
+}
+
+int mqtt_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain) {
+    if (len == 0) {
+        len = (int)strlen(data);
+    }
+    shim_publish_t *publish = &shim_published[shim_publish_count % SHIM_PUBLISH_MAX];
+    snprintf(publish->topic, sizeof(publish->topic), "%s", topic);
+    publish->len = len < SHIM_PAYLOAD_MAX ? len : SHIM_PAYLOAD_MAX;
+    memcpy(publish->data, data, publish->len);
+    shim_publish_count++;
+    return shim_publish_result != 0 ? shim_publish_result : shim_publish_count;
+}
+
+// cJSON
+
+cJSON *cJSON_CreateObject(void) { return NULL; }
+
+cJSON *cJSON_CreateArray(void) { return NULL; }
+
+cJSON *cJSON_CreateNumber(double number) { return NULL; }
+
+cJSON *cJSON_AddNumberToObject(cJSON *object, const char *name, double number) { return NULL; }
+
+cJSON *cJSON_AddObjectToObject(cJSON *object, const char *name) { return NULL; }
+
+int cJSON_AddItemToObject(cJSON *object, const char *name, cJSON *item) { return 0; }
+
+int cJSON_AddItemToArray(cJSON *array, cJSON *item) { return 0; }
+
+char *cJSON_PrintUnformatted(const cJSON *item) { return NULL; }
+
+void cJSON_Delete(cJSON *item) {}
@@ -0,0 +1,44 @@
+#ifndef SNOOPER_HOST_SHIM_H
+#define SNOOPER_HOST_SHIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Controls for the host stand-ins of the FreeRTOS and ESP-IDF APIs
+
+// esp_timer_get_time(); esp_log_timestamp() is derived from it
+extern int64_t shim_time_us;
+
+// Calls to esp_restart(), which returns on the host
+extern int shim_restarts;
+
+// What esp_reset_reason() reports; ESP_RST_SW unless a test changes it
+extern int shim_reset_reason;
+
+// xTaskGetHandle() finds a task only while it is added here
+void shim_task_add(const char *name);
+void shim_task_remove(const char *name);
+
+// Log lines reach the installed vprintf hook; the default one prints them only with
+// SHIM_VERBOSE set in the environment
+void shim_log_reset(void);
+
+// mqtt_publish() keeps a copy of the last SHIM_PUBLISH_MAX payloads and returns
+// shim_publish_result, or a message id counting from 1 when that is 0
+#define SHIM_PUBLISH_MAX 64
+#define SHIM_PAYLOAD_MAX 1024
+
+typedef struct {
+    char topic[64];
+    char data[SHIM_PAYLOAD_MAX];
+    int len;
+} shim_publish_t;
+
+extern shim_publish_t shim_published[SHIM_PUBLISH_MAX];
+extern int shim_publish_count;
+extern int shim_publish_result;
+
+void shim_publish_reset(void);
+
+#endif  // SNOOPER_HOST_SHIM_H
@@ -0,0 +1,28 @@
+#ifndef SNOOPER_HOST_TEST_H
+#define SNOOPER_HOST_TEST_H
+
+#include <stdio.h>
+
+// Minimal test runner: CHECK records a failure and carries on, RUN runs one case, and
+// test_report() is main's exit status
+
+static int test_failures = 0;
+
+#define CHECK(cond)                                                                  \
+    do {                                                                             \
+        if (!(cond)) {                                                               \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            test_failures++;                                                         \
+        }                                                                            \
+    } while (0)
+
+#define RUN(test)                                                            \
+    do {                                                                     \
+        int before = test_failures;                                          \
+        test();                                                              \
+        printf("%s %s\n", test_failures == before ? "PASS" : "FAIL", #test); \
+    } while (0)
+
+static inline int test_report(void) { return test_failures == 0 ? 0 : 1; }
+
+#endif  // SNOOPER_HOST_TEST_H
@@ -0,0 +1,277 @@
+// cbor.c is included for CBOR_MAX_NESTING
+#include "../main/cbor.c"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "test.h"
+
+// Encodes one unsigned integer, returning its length
+static size_t encode_uint(uint8_t *buf, size_t cap, uint64_t value) {
+    cbor_writer_t writer;
+    cbor_writer_init(&writer, buf, cap);
+    cbor_put_uint(&writer, value);
+    return writer.overflow ? 0 : writer.len;
+}
+
+static void test_round_trip(void) {
+    uint8_t buf[128];
+    cbor_writer_t writer;
+
+    cbor_writer_init(&writer, buf, sizeof(buf));
+    cbor_put_map(&writer, 4);
+    cbor_put_text(&writer, "LED");
+    cbor_put_text(&writer, "closed");
+    cbor_put_text(&writer, "seq");
+    cbor_put_int(&writer, 1234);
+    cbor_put_text(&writer, "ok");
+    cbor_put_bool(&writer, true);
+    cbor_put_text(&writer, "list");
+    cbor_put_array(&writer, 3);
+    cbor_put_int(&writer, -5);
+    cbor_put_bool(&writer, false);
+    cbor_put_text_len(&writer, "abcdef", 3);
+    CHECK(!writer.overflow);
+
+    cbor_reader_t reader;
+    size_t count;
+    const char *text;
+    size_t len;
+    int64_t number;
+    bool flag;
+    cbor_major_t major;
+
+    cbor_reader_init(&reader, buf, writer.len);
+    CHECK(cbor_is_map(buf, writer.len));
+    CHECK(cbor_get_map(&reader, &count) && count == 4);
+    CHECK(cbor_get_text(&reader, &text, &len) && len == 3 && memcmp(text, "LED", 3) == 0);
+    // A type mismatch leaves the item in place
+    CHECK(!cbor_get_int(&reader, &number) && !reader.error);
+    CHECK(cbor_get_text(&reader, &text, &len) && len == 6 && memcmp(text, "closed", 6) == 0);
+    CHECK(cbor_get_text(&reader, &text, &len) && len == 3);
+    CHECK(cbor_get_int(&reader, &number) && number == 1234);
+    CHECK(cbor_get_text(&reader, &text, &len) && len == 2);
+    CHECK(cbor_get_bool(&reader, &flag) && flag);
+    CHECK(cbor_get_text(&reader, &text, &len) && len == 4);
+    CHECK(cbor_peek_major(&reader, &major) && major == CBOR_ARRAY);
+    CHECK(cbor_get_array(&reader, &count) && count == 3);
+    CHECK(cbor_get_int(&reader, &number) && number == -5);
+    CHECK(cbor_get_bool(&reader, &flag) && !flag);
+    CHECK(cbor_get_text(&reader, &text, &len) && len == 3 && memcmp(text, "abc", 3) == 0);
+    CHECK(cbor_at_end(&reader) && !reader.error);
+
+    // The same payload skipped as one item
+    cbor_reader_init(&reader, buf, writer.len);
+    CHECK(cbor_skip(&reader) && cbor_at_end(&reader));
+    CHECK(!cbor_is_map("{}", 2));
+}
+
+static void test_head_boundaries(void) {
+    static const struct {
+        uint64_t value;
+        size_t len;
+        uint8_t initial;
+    } cases[] = {
+        {0, 1, 0x00},
+        {23, 1, 0x17},
+        {24, 2, 0x18},
+        {255, 2, 0x18},
+        {256, 3, 0x19},
+        {65535, 3, 0x19},
+        {65536, 5, 0x1a},
+        {UINT32_MAX, 5, 0x1a},
+        {1ull << 32, 9, 0x1b},
+        {INT64_MAX, 9, 0x1b},
+    };
+    uint8_t buf[16];
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        size_t len = encode_uint(buf, sizeof(buf), cases[i].value);
+        CHECK(len == cases[i].len);
+        CHECK(buf[0] == cases[i].initial);
+
+        cbor_reader_t reader;
+        int64_t value;
+        cbor_reader_init(&reader, buf, len);
+        CHECK(cbor_get_int(&reader, &value) && (uint64_t)value == cases[i].value);
+        CHECK(cbor_at_end(&reader));
+    }
+    // Big-endian argument
+    CHECK(encode_uint(buf, sizeof(buf), 0x0102) == 3 && buf[1] == 0x01 && buf[2] == 0x02);
+
+    // Valid CBOR, but too large for int64_t
+    cbor_reader_t reader;
+    int64_t value;
+    size_t len = encode_uint(buf, sizeof(buf), UINT64_MAX);
+    cbor_reader_init(&reader, buf, len);
+    CHECK(!cbor_get_int(&reader, &value) && reader.error);
+}
+
+static void test_negative_ints(void) {
+    static const struct {
+        int64_t value;
+        size_t len;
+        uint8_t initial;
+    } cases[] = {
+        {-1, 1, 0x20},
+        {-24, 1, 0x37},
+        {-25, 2, 0x38},
+        {-256, 2, 0x38},
+        {-257, 3, 0x39},
+        {-65537, 5, 0x3a},
+        {INT64_MIN, 9, 0x3b},
+    };
+    uint8_t buf[16];
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        cbor_writer_t writer;
+        cbor_writer_init(&writer, buf, sizeof(buf));
+        cbor_put_int(&writer, cases[i].value);
+        CHECK(writer.len == cases[i].len);
+        CHECK(buf[0] == cases[i].initial);
+
+        cbor_reader_t reader;
+        int64_t value;
+        cbor_reader_init(&reader, buf, writer.len);
+        CHECK(cbor_get_int(&reader, &value) && value == cases[i].value);
+    }
+
+    // -1 - 2^63 does not fit
+    const uint8_t too_small[] = {0x3b, 0x80, 0, 0, 0, 0, 0, 0, 0};
+    cbor_reader_t reader;
+    int64_t value;
+    cbor_reader_init(&reader, too_small, sizeof(too_small));
+    CHECK(!cbor_get_int(&reader, &value) && reader.error);
+}
+
+static void test_truncated_input(void) {
+    uint8_t buf[64];
+    cbor_writer_t writer;
+
+    cbor_writer_init(&writer, buf, sizeof(buf));
+    cbor_put_map(&writer, 2);
+    cbor_put_text(&writer, "seq");
+    cbor_put_uint(&writer, 70000);
+    cbor_put_text(&writer, "list");
+    cbor_put_array(&writer, 2);
+    cbor_put_int(&writer, -300);
+    cbor_put_text(&writer, "tail");
+
+    // Every proper prefix fails, whether read item by item or skipped
+    for (size_t len = 0; len < writer.len; len++) {
+        cbor_reader_t reader;
+        size_t count;
+        const char *text;
+        size_t text_len;
+        int64_t number;
+
+        cbor_reader_init(&reader, buf, len);
+        CHECK(!cbor_skip(&reader) && reader.error);
+
+        cbor_reader_init(&reader, buf, len);
+        bool complete = cbor_get_map(&reader, &count) && cbor_get_text(&reader, &text, &text_len) &&
+                        cbor_get_int(&reader, &number) && cbor_get_text(&reader, &text, &text_len) &&
+                        cbor_get_array(&reader, &count) && cbor_get_int(&reader, &number) &&
+                        cbor_get_text(&reader, &text, &text_len);
+        CHECK(!complete);
+    }
+
+    // Once set, the error sticks
+    cbor_reader_t reader;
+    int64_t number;
+    cbor_reader_init(&reader, buf, 2);
+    cbor_skip(&reader);
+    reader.len = writer.len;
+    CHECK(!cbor_get_int(&reader, &number) && !cbor_skip(&reader));
+
+    // Indefinite lengths are not supported
+    const uint8_t indefinite[] = {0x9f, 0x01, 0xff};
+    cbor_reader_init(&reader, indefinite, sizeof(indefinite));
+    CHECK(!cbor_skip(&reader) && reader.error);
+}
+
+static void test_counts_must_fit_the_input(void) {
+    cbor_reader_t reader;
+    size_t count;
+
+    // Claims 2^32 items with none following
+    const uint8_t huge_array[] = {0x9b, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00};
+    cbor_reader_init(&reader, huge_array, sizeof(huge_array));
+    CHECK(!cbor_get_array(&reader, &count) && reader.error);
+
+    // Three one-byte items fit; four do not
+    const uint8_t array[] = {0x84, 0x01, 0x02, 0x03};
+    cbor_reader_init(&reader, array, sizeof(array));
+    CHECK(!cbor_get_array(&reader, &count) && reader.error);
+    const uint8_t fits[] = {0x83, 0x01, 0x02, 0x03};
+    cbor_reader_init(&reader, fits, sizeof(fits));
+    CHECK(cbor_get_array(&reader, &count) && count == 3);
+
+    // A map needs two items per pair
+    const uint8_t map[] = {0xa2, 0x01, 0x02, 0x03};
+    cbor_reader_init(&reader, map, sizeof(map));
+    CHECK(!cbor_get_map(&reader, &count) && reader.error);
+    const uint8_t huge_map[] = {0xbb, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02};
+    cbor_reader_init(&reader, huge_map, sizeof(huge_map));
+    CHECK(!cbor_get_map(&reader, &count) && reader.error);
+}
+
+// depth arrays, each holding the next, around an empty one
+static size_t nested_arrays(uint8_t *buf, size_t cap, int depth) {
+    cbor_writer_t writer;
+    cbor_writer_init(&writer, buf, cap);
+    for (int i = 0; i < depth - 1; i++) {
+        cbor_put_array(&writer, 1);
+    }
+    cbor_put_array(&writer, 0);
+    return writer.len;
+}
+
+static void test_nesting_limit(void) {
+    uint8_t buf[CBOR_MAX_NESTING + 4];
+    cbor_reader_t reader;
+
+    // The outermost item is depth 0
+    size_t len = nested_arrays(buf, sizeof(buf), CBOR_MAX_NESTING + 1);
+    cbor_reader_init(&reader, buf, len);
+    CHECK(cbor_skip(&reader) && cbor_at_end(&reader));
+
+    len = nested_arrays(buf, sizeof(buf), CBOR_MAX_NESTING + 2);
+    cbor_reader_init(&reader, buf, len);
+    CHECK(!cbor_skip(&reader) && reader.error);
+
+    // Tags nest too
+    memset(buf, 0xc1, CBOR_MAX_NESTING + 1);  // Tag 1
+    buf[CBOR_MAX_NESTING + 1] = 0x00;
+    cbor_reader_init(&reader, buf, CBOR_MAX_NESTING + 2);
+    CHECK(!cbor_skip(&reader) && reader.error);
+    cbor_reader_init(&reader, buf + 1, CBOR_MAX_NESTING + 1);
+    CHECK(cbor_skip(&reader) && cbor_at_end(&reader));
+}
+
+static void test_writer_overflow(void) {
+    uint8_t buf[8];
+    cbor_writer_t writer;
+
+    cbor_writer_init(&writer, buf, sizeof(buf));
+    cbor_put_text(&writer, "seven!!");
+    CHECK(!writer.overflow && writer.len == 8);
+    cbor_put_uint(&writer, 1);
+    CHECK(writer.overflow);
+    // Nothing more is written, even what would fit
+    cbor_writer_init(&writer, buf, 4);
+    cbor_put_uint(&writer, UINT32_MAX);
+    cbor_put_bool(&writer, true);
+    CHECK(writer.overflow && writer.len == 0);
+}
+
+int main(void) {
+    RUN(test_round_trip);
+    RUN(test_head_boundaries);
+    RUN(test_negative_ints);
+    RUN(test_truncated_input);
+    RUN(test_counts_must_fit_the_input);
+    RUN(test_nesting_limit);
+    RUN(test_writer_overflow);
+    return test_report();
+}
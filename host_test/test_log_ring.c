@@ -0,0 +1,234 @@
+#include "log_ring.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "test.h"
+
+#define PRODUCERS 8
+#define RECORDS_PER_PRODUCER 20000
+#define PAYLOAD_MAX 120
+
+// Every record says who wrote it and when, and its payload is derived from both, so a torn,
+// overwritten or misplaced record shows up as a mismatch
+typedef struct {
+    uint16_t producer;
+    uint16_t payload_len;
+    uint32_t seq;
+} record_header_t;
+
+static uint32_t storage[1024 / sizeof(uint32_t)];
+static log_ring_t ring;
+static atomic_int producers_done;
+static uint32_t accepted[PRODUCERS];
+static uint32_t attempts[PRODUCERS];
+static uint32_t consumed[PRODUCERS];
+static uint32_t corrupt = 0;
+static uint32_t out_of_order = 0;
+
+static void reset_ring(void) {
+    memset(storage, 0, sizeof(storage));
+    ring = (log_ring_t)LOG_RING_INITIALIZER(storage);
+    atomic_store(&producers_done, 0);
+    memset(accepted, 0, sizeof(accepted));
+    memset(attempts, 0, sizeof(attempts));
+    memset(consumed, 0, sizeof(consumed));
+    corrupt = 0;
+    out_of_order = 0;
+}
+
+static uint8_t payload_byte(uint16_t producer, uint32_t seq, int i) { return (uint8_t)(producer * 31 + seq * 7 + i); }
+
+static size_t make_record(uint8_t *buf, uint16_t producer, uint32_t seq) {
+    record_header_t header = {
+        .producer = producer, .payload_len = (seq * 13 + producer) % (PAYLOAD_MAX + 1), .seq = seq};
+    memcpy(buf, &header, sizeof(header));
+    for (int i = 0; i < header.payload_len; i++) {
+        buf[sizeof(header) + i] = payload_byte(producer, seq, i);
+    }
+    return sizeof(header) + header.payload_len;
+}
+
+static void check_record(const uint8_t *data, size_t len, uint32_t *last_seq) {
+    record_header_t header;
+
+    if (len < sizeof(header)) {
+        corrupt++;
+        return;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (header.producer >= PRODUCERS || len != sizeof(header) + header.payload_len) {
+        corrupt++;
+        return;
+    }
+    for (int i = 0; i < header.payload_len; i++) {
+        if (data[sizeof(header) + i] != payload_byte(header.producer, header.seq, i)) {
+            corrupt++;
+            return;
+        }
+    }
+    // Records of one producer come out in the order they went in, with gaps for drops
+    if (consumed[header.producer] > 0 && header.seq <= last_seq[header.producer]) {
+        out_of_order++;
+    }
+    last_seq[header.producer] = header.seq;
+    consumed[header.producer]++;
+}
+
+static void *producer(void *arg) {
+    uint16_t id = (uint16_t)(intptr_t)arg;
+    uint8_t buf[sizeof(record_header_t) + PAYLOAD_MAX];
+
+    for (uint32_t seq = 0; seq < RECORDS_PER_PRODUCER; seq++) {
+        size_t len = make_record(buf, id, seq);
+        // Every other record is retried once after giving the consumer a turn, so the ring
+        // both wraps many times and runs full
+        for (int tries = seq % 2 ? 2 : 1; tries > 0; tries--) {
+            attempts[id]++;
+            if (log_ring_push(&ring, buf, len)) {
+                accepted[id]++;
+                break;
+            }
+            sched_yield();
+        }
+    }
+    atomic_fetch_add(&producers_done, 1);
+    return NULL;
+}
+
+// Drains until every producer has finished and the ring is empty
+static void consume(void) {
+    uint32_t last_seq[PRODUCERS] = {0};
+    const void *data;
+    size_t len;
+
+    while (true) {
+        bool done = atomic_load(&producers_done) == PRODUCERS;
+        if ((len = log_ring_peek(&ring, &data)) > 0) {
+            check_record(data, len, last_seq);
+            log_ring_pop(&ring);
+        } else if (done && log_ring_used(&ring) == 0) {
+            break;
+        } else {
+            // Empty, or the oldest record is reserved by a producer that has not published it
+            sched_yield();
+        }
+    }
+}
+
+static void test_concurrent_producers(void) {
+    pthread_t threads[PRODUCERS];
+
+    reset_ring();
+    for (int i = 0; i < PRODUCERS; i++) {
+        pthread_create(&threads[i], NULL, producer, (void *)(intptr_t)i);
+    }
+    consume();
+    for (int i = 0; i < PRODUCERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    CHECK(corrupt == 0);
+    CHECK(out_of_order == 0);
+    uint32_t total_accepted = 0;
+    uint32_t total_attempts = 0;
+    for (int i = 0; i < PRODUCERS; i++) {
+        CHECK(consumed[i] == accepted[i]);
+        total_accepted += accepted[i];
+        total_attempts += attempts[i];
+    }
+
+    log_ring_stats_t stats;
+    log_ring_get_stats(&ring, &stats);
+    CHECK(stats.records == total_accepted);
+    CHECK(stats.records + stats.dropped_records == total_attempts);
+    CHECK(stats.dropped_records > 0);
+    CHECK(stats.used == 0);
+    CHECK(stats.high_water <= sizeof(storage));
+    // The ring went round many times
+    CHECK(stats.bytes > 100 * sizeof(storage));
+    printf("  %u records accepted, %u dropped\n", (unsigned)stats.records, (unsigned)stats.dropped_records);
+}
+
+static void test_full_ring_drops_newest(void) {
+    uint8_t buf[sizeof(record_header_t) + PAYLOAD_MAX];
+    uint32_t last_seq[PRODUCERS] = {0};
+    uint32_t pushed = 0;
+    uint32_t seq = 0;
+
+    reset_ring();
+    // Nobody consumes: the ring fills up and then refuses records instead of overwriting
+    while (pushed < 1000) {
+        size_t len = make_record(buf, 0, seq++);
+        if (!log_ring_push(&ring, buf, len)) {
+            break;
+        }
+        pushed++;
+    }
+    CHECK(pushed < 1000);
+    for (int i = 0; i < 100; i++) {
+        size_t len = make_record(buf, 0, seq++);
+        log_ring_push(&ring, buf, len);
+    }
+
+    const void *data;
+    size_t len;
+    while ((len = log_ring_peek(&ring, &data)) > 0) {
+        check_record(data, len, last_seq);
+        log_ring_pop(&ring);
+    }
+    CHECK(corrupt == 0);
+    CHECK(out_of_order == 0);
+    CHECK(consumed[0] >= pushed);
+    CHECK(last_seq[0] < seq);  // The dropped ones were the newest
+
+    log_ring_stats_t stats;
+    log_ring_get_stats(&ring, &stats);
+    CHECK(stats.records == consumed[0]);
+    CHECK(stats.records + stats.dropped_records == seq);
+    CHECK(stats.used == 0);
+}
+
+static void test_padding_at_the_end(void) {
+    uint8_t record[200];
+    const void *data;
+
+    reset_ring();
+    // Leave less than a record of room at the end of the buffer
+    for (int i = 0; i < 4; i++) {
+        memset(record, i, sizeof(record));
+        CHECK(log_ring_push(&ring, record, 240 - 4));
+        CHECK(log_ring_peek(&ring, &data) == 240 - 4);
+        log_ring_pop(&ring);
+    }
+    memset(record, 0xaa, sizeof(record));
+    CHECK(log_ring_push(&ring, record, sizeof(record)));
+    CHECK(log_ring_peek(&ring, &data) == sizeof(record));
+    CHECK(data == (const uint8_t *)storage + 4);  // Wrapped to the start, after its header
+    CHECK(memcmp(data, record, sizeof(record)) == 0);
+    log_ring_pop(&ring);
+    CHECK(log_ring_used(&ring) == 0);
+}
+
+static void test_oversized_record_dropped(void) {
+    static uint8_t big[sizeof(storage)];
+
+    reset_ring();
+    CHECK(!log_ring_push(&ring, big, sizeof(storage) / 2));
+    CHECK(log_ring_push(&ring, big, 16));
+    log_ring_stats_t stats;
+    log_ring_get_stats(&ring, &stats);
+    CHECK(stats.dropped_records == 1);
+    CHECK(stats.dropped_bytes == sizeof(storage) / 2);
+    CHECK(stats.used == 20);
+}
+
+int main(void) {
+    RUN(test_padding_at_the_end);
+    RUN(test_oversized_record_dropped);
+    RUN(test_full_ring_drops_newest);
+    RUN(test_concurrent_producers);
+    return test_report();
+}
@@ -0,0 +1,255 @@
+// metrics.c is included so each test starts with an empty registry
+#include "../main/metrics.c"
+
+#include <pthread.h>
+#include <string.h>
+
+#include "cbor.h"
+#include "shim.h"
+#include "test.h"
+
+#define TOPIC "test/metrics"
+#define THREADS 4
+#define UPDATES_PER_THREAD 100000
+
+static void setup(void) {
+    memset(metrics, 0, sizeof(metrics));
+    memset(histograms, 0, sizeof(histograms));
+    atomic_store(&metric_count, 0);
+    histogram_count = 0;
+    frame_seq = 0;
+    keyframe_needed = true;
+    shim_publish_reset();
+}
+
+// A decoded CBOR frame; histograms are reduced to their sample count
+typedef struct {
+    int64_t seq;
+    bool keyframe;
+    int count;
+    char names[METRICS_MAX][32];
+    int64_t values[METRICS_MAX];
+} frame_t;
+
+static bool decode_frame(const shim_publish_t *publish, frame_t *frame) {
+    cbor_reader_t reader;
+    size_t pairs;
+
+    memset(frame, 0, sizeof(*frame));
+    cbor_reader_init(&reader, publish->data, publish->len);
+    if (!cbor_get_map(&reader, &pairs)) {
+        return false;
+    }
+    for (size_t i = 0; i < pairs; i++) {
+        const char *key;
+        size_t key_len;
+        if (!cbor_get_text(&reader, &key, &key_len)) {
+            return false;
+        }
+        if (key_len == 3 && memcmp(key, "seq", 3) == 0) {
+            cbor_get_int(&reader, &frame->seq);
+        } else if (key_len == 2 && memcmp(key, "kf", 2) == 0) {
+            int64_t kf;
+            frame->keyframe = cbor_get_int(&reader, &kf) && kf == 1;
+        } else {
+            size_t metric_count;
+            if (!cbor_get_map(&reader, &metric_count)) {
+                return false;
+            }
+            for (size_t m = 0; m < metric_count; m++) {
+                const char *name;
+                size_t name_len;
+                cbor_major_t major;
+                cbor_get_text(&reader, &name, &name_len);
+                snprintf(frame->names[frame->count], sizeof(frame->names[0]), "%.*s", (int)name_len, name);
+                if (cbor_peek_major(&reader, &major) && major == CBOR_ARRAY) {
+                    size_t items;
+                    cbor_get_array(&reader, &items);
+                    cbor_get_int(&reader, &frame->values[frame->count]);
+                    for (size_t skip = 1; skip < items; skip++) {
+                        cbor_skip(&reader);
+                    }
+                } else {
+                    cbor_get_int(&reader, &frame->values[frame->count]);
+                }
+                frame->count++;
+            }
+        }
+    }
+    return !reader.error && cbor_at_end(&reader);
+}
+
+static bool last_frame(frame_t *frame) {
+    return shim_publish_count > 0 && decode_frame(&shim_published[(shim_publish_count - 1) % SHIM_PUBLISH_MAX], frame);
+}
+
+// Returns the metric's value in the frame, or -1 when the frame leaves it out
+static int64_t frame_value(const frame_t *frame, const char *name) {
+    for (int i = 0; i < frame->count; i++) {
+        if (strcmp(frame->names[i], name) == 0) {
+            return frame->values[i];
+        }
+    }
+    return -1;
+}
+
+static void test_histogram_buckets(void) {
+    setup();
+    metric_t *histogram = metrics_histogram("h");
+    const uint32_t values[] = {0, 1, 2, 3, 4, 7, 8, 1u << 17, (1u << 18) - 1, 1u << 18, 1u << 19, UINT32_MAX};
+    uint32_t sum = 0;
+
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        metric_observe(histogram, values[i]);
+        sum += values[i];
+    }
+    CHECK(atomic_load(&histogram->value) == (int)(sizeof(values) / sizeof(values[0])));
+    CHECK(atomic_load(&histogram->histogram->sum) == sum);  // Wraps
+    CHECK(atomic_load(&histogram->histogram->buckets[0]) == 1);   // 0
+    CHECK(atomic_load(&histogram->histogram->buckets[1]) == 1);   // 1
+    CHECK(atomic_load(&histogram->histogram->buckets[2]) == 2);   // 2, 3
+    CHECK(atomic_load(&histogram->histogram->buckets[3]) == 2);   // 4, 7
+    CHECK(atomic_load(&histogram->histogram->buckets[4]) == 1);   // 8
+    CHECK(atomic_load(&histogram->histogram->buckets[18]) == 2);  // 2^17 up to 2^18 - 1
+    // The last bucket takes 2^18 and everything larger
+    CHECK(atomic_load(&histogram->histogram->buckets[METRIC_HISTOGRAM_BUCKETS - 1]) == 3);
+}
+
+static void test_registry_full_hands_out_scratch(void) {
+    setup();
+    for (int i = 0; i < METRICS_MAX_HISTOGRAMS; i++) {
+        CHECK(metrics_histogram("h") != &scratch);
+    }
+    metric_t *extra_histogram = metrics_histogram("h");
+    CHECK(extra_histogram == &scratch);
+    metric_observe(extra_histogram, 5);  // Safe, just not exported
+    while (atomic_load(&metric_count) < METRICS_MAX) {
+        CHECK(metrics_counter("c") != &scratch);
+    }
+    CHECK(metrics_gauge("g") == &scratch);
+    CHECK(atomic_load(&metric_count) == METRICS_MAX);
+}
+
+static void test_keyframe_then_deltas(void) {
+    frame_t frame;
+
+    setup();
+    metric_t *counter = metrics_counter("counter");
+    metric_t *gauge = metrics_gauge("gauge");
+    metric_t *histogram = metrics_histogram("histogram");
+    metric_set_threshold(gauge, 10);
+    metric_set_threshold(histogram, 2);
+
+    // The first frame is a keyframe even when a delta was asked for
+    metric_inc(counter);
+    CHECK(metrics_publish_delta(NULL, TOPIC, PAYLOAD_CBOR));
+    CHECK(last_frame(&frame));
+    CHECK(frame.keyframe);
+    CHECK(frame.seq == 0);
+    CHECK(frame.count == 3);
+    CHECK(frame_value(&frame, "counter") == 1);
+    CHECK(frame_value(&frame, "gauge") == 0);
+    CHECK(frame_value(&frame, "histogram") == 0);
+
+    // Nothing moved
+    CHECK(!metrics_publish_delta(NULL, TOPIC, PAYLOAD_CBOR));
+    CHECK(shim_publish_count == 1);
+
+    // Within the thresholds only the counter is sent
+    metric_inc(counter);
+    metric_set(gauge, 10);
+    metric_observe(histogram, 100);
+    metric_observe(histogram, 100);
+    CHECK(metrics_publish_delta(NULL, TOPIC, PAYLOAD_CBOR));
+    CHECK(last_frame(&frame));
+    CHECK(!frame.keyframe);
+    CHECK(frame.seq == 1);
+    CHECK(frame.count == 1);
+    CHECK(frame_value(&frame, "counter") == 2);
+
+    // Past them, at their current value
+    metric_set(gauge, 11);
+    metric_observe(histogram, 100);
+    CHECK(metrics_publish_delta(NULL, TOPIC, PAYLOAD_CBOR));
+    CHECK(last_frame(&frame));
+    CHECK(frame.count == 2);
+    CHECK(frame_value(&frame, "gauge") == 11);
+    CHECK(frame_value(&frame, "histogram") == 3);
+
+    // A keyframe carries everything
+    metrics_publish(NULL, TOPIC, PAYLOAD_CBOR);
+    CHECK(last_frame(&frame));
+    CHECK(frame.keyframe);
+    CHECK(frame.seq == 3);
+    CHECK(frame.count == 3);
+}
+
+static void test_failed_publish_forces_keyframe(void) {
+    frame_t frame;
+
+    setup();
+    metric_t *counter = metrics_counter("counter");
+    metrics_counter("idle");
+    metrics_publish(NULL, TOPIC, PAYLOAD_CBOR);
+
+    metric_inc(counter);
+    shim_publish_result = -1;
+    CHECK(!metrics_publish_delta(NULL, TOPIC, PAYLOAD_CBOR));
+    shim_publish_result = 0;
+
+    // The receiver may have missed the change, so the next frame is a keyframe with the same seq
+    CHECK(metrics_publish_delta(NULL, TOPIC, PAYLOAD_CBOR));
+    CHECK(last_frame(&frame));
+    CHECK(frame.keyframe);
+    CHECK(frame.seq == 1);
+    CHECK(frame.count == 2);
+    CHECK(frame_value(&frame, "counter") == 1);
+}
+
+static metric_t *shared_counter;
+static metric_t *shared_histogram;
+
+static void *update(void *arg) {
+    for (uint32_t i = 0; i < UPDATES_PER_THREAD; i++) {
+        metric_inc(shared_counter);
+        metric_observe(shared_histogram, i & 0xff);
+    }
+    return NULL;
+}
+
+static void test_concurrent_updates(void) {
+    pthread_t threads[THREADS];
+
+    setup();
+    shared_counter = metrics_counter("counter");
+    shared_histogram = metrics_histogram("histogram");
+    for (int i = 0; i < THREADS; i++) {
+        pthread_create(&threads[i], NULL, update, NULL);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    CHECK(atomic_load(&shared_counter->value) == THREADS * UPDATES_PER_THREAD);
+    CHECK(atomic_load(&shared_histogram->value) == THREADS * UPDATES_PER_THREAD);
+    uint32_t bucketed = 0;
+    for (int i = 0; i < METRIC_HISTOGRAM_BUCKETS; i++) {
+        bucketed += atomic_load(&shared_histogram->histogram->buckets[i]);
+    }
+    CHECK(bucketed == THREADS * UPDATES_PER_THREAD);
+    // Every thread observes 0..255 the same number of times
+    uint32_t per_thread_sum = (UPDATES_PER_THREAD / 256) * (255 * 256 / 2);
+    for (uint32_t i = UPDATES_PER_THREAD / 256 * 256; i < UPDATES_PER_THREAD; i++) {
+        per_thread_sum += i & 0xff;
+    }
+    CHECK(atomic_load(&shared_histogram->histogram->sum) == THREADS * per_thread_sum);
+}
+
+int main(void) {
+    RUN(test_histogram_buckets);
+    RUN(test_registry_full_hands_out_scratch);
+    RUN(test_keyframe_then_deltas);
+    RUN(test_failed_publish_forces_keyframe);
+    RUN(test_concurrent_updates);
+    return test_report();
+}
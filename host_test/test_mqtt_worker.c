@@ -0,0 +1,256 @@
+// mqtt_worker.c is included so each test can start from an empty queue and drive the worker
+#include "../main/mqtt_worker.c"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "shim.h"
+#include "test.h"
+
+#define EVICT_TOPIC "test/evict"
+#define REJECT_TOPIC "test/reject"
+#define STRESS_MESSAGES 20000
+#define HANDLED_MAX (STRESS_MESSAGES * 2)
+#define HANDLER_US 500
+
+// The worker's heartbeats are not under test
+supervised_t *supervisor_register(const char *task_name, uint32_t deadline_ms, supervisor_restart_t restart) {
+    return NULL;
+}
+
+void supervisor_heartbeat(supervised_t *task) {}
+
+typedef struct {
+    int topic_index;
+    int value;
+} handled_t;
+
+static handled_t handled[HANDLED_MAX];
+static int handled_count;
+static bool advance_clock;
+
+static void record(const mqtt_work_item_t *item) {
+    if (handled_count < HANDLED_MAX) {
+        handled[handled_count++] = (handled_t){.topic_index = item->topic_index, .value = atoi(item->data)};
+    }
+    if (advance_clock) {
+        shim_time_us += HANDLER_US;
+    }
+}
+
+static void setup(void) {
+    route_count = 0;
+    queue_head = 0;
+    queue_count = 0;
+    memset(&stats, 0, sizeof(stats));
+    atomic_store(&received_metric->value, 0);
+    atomic_store(&dropped_metric->value, 0);
+    atomic_store(&handler_metric->value, 0);
+    atomic_store(&handler_metric->histogram->sum, 0);
+    handled_count = 0;
+    advance_clock = false;
+    shim_time_us = 0;
+    mqtt_worker_register(EVICT_TOPIC, MQTT_WORK_DROP_OLDEST, record);
+    mqtt_worker_register(REJECT_TOPIC, MQTT_WORK_REJECT, record);
+}
+
+static bool submit(const char *topic, int value) {
+    char data[16];
+    int len = snprintf(data, sizeof(data), "%d", value);
+    esp_mqtt_event_t event = {.event_id = MQTT_EVENT_DATA,
+                              .topic = (char *)topic,
+                              .topic_len = strlen(topic),
+                              .data = data,
+                              .data_len = len,
+                              .total_data_len = len};
+    return mqtt_worker_submit(&event);
+}
+
+static void drain(void) {
+    while (handle_next()) {
+    }
+}
+
+static void test_drop_oldest_keeps_the_newest(void) {
+    mqtt_worker_stats_t snapshot;
+
+    setup();
+    for (int i = 0; i < 12; i++) {
+        CHECK(submit(EVICT_TOPIC, i));
+    }
+    drain();
+
+    CHECK(handled_count == MQTT_WORK_QUEUE_LENGTH);
+    for (int i = 0; i < handled_count; i++) {
+        CHECK(handled[i].value == 12 - MQTT_WORK_QUEUE_LENGTH + i);
+    }
+    mqtt_worker_get_stats(&snapshot);
+    CHECK(snapshot.received == 12);
+    CHECK(snapshot.dropped == 12 - MQTT_WORK_QUEUE_LENGTH);
+    CHECK(snapshot.handled == MQTT_WORK_QUEUE_LENGTH);
+    CHECK(snapshot.depth == 0);
+    CHECK(snapshot.depth_high_water == MQTT_WORK_QUEUE_LENGTH);
+}
+
+static void test_reject_keeps_the_oldest(void) {
+    mqtt_worker_stats_t snapshot;
+
+    setup();
+    for (int i = 0; i < 12; i++) {
+        CHECK(submit(REJECT_TOPIC, i) == (i < MQTT_WORK_QUEUE_LENGTH));
+    }
+    drain();
+
+    CHECK(handled_count == MQTT_WORK_QUEUE_LENGTH);
+    for (int i = 0; i < handled_count; i++) {
+        CHECK(handled[i].value == i);
+    }
+    mqtt_worker_get_stats(&snapshot);
+    CHECK(snapshot.received == 12);
+    CHECK(snapshot.dropped == 12 - MQTT_WORK_QUEUE_LENGTH);
+    CHECK(snapshot.depth_high_water == MQTT_WORK_QUEUE_LENGTH);
+}
+
+static void test_eviction_only_takes_its_own_topic(void) {
+    mqtt_worker_stats_t snapshot;
+
+    setup();
+    // reject 0, evict 100, reject 1, evict 101, ... fills the queue
+    for (int i = 0; i < MQTT_WORK_QUEUE_LENGTH / 2; i++) {
+        CHECK(submit(REJECT_TOPIC, i));
+        CHECK(submit(EVICT_TOPIC, 100 + i));
+    }
+    CHECK(submit(EVICT_TOPIC, 200));  // Evicts 100
+    CHECK(submit(EVICT_TOPIC, 201));  // Evicts 101
+    CHECK(!submit(REJECT_TOPIC, 99));
+    drain();
+
+    const handled_t expected[] = {{1, 0}, {1, 1}, {1, 2}, {0, 102}, {1, 3}, {0, 103}, {0, 200}, {0, 201}};
+    CHECK(handled_count == (int)(sizeof(expected) / sizeof(expected[0])));
+    for (int i = 0; i < handled_count; i++) {
+        CHECK(handled[i].topic_index == expected[i].topic_index);
+        CHECK(handled[i].value == expected[i].value);
+    }
+    mqtt_worker_get_stats(&snapshot);
+    CHECK(snapshot.dropped == 3);
+
+    // With none of its own queued, a drop-oldest topic is rejected too
+    setup();
+    for (int i = 0; i < MQTT_WORK_QUEUE_LENGTH; i++) {
+        CHECK(submit(REJECT_TOPIC, i));
+    }
+    CHECK(!submit(EVICT_TOPIC, 100));
+    drain();
+    CHECK(handled_count == MQTT_WORK_QUEUE_LENGTH);
+    CHECK(handled[handled_count - 1].topic_index == 1);
+}
+
+static void test_oversized_and_unrouted(void) {
+    static char big[MQTT_WORK_DATA_MAX + 1];
+    mqtt_worker_stats_t snapshot;
+
+    setup();
+    memset(big, '7', sizeof(big));
+    esp_mqtt_event_t event = {.topic = EVICT_TOPIC,
+                              .topic_len = strlen(EVICT_TOPIC),
+                              .data = big,
+                              .data_len = sizeof(big),
+                              .total_data_len = sizeof(big)};
+    CHECK(!mqtt_worker_submit(&event));
+    // A fragment of a larger message
+    event.data_len = 10;
+    CHECK(!mqtt_worker_submit(&event));
+    // Exactly the limit fits
+    event.data_len = event.total_data_len = MQTT_WORK_DATA_MAX;
+    CHECK(mqtt_worker_submit(&event));
+    CHECK(!submit("test/unknown", 1));
+    drain();
+
+    CHECK(handled_count == 1);
+    mqtt_worker_get_stats(&snapshot);
+    CHECK(snapshot.received == 3);  // Unrouted topics are not counted
+    CHECK(snapshot.dropped == 2);
+}
+
+static void test_handler_and_latency_times(void) {
+    mqtt_worker_stats_t snapshot;
+
+    setup();
+    advance_clock = true;
+    for (int i = 0; i < 4; i++) {
+        CHECK(submit(REJECT_TOPIC, i));
+    }
+    shim_time_us += 1000;
+    drain();
+
+    mqtt_worker_get_stats(&snapshot);
+    CHECK(snapshot.handled == 4);
+    CHECK(snapshot.handler_time_us == 4 * HANDLER_US);
+    CHECK(snapshot.handler_max_us == HANDLER_US);
+    // The last one waited for the three before it
+    CHECK(snapshot.latency_max_us == 1000 + 4 * HANDLER_US);
+    CHECK(snapshot.depth_high_water == 4);
+}
+
+static atomic_bool producing;
+
+static void *produce(void *arg) {
+    for (int i = 0; i < STRESS_MESSAGES; i++) {
+        submit(EVICT_TOPIC, i);
+        submit(REJECT_TOPIC, i);
+        if (i % 16 == 0) {
+            sched_yield();
+        }
+    }
+    atomic_store(&producing, false);
+    return NULL;
+}
+
+static void test_stress(void) {
+    pthread_t producer;
+    mqtt_worker_stats_t snapshot;
+
+    setup();
+    atomic_store(&producing, true);
+    pthread_create(&producer, NULL, produce, NULL);
+    while (atomic_load(&producing)) {
+        if (!handle_next()) {
+            sched_yield();
+        }
+    }
+    pthread_join(producer, NULL);
+    drain();
+
+    // Each topic comes out in order, with gaps only where messages were dropped
+    int last[2] = {-1, -1};
+    bool ordered = true;
+    for (int i = 0; i < handled_count; i++) {
+        ordered &= handled[i].value > last[handled[i].topic_index];
+        last[handled[i].topic_index] = handled[i].value;
+    }
+    CHECK(ordered);
+    mqtt_worker_get_stats(&snapshot);
+    CHECK(snapshot.received == 2 * STRESS_MESSAGES);
+    CHECK(snapshot.handled == (uint32_t)handled_count);
+    CHECK(snapshot.handled + snapshot.dropped == snapshot.received);
+    CHECK(snapshot.depth == 0);
+    CHECK(snapshot.depth_high_water <= MQTT_WORK_QUEUE_LENGTH);
+    // Drop-oldest always ends with the newest message
+    CHECK(last[0] == STRESS_MESSAGES - 1);
+    printf("  %u handled, %u dropped, max depth %u\n", (unsigned)snapshot.handled, (unsigned)snapshot.dropped,
+           (unsigned)snapshot.depth_high_water);
+}
+
+int main(void) {
+    start_mqtt_worker();
+    RUN(test_drop_oldest_keeps_the_newest);
+    RUN(test_reject_keeps_the_oldest);
+    RUN(test_eviction_only_takes_its_own_topic);
+    RUN(test_oversized_and_unrouted);
+    RUN(test_handler_and_latency_times);
+    RUN(test_stress);
+    return test_report();
+}
@@ -0,0 +1,188 @@
+// recovery.c is included so each test can drive the ladder's events and window expiries
+#include "../main/recovery.c"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "shim.h"
+#include "test.h"
+
+// Simulated network: MQTT_EVENT_CONNECTED follows a handshake after the rung that clears the fault,
+// and a Wi-Fi rejoin through the cache takes an association
+#define TLS_HANDSHAKE_MS 1500
+#define CACHED_ASSOC_MS 1200
+
+static int64_t wifi_up_at_us;
+static int reconnects;
+static int restarts_before;
+static bool cache_used;
+
+esp_err_t esp_mqtt_client_reconnect(esp_mqtt_client_handle_t client) {
+    reconnects++;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client) { return ESP_OK; }
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client) { return ESP_OK; }
+
+esp_err_t esp_wifi_connect(void) { return ESP_OK; }
+
+esp_err_t esp_wifi_disconnect(void) {
+    wifi_up_at_us = INT64_MAX;
+    return ESP_OK;
+}
+
+bool wifi_cache_connect(int64_t started_us) {
+    cache_used = true;
+    wifi_up_at_us = shim_time_us + CACHED_ASSOC_MS * 1000;
+    return true;
+}
+
+bool wifi_active(void) { return shim_time_us >= wifi_up_at_us; }
+
+void rtc_journal_event(const char *text) {}
+
+static void setup(void) {
+    memset(&stats, 0, sizeof(stats));
+    fault_active = false;
+    shim_time_us = 1000000;
+    wifi_up_at_us = 0;
+    reconnects = 0;
+    cache_used = false;
+    restarts_before = shim_restarts;
+}
+
+static void post(recovery_event_type_t type, recovery_error_class_t error_class) {
+    recovery_event_t event = {.type = type, .error_class = error_class, .timestamp_us = shim_time_us};
+    handle_event(&event);
+}
+
+// Runs one fault through the ladder; returns the step it recovered at, or RECOVERY_STEP_REBOOT
+static recovery_step_t run_fault(recovery_error_class_t error_class, recovery_step_t fixed_by) {
+    post(RECOVERY_EVENT_ERROR, error_class);
+    // Further errors from the same outage are absorbed
+    post(RECOVERY_EVENT_ERROR, RECOVERY_ERROR_OTHER);
+    while (step < fixed_by && step < RECOVERY_STEP_REBOOT) {
+        shim_time_us += (int64_t)step_wait() * 1000;
+        CHECK(step_wait() == 0);
+        escalate();
+    }
+    if (step == RECOVERY_STEP_REBOOT) {
+        return step;
+    }
+    shim_time_us += TLS_HANDSHAKE_MS * 1000;
+    post(RECOVERY_EVENT_CONNECTED, RECOVERY_ERROR_OTHER);
+    return step;
+}
+
+static uint64_t mean_ttr_ms(recovery_error_class_t error_class) {
+    return stats.recoveries[error_class] ? stats.recovery_time_us[error_class] / stats.recoveries[error_class] / 1000
+                                         : 0;
+}
+
+static void test_transport_fixes_a_tls_hiccup(void) {
+    setup();
+    CHECK(step_wait() == portMAX_DELAY);
+    CHECK(run_fault(RECOVERY_ERROR_TLS, RECOVERY_STEP_TRANSPORT) == RECOVERY_STEP_TRANSPORT);
+    CHECK(!fault_active);
+    CHECK(reconnects == 1);
+    CHECK(stats.faults[RECOVERY_ERROR_TLS] == 1);
+    CHECK(stats.faults[RECOVERY_ERROR_OTHER] == 0);
+    CHECK(stats.step_attempts[RECOVERY_STEP_TRANSPORT] == 1);
+    CHECK(stats.step_successes[RECOVERY_STEP_TRANSPORT] == 1);
+    CHECK(stats.step_attempts[RECOVERY_STEP_MQTT] == 0);
+    CHECK(mean_ttr_ms(RECOVERY_ERROR_TLS) == TLS_HANDSHAKE_MS);
+    CHECK(shim_restarts == restarts_before);
+}
+
+static void test_escalates_to_mqtt_restart(void) {
+    setup();
+    CHECK(run_fault(RECOVERY_ERROR_CONNECTION_REFUSED, RECOVERY_STEP_MQTT) == RECOVERY_STEP_MQTT);
+    CHECK(stats.step_attempts[RECOVERY_STEP_TRANSPORT] == 1);
+    CHECK(stats.step_successes[RECOVERY_STEP_TRANSPORT] == 0);
+    CHECK(stats.step_time_us[RECOVERY_STEP_TRANSPORT] == RECOVERY_TRANSPORT_WINDOW_MS * 1000ull);
+    CHECK(stats.step_successes[RECOVERY_STEP_MQTT] == 1);
+    CHECK(mean_ttr_ms(RECOVERY_ERROR_CONNECTION_REFUSED) == RECOVERY_TRANSPORT_WINDOW_MS + TLS_HANDSHAKE_MS);
+}
+
+static void test_wifi_rejoin_uses_the_cache(void) {
+    setup();
+    CHECK(run_fault(RECOVERY_ERROR_OTHER, RECOVERY_STEP_WIFI) == RECOVERY_STEP_WIFI);
+    CHECK(cache_used);
+    // Transport, then the reconnect once the station is back
+    CHECK(reconnects == 2);
+    CHECK(stats.step_successes[RECOVERY_STEP_WIFI] == 1);
+    // The rejoin is polled every RECOVERY_WIFI_POLL_MS
+    uint64_t assoc_ms = (CACHED_ASSOC_MS + RECOVERY_WIFI_POLL_MS - 1) / RECOVERY_WIFI_POLL_MS * RECOVERY_WIFI_POLL_MS;
+    CHECK(mean_ttr_ms(RECOVERY_ERROR_OTHER) ==
+          RECOVERY_TRANSPORT_WINDOW_MS + RECOVERY_MQTT_WINDOW_MS + assoc_ms + TLS_HANDSHAKE_MS);
+}
+
+static void test_reboots_only_at_the_last_rung(void) {
+    setup();
+    CHECK(run_fault(RECOVERY_ERROR_TLS, RECOVERY_STEP_COUNT) == RECOVERY_STEP_REBOOT);
+    CHECK(shim_restarts == restarts_before + 1);
+    for (int i = 0; i < RECOVERY_STEP_COUNT; i++) {
+        CHECK(stats.step_attempts[i] == 1);
+        CHECK(stats.step_successes[i] == 0);
+    }
+    CHECK(stats.recoveries[RECOVERY_ERROR_TLS] == 0);
+}
+
+static void test_connected_without_a_fault_is_ignored(void) {
+    setup();
+    post(RECOVERY_EVENT_CONNECTED, RECOVERY_ERROR_OTHER);
+    CHECK(!fault_active);
+    for (int i = 0; i < RECOVERY_ERROR_COUNT; i++) {
+        CHECK(stats.recoveries[i] == 0);
+    }
+
+    // An error classified from the esp-mqtt error codes
+    esp_mqtt_error_codes_t codes = {.error_type = MQTT_ERROR_TYPE_CONNECTION_REFUSED};
+    CHECK(classify_error(&codes) == RECOVERY_ERROR_CONNECTION_REFUSED);
+    codes.error_type = MQTT_ERROR_TYPE_ESP_TLS;
+    CHECK(classify_error(&codes) == RECOVERY_ERROR_TLS);
+    CHECK(classify_error(NULL) == RECOVERY_ERROR_OTHER);
+}
+
+// A mix of outages, reported as mean time to recovery per error class
+static void test_mean_time_to_recovery(void) {
+    static const struct {
+        recovery_error_class_t error_class;
+        recovery_step_t fixed_by;
+        int count;
+    } outages[] = {
+        {RECOVERY_ERROR_TLS, RECOVERY_STEP_TRANSPORT, 8},
+        {RECOVERY_ERROR_TLS, RECOVERY_STEP_MQTT, 2},
+        {RECOVERY_ERROR_CONNECTION_REFUSED, RECOVERY_STEP_MQTT, 4},
+        {RECOVERY_ERROR_OTHER, RECOVERY_STEP_TRANSPORT, 5},
+        {RECOVERY_ERROR_OTHER, RECOVERY_STEP_WIFI, 5},
+    };
+
+    setup();
+    for (size_t i = 0; i < sizeof(outages) / sizeof(outages[0]); i++) {
+        for (int n = 0; n < outages[i].count; n++) {
+            run_fault(outages[i].error_class, outages[i].fixed_by);
+            shim_time_us += 60 * 1000000LL;
+        }
+    }
+    CHECK(stats.recoveries[RECOVERY_ERROR_TLS] == 10);
+    CHECK(stats.recoveries[RECOVERY_ERROR_CONNECTION_REFUSED] == 4);
+    CHECK(stats.recoveries[RECOVERY_ERROR_OTHER] == 10);
+    CHECK(shim_restarts == restarts_before);
+    for (int i = 0; i < RECOVERY_ERROR_COUNT; i++) {
+        printf("  %-7s mean time to recovery %llu ms over %lu faults\n", error_names[i],
+               (unsigned long long)mean_ttr_ms(i), (unsigned long)stats.recoveries[i]);
+    }
+}
+
+int main(void) {
+    RUN(test_transport_fixes_a_tls_hiccup);
+    RUN(test_escalates_to_mqtt_restart);
+    RUN(test_wifi_rejoin_uses_the_cache);
+    RUN(test_reboots_only_at_the_last_rung);
+    RUN(test_connected_without_a_fault_is_ignored);
+    RUN(test_mean_time_to_recovery);
+    return test_report();
+}
@@ -0,0 +1,164 @@
+// rtc_journal.c is included so the tests can reboot it: its RAM state is reset while the
+// journal, which lives in RTC memory on the device, is kept
+#include "../main/rtc_journal.c"
+
+#include "shim.h"
+#include "test.h"
+
+#define DRAINED_MAX (2 * RTC_JOURNAL_RECORDS)
+
+// What rtc_journal_drain() hands to the cloud log
+static char drained_lines[DRAINED_MAX][JOURNAL_LINE_MAX];
+static int drained_count = 0;
+
+void cloud_log_append(const void *data, size_t len, bool urgent) {
+    if (drained_count < DRAINED_MAX) {
+        memcpy(drained_lines[drained_count], data, len);
+        drained_lines[drained_count][len] = '\0';
+    }
+    drained_count++;
+}
+
+void cloud_log_flush(void) {}
+
+static void reboot(esp_reset_reason_t reason) {
+    next_seq = 1;
+    boot_start_seq = 1;
+    drained = false;
+    memset(&stats, 0, sizeof(stats));
+    shim_log_reset();
+    shim_reset_reason = reason;
+    init_rtc_journal();
+}
+
+static void drain(void) {
+    drained_count = 0;
+    rtc_journal_drain(NULL, "log");
+}
+
+static bool drained_line_has(int index, const char *text) {
+    return index < drained_count && strstr(drained_lines[index], text) != NULL;
+}
+
+static void test_records_survive_reboot(void) {
+    reboot(ESP_RST_POWERON);
+    rtc_journal_event("first");
+    rtc_journal_event("second");
+    reboot(ESP_RST_PANIC);
+    CHECK(stats.boot_count == 2);
+    CHECK(stats.records == 3);  // Reset reason plus two events
+    CHECK(stats.corrupt == 0);
+
+    drain();
+    CHECK(drained_count == 3);
+    CHECK(drained_line_has(0, "boot 1 reset: reset reason: power-on"));
+    CHECK(drained_line_has(1, "boot 1 event: first"));
+    CHECK(drained_line_has(2, "boot 1 event: second"));
+    CHECK(stats.drained == 3);
+
+    // Shipped once only, also after the next reboot
+    drain();
+    CHECK(drained_count == 0);
+    reboot(ESP_RST_SW);
+    drain();
+    CHECK(drained_count == 1);
+    CHECK(drained_line_has(0, "boot 2 reset: reset reason: panic"));
+}
+
+static void test_wraparound_keeps_newest(void) {
+    char text[16];
+
+    reboot(ESP_RST_POWERON);
+    for (int i = 0; i < 3 * RTC_JOURNAL_RECORDS; i++) {
+        snprintf(text, sizeof(text), "event %d", i);
+        rtc_journal_event(text);
+    }
+    reboot(ESP_RST_SW);
+    CHECK(stats.records == RTC_JOURNAL_RECORDS);
+    CHECK(stats.corrupt == 0);
+
+    // This boot's reset record took the slot of the oldest one
+    drain();
+    CHECK(drained_count == RTC_JOURNAL_RECORDS - 1);
+    for (int i = 0; i < drained_count; i++) {
+        snprintf(text, sizeof(text), "event %d\n", 2 * RTC_JOURNAL_RECORDS + 1 + i);
+        CHECK(drained_line_has(i, text));
+    }
+}
+
+static void test_corrupt_record_skipped(void) {
+    reboot(ESP_RST_POWERON);
+    rtc_journal_event("kept");
+    rtc_journal_event("damaged");
+    rtc_journal_event("also kept");
+    // A reset in the middle of writing the record
+    journal.records[(boot_start_seq + 2) % RTC_JOURNAL_RECORDS].text[0] ^= 0x01;
+    reboot(ESP_RST_TASK_WDT);
+    CHECK(stats.corrupt == 1);
+    CHECK(stats.records == 3);
+
+    drain();
+    CHECK(drained_count == 3);
+    CHECK(drained_line_has(1, "event: kept"));
+    CHECK(drained_line_has(2, "event: also kept"));
+}
+
+static void test_corrupt_header_clears_journal(void) {
+    reboot(ESP_RST_POWERON);
+    rtc_journal_event("lost");
+    journal.header.drained_seq ^= 0x10;
+    reboot(ESP_RST_SW);
+    CHECK(stats.boot_count == 1);
+    CHECK(stats.records == 0);
+    drain();
+    CHECK(drained_count == 0);
+}
+
+static void test_power_on_clears_journal(void) {
+    reboot(ESP_RST_POWERON);
+    rtc_journal_event("lost");
+    reboot(ESP_RST_POWERON);
+    CHECK(stats.records == 0);
+    CHECK(stats.boot_count == 1);
+}
+
+static void test_log_lines_are_compacted(void) {
+    static const char *TEST_TAG = "TEST";
+
+    reboot(ESP_RST_POWERON);
+    shim_time_us = 1234000;
+    ESP_LOGE(TEST_TAG, "something failed: %d", 42);
+    ESP_LOGW(TEST_TAG, "something odd");
+    ESP_LOGI(TEST_TAG, "not journaled");
+    reboot(ESP_RST_SW);
+
+    drain();
+    CHECK(drained_count == 3);
+    CHECK(drained_line_has(1, "boot 1 log: E TEST: something failed: 42"));
+    CHECK(drained_line_has(2, "boot 1 log: W TEST: something odd"));
+}
+
+static void test_colour_codes_stripped(void) {
+    char coloured[] = "\033[0;31mE (99) TEST: red\033[0m\n";
+    char broken[] = "\033[0;31";
+
+    reboot(ESP_RST_POWERON);
+    journal_line(coloured, strlen(coloured));
+    journal_line(broken, strlen(broken));  // No 'm': not journaled, and no crash
+    reboot(ESP_RST_SW);
+
+    drain();
+    CHECK(drained_count == 2);
+    CHECK(drained_line_has(1, "boot 1 log: E TEST: red\n"));
+}
+
+int main(void) {
+    RUN(test_records_survive_reboot);
+    RUN(test_wraparound_keeps_newest);
+    RUN(test_corrupt_record_skipped);
+    RUN(test_corrupt_header_clears_journal);
+    RUN(test_power_on_clears_journal);
+    RUN(test_log_lines_are_compacted);
+    RUN(test_colour_codes_stripped);
+    return test_report();
+}
@@ -0,0 +1,144 @@
+// status_filter.c is included so each test can start without a last accepted status
+#include "../main/status_filter.c"
+
+#include <string.h>
+
+#include "test.h"
+
+#define NOW 1700000000
+
+static void setup(void) {
+    have_last = false;
+    last_state = LED_OFF;
+    last_has_sequence = false;
+    last_sequence = 0;
+    last_has_boot = false;
+    last_boot = 0;
+    last_timestamp = 0;
+    memset(&stats, 0, sizeof(stats));
+}
+
+static status_filter_result_t seq(led_state_t state, uint32_t sequence) {
+    status_message_t msg = {.state = state, .has_sequence = true, .sequence = sequence};
+    return status_filter_accept(&msg, NOW);
+}
+
+static status_filter_result_t seq_boot(led_state_t state, uint32_t sequence, uint32_t boot) {
+    status_message_t msg = {.state = state, .has_sequence = true, .sequence = sequence, .has_boot = true, .boot = boot};
+    return status_filter_accept(&msg, NOW);
+}
+
+static status_filter_result_t ts(led_state_t state, int64_t timestamp) {
+    status_message_t msg = {.state = state, .has_timestamp = true, .timestamp = timestamp};
+    return status_filter_accept(&msg, NOW);
+}
+
+static status_filter_result_t seq_ts(led_state_t state, uint32_t sequence, int64_t timestamp) {
+    status_message_t msg = {
+        .state = state, .has_sequence = true, .sequence = sequence, .has_timestamp = true, .timestamp = timestamp};
+    return status_filter_accept(&msg, NOW);
+}
+
+static void test_untagged_messages_are_current(void) {
+    setup();
+    status_message_t msg = {.state = LED_RED};
+    CHECK(status_filter_accept(&msg, NOW) == STATUS_FILTER_APPLY);
+    CHECK(status_filter_accept(&msg, NOW) == STATUS_FILTER_COALESCE);
+    msg.state = LED_GREEN;
+    CHECK(status_filter_accept(&msg, 0) == STATUS_FILTER_APPLY);
+}
+
+static void test_stale_timestamp_dropped(void) {
+    setup();
+    CHECK(ts(LED_RED, NOW - 10) == STATUS_FILTER_APPLY);
+    CHECK(ts(LED_GREEN, NOW - 20) == STATUS_FILTER_DROP_STALE);
+    CHECK(ts(LED_GREEN, NOW - 5) == STATUS_FILTER_APPLY);
+    CHECK(stats.dropped_stale == 1);
+}
+
+static void test_duplicate_sequence(void) {
+    setup();
+    CHECK(seq(LED_RED, 7) == STATUS_FILTER_APPLY);
+    // A QoS 1 redelivery
+    CHECK(seq(LED_RED, 7) == STATUS_FILTER_DROP_OUT_OF_ORDER);
+    CHECK(seq(LED_RED, 8) == STATUS_FILTER_COALESCE);
+    CHECK(stats.applied == 1 && stats.coalesced == 1 && stats.dropped_out_of_order == 1);
+}
+
+static void test_reordered_sequence(void) {
+    setup();
+    CHECK(seq(LED_RED, 10) == STATUS_FILTER_APPLY);
+    CHECK(seq(LED_GREEN, 12) == STATUS_FILTER_APPLY);
+    CHECK(seq(LED_BLUE, 11) == STATUS_FILTER_DROP_OUT_OF_ORDER);
+    CHECK(seq(LED_BLUE, 12 - STATUS_SEQUENCE_WINDOW) == STATUS_FILTER_DROP_OUT_OF_ORDER);
+    CHECK(last_state == LED_GREEN);
+    CHECK(stats.sender_restarts == 0);
+}
+
+static void test_sequence_wraps(void) {
+    setup();
+    CHECK(seq(LED_RED, 0xfffffffe) == STATUS_FILTER_APPLY);
+    CHECK(seq(LED_GREEN, 1) == STATUS_FILTER_APPLY);
+    CHECK(seq(LED_BLUE, 0xffffffff) == STATUS_FILTER_DROP_OUT_OF_ORDER);
+}
+
+static void test_restarted_sender_large_jump(void) {
+    setup();
+    CHECK(seq(LED_RED, 5000) == STATUS_FILTER_APPLY);
+    // Back to the start: not a reordering
+    CHECK(seq(LED_GREEN, 1) == STATUS_FILTER_APPLY);
+    CHECK(stats.sender_restarts == 1);
+    // The new sequence is the reference from now on
+    CHECK(seq(LED_BLUE, 2) == STATUS_FILTER_APPLY);
+    CHECK(seq(LED_RED, 1) == STATUS_FILTER_DROP_OUT_OF_ORDER);
+}
+
+static void test_restarted_sender_boot_id(void) {
+    setup();
+    CHECK(seq_boot(LED_RED, 3, 100) == STATUS_FILTER_APPLY);
+    CHECK(seq_boot(LED_GREEN, 1, 101) == STATUS_FILTER_APPLY);
+    CHECK(stats.sender_restarts == 1);
+    CHECK(seq_boot(LED_RED, 1, 101) == STATUS_FILTER_DROP_OUT_OF_ORDER);
+    // Same boot: a large jump back is just very late
+    CHECK(seq_boot(LED_GREEN, 5000, 101) == STATUS_FILTER_COALESCE);
+    CHECK(seq_boot(LED_RED, 1, 101) == STATUS_FILTER_DROP_OUT_OF_ORDER);
+    CHECK(stats.sender_restarts == 1);
+}
+
+static void test_newer_timestamp_wins_over_sequence(void) {
+    setup();
+    CHECK(seq_ts(LED_RED, 40, NOW - 100) == STATUS_FILTER_APPLY);
+    // Sender restarted: lower sequence but a later timestamp
+    CHECK(seq_ts(LED_GREEN, 1, NOW - 50) == STATUS_FILTER_APPLY);
+    // Higher sequence cannot revive an older timestamp
+    CHECK(seq_ts(LED_BLUE, 99, NOW - 60) == STATUS_FILTER_DROP_STALE);
+}
+
+static void test_same_timestamp_uses_sequence(void) {
+    setup();
+    CHECK(seq_ts(LED_RED, 2, NOW - 10) == STATUS_FILTER_APPLY);
+    CHECK(seq_ts(LED_GREEN, 1, NOW - 10) == STATUS_FILTER_DROP_OUT_OF_ORDER);
+    CHECK(seq_ts(LED_GREEN, 3, NOW - 10) == STATUS_FILTER_APPLY);
+}
+
+static void test_timestamp_then_sequence_only(void) {
+    setup();
+    CHECK(seq_ts(LED_RED, 10, NOW - 10) == STATUS_FILTER_APPLY);
+    // No timestamp: the sequence decides
+    CHECK(seq(LED_GREEN, 9) == STATUS_FILTER_DROP_OUT_OF_ORDER);
+    CHECK(seq(LED_GREEN, 11) == STATUS_FILTER_APPLY);
+}
+
+int main(void) {
+    RUN(test_untagged_messages_are_current);
+    RUN(test_stale_timestamp_dropped);
+    RUN(test_duplicate_sequence);
+    RUN(test_reordered_sequence);
+    RUN(test_sequence_wraps);
+    RUN(test_restarted_sender_large_jump);
+    RUN(test_restarted_sender_boot_id);
+    RUN(test_newer_timestamp_wins_over_sequence);
+    RUN(test_same_timestamp_uses_sequence);
+    RUN(test_timestamp_then_sequence_only);
+    return test_report();
+}
@@ -0,0 +1,161 @@
+// supervisor.c is included so the tests can drive check() and give_up() with their own clock
+#include "../main/supervisor.c"
+
+#include <string.h>
+
+#include "shim.h"
+#include "test.h"
+
+#define DEADLINE_MS 1000
+
+static int restart_calls = 0;
+static bool restart_succeeds = true;
+
+static bool fake_restart(void) {
+    restart_calls++;
+    return restart_succeeds;
+}
+
+static supervised_t *setup(supervisor_restart_t restart) {
+    memset(supervised, 0, sizeof(supervised));
+    supervised_count = 0;
+    restart_calls = 0;
+    restart_succeeds = true;
+    shim_restarts = 0;
+    shim_time_us = 1000000;
+    shim_task_remove("worker");
+    shim_task_add("worker");
+    supervised_t *task = supervisor_register("worker", DEADLINE_MS, restart);
+    CHECK(check(task, shim_time_us));
+    return task;
+}
+
+static bool advance_and_check(supervised_t *task, int64_t ms) {
+    shim_time_us += ms * 1000;
+    return check(task, shim_time_us);
+}
+
+static void test_heartbeats_keep_task_healthy(void) {
+    supervised_t *task = setup(fake_restart);
+    for (int i = 0; i < 10; i++) {
+        shim_time_us += 900 * 1000;
+        supervisor_heartbeat(task);
+        CHECK(check(task, shim_time_us));
+    }
+    CHECK(restart_calls == 0);
+    CHECK(task->worst_gap_ms == 900);
+}
+
+static void test_silent_task_is_restarted(void) {
+    supervised_t *task = setup(fake_restart);
+    CHECK(advance_and_check(task, DEADLINE_MS));  // At the deadline, not past it
+    CHECK(advance_and_check(task, 1));
+    CHECK(restart_calls == 1);
+    CHECK(task->restarts == 1);
+    CHECK(task->failed_us == 0);
+    // The deadline starts afresh after a restart
+    CHECK(advance_and_check(task, DEADLINE_MS));
+    CHECK(restart_calls == 1);
+}
+
+static void test_restart_budget_exhausted(void) {
+    supervised_t *task = setup(fake_restart);
+    for (int i = 0; i < SUPERVISOR_MAX_RESTARTS; i++) {
+        CHECK(advance_and_check(task, DEADLINE_MS + 1));
+    }
+    CHECK(restart_calls == SUPERVISOR_MAX_RESTARTS);
+
+    CHECK(!advance_and_check(task, DEADLINE_MS + 1));
+    CHECK(restart_calls == SUPERVISOR_MAX_RESTARTS);
+    CHECK(task->failed_us == shim_time_us);
+    CHECK(shim_restarts == 0);  // Left to the task watchdog first
+
+    CHECK(!advance_and_check(task, SUPERVISOR_REBOOT_GRACE_MS - 1));
+    CHECK(shim_restarts == 0);
+    CHECK(!advance_and_check(task, 1));
+    CHECK(shim_restarts == 1);
+}
+
+static void test_restart_budget_renews_each_window(void) {
+    supervised_t *task = setup(fake_restart);
+    for (int i = 0; i < SUPERVISOR_MAX_RESTARTS; i++) {
+        CHECK(advance_and_check(task, DEADLINE_MS + 1));
+    }
+    // Healthy for the rest of the window
+    int64_t window_end_us = task->window_start_us + SUPERVISOR_RESTART_WINDOW_S * 1000000LL;
+    while (shim_time_us < window_end_us) {
+        shim_time_us += DEADLINE_MS * 1000;
+        supervisor_heartbeat(task);
+    }
+    CHECK(advance_and_check(task, DEADLINE_MS + 1));
+    CHECK(restart_calls == SUPERVISOR_MAX_RESTARTS + 1);
+    CHECK(task->window_restarts == 1);
+}
+
+static void test_no_restart_callback_reboots(void) {
+    supervised_t *task = setup(NULL);
+    CHECK(!advance_and_check(task, DEADLINE_MS + 1));
+    CHECK(task->failed_us != 0);
+    CHECK(!advance_and_check(task, SUPERVISOR_REBOOT_GRACE_MS));
+    CHECK(shim_restarts == 1);
+}
+
+static void test_refused_restart_reboots(void) {
+    supervised_t *task = setup(fake_restart);
+    restart_succeeds = false;
+    CHECK(!advance_and_check(task, DEADLINE_MS + 1));
+    CHECK(restart_calls == 1);
+    CHECK(task->restarts == 0);
+    CHECK(task->failed_us != 0);
+}
+
+static void test_absent_task_is_not_judged(void) {
+    supervised_t *task = setup(NULL);
+    shim_task_remove("worker");
+    CHECK(advance_and_check(task, 10 * DEADLINE_MS));
+    CHECK(!task->running);
+    // Watched afresh once it exists again, without counting the time it was gone
+    shim_task_add("worker");
+    CHECK(advance_and_check(task, 1));
+    CHECK(task->running);
+    CHECK(advance_and_check(task, DEADLINE_MS));
+    CHECK(!advance_and_check(task, 1));
+}
+
+static void test_queue_watched_task(void) {
+    struct shim_queue queue = {.waiting = 0};
+    supervised_t *task = setup(NULL);
+    supervisor_watch_queue(task, &queue);
+
+    // An empty queue means the task is keeping up
+    CHECK(advance_and_check(task, 10 * DEADLINE_MS));
+
+    // A draining queue counts as a heartbeat
+    queue.waiting = 5;
+    CHECK(advance_and_check(task, DEADLINE_MS / 2));
+    for (queue.waiting = 4; queue.waiting > 0; queue.waiting--) {
+        CHECK(advance_and_check(task, DEADLINE_MS));
+    }
+
+    // A queue that stays full does not
+    queue.waiting = 3;
+    CHECK(advance_and_check(task, DEADLINE_MS / 2));
+    queue.waiting = 7;
+    CHECK(advance_and_check(task, DEADLINE_MS / 2));
+    CHECK(!advance_and_check(task, DEADLINE_MS / 2 + 1));
+    CHECK(task->failed_us != 0);
+}
+
+int main(void) {
+    restart_metric = metrics_counter("supervisor.restarts");
+
+    RUN(test_heartbeats_keep_task_healthy);
+    RUN(test_silent_task_is_restarted);
+    RUN(test_restart_budget_exhausted);
+    RUN(test_restart_budget_renews_each_window);
+    RUN(test_no_restart_callback_reboots);
+    RUN(test_refused_restart_reboots);
+    RUN(test_absent_task_is_not_judged);
+    RUN(test_queue_watched_task);
+    return test_report();
+}
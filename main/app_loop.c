@@ -0,0 +1,95 @@
+#include "app_loop.h"
+
+#if APP_EVENT_LOOP
+
+#include <stdatomic.h>
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "metrics.h"
+#include "static_alloc.h"
+#include "supervisor.h"
+
+static const char *TAG = "APP_LOOP";
+
+ESP_EVENT_DEFINE_BASE(APP_LOOP_EVENT);
+
+static esp_event_loop_handle_t loop = NULL;
+static app_loop_handler_t handlers[APP_LOOP_EVENT_COUNT];
+static atomic_bool pending[APP_LOOP_EVENT_COUNT];
+// Written by the poster that set pending, read by the loop after it has received the event
+static int64_t posted_us[APP_LOOP_EVENT_COUNT];
+static metric_t *dispatch_metric;
+static supervised_t *loop_supervised;
+STATIC_TASK_STORAGE(app_loop, APP_LOOP_STACK_BYTES);
+
+static void dispatch(void *arg, esp_event_base_t base, int32_t id, void *data) {
+    if (id < 0 || id >= APP_LOOP_EVENT_COUNT) {
+        return;
+    }
+    // Cleared before the handler runs, so a post made meanwhile gets its own dispatch
+    int64_t latency_us = esp_timer_get_time() - posted_us[id];
+    atomic_store(&pending[id], false);
+    metric_observe(dispatch_metric, (uint32_t)latency_us);
+    if (handlers[id] != NULL) {
+        handlers[id]();
+    }
+}
+
+static void beat(void) { supervisor_heartbeat(loop_supervised); }
+
+static void app_loop_task(void *param) {
+    while (true) {
+        esp_event_loop_run(loop, portMAX_DELAY);
+    }
+}
+
+void app_loop_start(void) {
+    // No task of its own: it runs on app_loop_task, whose stack is static
+    esp_event_loop_args_t args = {.queue_size = APP_LOOP_QUEUE_LENGTH, .task_name = NULL};
+    ESP_ERROR_CHECK(esp_event_loop_create(&args, &loop));
+    ESP_ERROR_CHECK(esp_event_handler_register_with(loop, APP_LOOP_EVENT, ESP_EVENT_ANY_ID, &dispatch, NULL));
+
+    dispatch_metric = metrics_histogram("loop.dispatch_us");
+    metric_set_threshold(dispatch_metric, 16);
+    loop_supervised = supervisor_register("app_loop", APP_LOOP_DEADLINE_MS, NULL);
+
+    if (STATIC_TASK_CREATE(app_loop, &app_loop_task, "app_loop", NULL, APP_LOOP_PRIORITY) == NULL) {
+        ESP_LOGE(TAG, "Failed to create the event loop task");
+        esp_restart();
+    }
+    app_loop_register(APP_LOOP_HEARTBEAT, beat);
+    app_loop_post_every(APP_LOOP_HEARTBEAT, SUPERVISOR_HEARTBEAT_MS);
+}
+
+void app_loop_register(app_loop_event_t event, app_loop_handler_t handler) { handlers[event] = handler; }
+
+bool app_loop_post(app_loop_event_t event) {
+    if (loop == NULL) {
+        return false;
+    }
+    if (atomic_exchange(&pending[event], true)) {
+        return true;
+    }
+    posted_us[event] = esp_timer_get_time();
+    // Never waits: posts come from log calls and timer callbacks. Nothing here may log.
+    if (esp_event_post_to(loop, APP_LOOP_EVENT, event, NULL, 0, 0) != ESP_OK) {
+        atomic_store(&pending[event], false);
+        return false;
+    }
+    return true;
+}
+
+static void post_tick(void *arg) { app_loop_post((app_loop_event_t)(intptr_t)arg); }
+
+void app_loop_post_every(app_loop_event_t event, uint32_t period_ms) {
+    esp_timer_handle_t timer;
+    const esp_timer_create_args_t args = {.callback = &post_tick, .arg = (void *)(intptr_t)event, .name = "app_loop"};
+    ESP_ERROR_CHECK(esp_timer_create(&args, &timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(timer, period_ms * 1000ULL));
+}
+
+#endif  // APP_EVENT_LOOP
@@ -0,0 +1,62 @@
+#ifndef SNOOPER_APP_LOOP_H
+#define SNOOPER_APP_LOOP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_event.h"
+
+// Single event loop mode. With APP_EVENT_LOOP, telemetry scheduling and cloud log draining run
+// as handlers on one esp_event loop instead of on a task each, driven by esp_timer and by
+// posts from the code that used to notify their tasks. The loop runs on one static task
+// (app_loop) sized for the deepest handler, so the stacks and TCBs of the tasks it replaces
+// are not reserved at all. Without it every subsystem keeps its own task as before.
+//
+// Posts never block and an event already waiting in the queue is not posted again, so a log
+// burst costs one dispatch. loop.dispatch_us is the time from post to handler start.
+
+#ifndef APP_EVENT_LOOP
+#define APP_EVENT_LOOP 0
+#endif
+
+// The telemetry keyframe is the deepest handler; the old tasks had 4096 bytes each
+#ifndef APP_LOOP_STACK_BYTES
+#define APP_LOOP_STACK_BYTES 4608
+#endif
+
+#ifndef APP_LOOP_QUEUE_LENGTH
+#define APP_LOOP_QUEUE_LENGTH 8
+#endif
+
+#ifndef APP_LOOP_PRIORITY
+#define APP_LOOP_PRIORITY 4
+#endif
+
+#ifndef APP_LOOP_DEADLINE_MS
+#define APP_LOOP_DEADLINE_MS 60000
+#endif
+
+ESP_EVENT_DECLARE_BASE(APP_LOOP_EVENT);
+
+typedef enum {
+    APP_LOOP_HEARTBEAT = 0,
+    APP_LOOP_TELEMETRY,
+    APP_LOOP_LOG_FLUSH,
+    APP_LOOP_EVENT_COUNT
+} app_loop_event_t;
+
+typedef void (*app_loop_handler_t)(void);
+
+// Creates the loop and its task; call before registering handlers
+void app_loop_start(void);
+
+void app_loop_register(app_loop_event_t event, app_loop_handler_t handler);
+
+// Safe from any task, including from inside a log call. Returns false if the event was not
+// queued (loop not started or queue full); one already pending counts as queued.
+bool app_loop_post(app_loop_event_t event);
+
+// Posts the event every period_ms from an esp_timer
+void app_loop_post_every(app_loop_event_t event, uint32_t period_ms);
+
+#endif  // SNOOPER_APP_LOOP_H
@@ -0,0 +1,76 @@
+#include "boot.h"
+
+#include "boot_record.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include "gecl-wifi-manager.h"
+#include "static_alloc.h"
+#include "wall_clock.h"
+#include "wifi_cache.h"
+
+static const char *TAG = "BOOT";
+
+#define BOOT_WIFI_POLL_MS 100
+
+static EventGroupHandle_t boot_events = NULL;
+STATIC_EVENT_GROUP_STORAGE(boot_events);
+STATIC_TASK_STORAGE(boot_network, 4096);
+static bool clock_restored = false;
+static int64_t mqtt_started_us = 0;
+
+static void network_task(void *param) {
+    int64_t started_us = esp_timer_get_time();
+    boot_phase_begin(BOOT_PHASE_WIFI);
+    // wifi_init_sta() joins the cached AP directly, skipping the scan, when the cache has one
+    wifi_cache_prepare(started_us);
+    wifi_init_sta();
+    wifi_cache_connect(started_us);
+    // wifi_init_sta() may return before the station has an address
+    while (!wifi_active()) {
+        vTaskDelay(pdMS_TO_TICKS(BOOT_WIFI_POLL_MS));
+    }
+    boot_phase_end(BOOT_PHASE_WIFI);
+    xEventGroupSetBits(boot_events, BOOT_WIFI_UP);
+
+    // With a restored clock this only refines it; MQTT may already be connecting
+    boot_phase_begin(BOOT_PHASE_SNTP);
+    wall_clock_synchronize();
+    boot_phase_end(BOOT_PHASE_SNTP);
+    if (clock_restored && (xEventGroupGetBits(boot_events) & BOOT_MQTT_STARTED)) {
+        ESP_LOGI(TAG, "MQTT started %lld ms before SNTP finished", (esp_timer_get_time() - mqtt_started_us) / 1000);
+    }
+    xEventGroupSetBits(boot_events, BOOT_TIME_SYNCED);
+
+    vTaskDelete(NULL);
+}
+
+void boot_start_network(void) {
+    init_wifi_cache();
+    boot_events = STATIC_EVENT_GROUP_CREATE(boot_events);
+    if (boot_events == NULL) {
+        ESP_LOGE(TAG, "Failed to create boot event group");
+        esp_restart();
+    }
+    // A warm reset keeps a usable clock, so nothing needs to wait for SNTP
+    clock_restored = wall_clock_restore();
+    if (clock_restored) {
+        boot_record_set_clock("rtc");
+        xEventGroupSetBits(boot_events, BOOT_TIME_SYNCED);
+    }
+    STATIC_TASK_CREATE(boot_network, &network_task, "boot_network", NULL, 5);
+}
+
+void boot_start_mqtt(esp_mqtt_client_handle_t client) {
+    boot_wait(BOOT_MQTT_NEEDS, portMAX_DELAY);
+    boot_phase_begin(BOOT_PHASE_CONNACK);
+    ESP_ERROR_CHECK(esp_mqtt_client_start(client));
+    mqtt_started_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "MQTT started at %lld ms", mqtt_started_us / 1000);
+    xEventGroupSetBits(boot_events, BOOT_MQTT_STARTED);
+}
+
+EventBits_t boot_wait(EventBits_t bits, TickType_t timeout) {
+    return xEventGroupWaitBits(boot_events, bits, pdFALSE, pdTRUE, timeout);
+}
@@ -0,0 +1,33 @@
+#ifndef SNOOPER_BOOT_H
+#define SNOOPER_BOOT_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "mqtt_client.h"
+#include "sdkconfig.h"
+
+// Boot orchestration. app_main brings up the local subsystems (LED, audio, logging) straight
+// away while a boot task joins Wi-Fi and then runs SNTP; the MQTT client is started as soon as
+// the stages it depends on are done, so the TLS handshake overlaps SNTP where it can.
+
+#define BOOT_WIFI_UP (1 << 0)
+#define BOOT_TIME_SYNCED (1 << 1)  // Clock restored (wall_clock.h) or SNTP finished; invalid if SNTP timed out
+#define BOOT_MQTT_STARTED (1 << 2)
+
+// mbedTLS only checks certificate validity dates with CONFIG_MBEDTLS_HAVE_TIME_DATE; without
+// it the handshake does not care about the clock and need not wait for SNTP
+#if CONFIG_MBEDTLS_HAVE_TIME_DATE
+#define BOOT_MQTT_NEEDS (BOOT_WIFI_UP | BOOT_TIME_SYNCED)
+#else
+#define BOOT_MQTT_NEEDS BOOT_WIFI_UP
+#endif
+
+// Starts the Wi-Fi and SNTP stages; NVS must be initialized. Wi-Fi joins via wifi_cache.h.
+void boot_start_network(void);
+
+// Waits for BOOT_MQTT_NEEDS, then starts the client
+void boot_start_mqtt(esp_mqtt_client_handle_t client);
+
+EventBits_t boot_wait(EventBits_t bits, TickType_t timeout);
+
+#endif  // SNOOPER_BOOT_H
@@ -0,0 +1,140 @@
+#include "boot_record.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "cJSON.h"
+#include "esp_app_desc.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "mqtt_publish.h"
+
+static const char *TAG = "BOOT_RECORD";
+
+static const char *phase_names[BOOT_PHASE_COUNT] = {
+    "version_info", "mac_address", "nvs", "wifi", "sntp", "connack", "first_status",
+};
+
+// 0 means not reached; esp_timer is already well past 0 by the time app_main runs
+static int64_t begin_us[BOOT_PHASE_COUNT];
+static int64_t end_us[BOOT_PHASE_COUNT];
+static const char *clock_source = "sntp";
+static bool published = false;
+static portMUX_TYPE record_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void boot_phase_begin(boot_phase_t phase) {
+    int64_t now = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&record_lock);
+    if (begin_us[phase] == 0) {
+        begin_us[phase] = now;
+    }
+    taskEXIT_CRITICAL(&record_lock);
+}
+
+void boot_phase_end(boot_phase_t phase) {
+    int64_t now = esp_timer_get_time();
+    bool first = false;
+
+    taskENTER_CRITICAL(&record_lock);
+    if (begin_us[phase] != 0 && end_us[phase] == 0) {
+        end_us[phase] = now;
+        first = true;
+    }
+    taskEXIT_CRITICAL(&record_lock);
+
+    if (first) {
+        ESP_LOGI(TAG, "%s done at %lld ms, took %lld ms", phase_names[phase], now / 1000,
+                 (now - begin_us[phase]) / 1000);
+    }
+}
+
+int64_t boot_phase_duration_us(boot_phase_t phase) {
+    int64_t duration = -1;
+
+    taskENTER_CRITICAL(&record_lock);
+    if (end_us[phase] != 0) {
+        duration = end_us[phase] - begin_us[phase];
+    }
+    taskEXIT_CRITICAL(&record_lock);
+    return duration;
+}
+
+const char *boot_phase_name(boot_phase_t phase) {
+    return phase < BOOT_PHASE_COUNT ? phase_names[phase] : "unknown";
+}
+
+void boot_record_set_clock(const char *source) { clock_source = source; }
+
+static void snapshot(int64_t *begin, int64_t *end) {
+    taskENTER_CRITICAL(&record_lock);
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+        begin[i] = begin_us[i];
+        end[i] = end_us[i];
+    }
+    taskEXIT_CRITICAL(&record_lock);
+}
+
+void boot_record_log(void) {
+    int64_t begin[BOOT_PHASE_COUNT];
+    int64_t end[BOOT_PHASE_COUNT];
+
+    snapshot(begin, end);
+    ESP_LOGI(TAG, "%-14s %9s %9s %9s", "phase", "start ms", "end ms", "took ms");
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+        if (end[i] != 0) {
+            ESP_LOGI(TAG, "%-14s %9lld %9lld %9lld", phase_names[i], begin[i] / 1000, end[i] / 1000,
+                     (end[i] - begin[i]) / 1000);
+        } else if (begin[i] != 0) {
+            ESP_LOGI(TAG, "%-14s %9lld %9s %9s", phase_names[i], begin[i] / 1000, "-", "-");
+        } else {
+            ESP_LOGI(TAG, "%-14s %9s %9s %9s", phase_names[i], "-", "-", "-");
+        }
+    }
+}
+
+void boot_record_publish(esp_mqtt_client_handle_t client, const char *topic, const char *device) {
+    int64_t begin[BOOT_PHASE_COUNT];
+    int64_t end[BOOT_PHASE_COUNT];
+
+    taskENTER_CRITICAL(&record_lock);
+    bool already = published;
+    published = true;
+    taskEXIT_CRITICAL(&record_lock);
+    if (already) {
+        return;
+    }
+
+    boot_record_log();
+    snapshot(begin, end);
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON *record = cJSON_AddObjectToObject(root, "boot_record");
+    cJSON_AddStringToObject(record, "device", device);
+    cJSON_AddStringToObject(record, "version", esp_app_get_description()->version);
+    cJSON_AddNumberToObject(record, "reset", esp_reset_reason());
+    cJSON_AddStringToObject(record, "clock", clock_source);
+    cJSON *phases = cJSON_AddObjectToObject(record, "phases");
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+        if (end[i] == 0) {
+            continue;
+        }
+        cJSON *span = cJSON_CreateArray();
+        cJSON_AddItemToArray(span, cJSON_CreateNumber((double)begin[i]));
+        cJSON_AddItemToArray(span, cJSON_CreateNumber((double)end[i]));
+        cJSON_AddItemToObject(phases, phase_names[i], span);
+    }
+
+    char *json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (json == NULL) {
+        ESP_LOGE(TAG, "Could not encode boot record");
+        return;
+    }
+    if (mqtt_publish(client, topic, json, 0, 1, 0) < 0) {
+        ESP_LOGW(TAG, "Could not publish boot record");
+    }
+    free(json);
+}
@@ -0,0 +1,46 @@
+#ifndef SNOOPER_BOOT_RECORD_H
+#define SNOOPER_BOOT_RECORD_H
+
+#include <stdint.h>
+
+#include "mqtt_client.h"
+
+// Boot phase timeline. Each startup phase is stamped with esp_timer_get_time() (microseconds
+// since the timer started, just before app_main) when it begins and ends. Phases may overlap,
+// since Wi-Fi and SNTP run beside the local startup (boot.h). The record is printed to the
+// console and published once to the telemetry topic as
+//
+//   {"boot_record":{"device":"...","version":"...","reset":3,"clock":"rtc","phases":{"nvs":[12034,48211],...}}}
+//
+// scripts/boot_report.py turns a fleet's worth of these into per-phase percentiles.
+
+typedef enum {
+    BOOT_PHASE_VERSION_INFO = 0,  // print_version_info()
+    BOOT_PHASE_MAC_ADDRESS,       // show_mac_address()
+    BOOT_PHASE_NVS,               // setup_nvs_flash()
+    BOOT_PHASE_WIFI,              // wifi_init_sta() until the station has an address
+    BOOT_PHASE_SNTP,              // synchronize_time()
+    BOOT_PHASE_CONNACK,           // esp_mqtt_client_start() until the first CONNACK
+    BOOT_PHASE_FIRST_STATUS,      // First CONNACK until the first status is accepted
+    BOOT_PHASE_COUNT,
+} boot_phase_t;
+
+// Only the first begin and end of each phase are kept, so reconnects do not move them
+void boot_phase_begin(boot_phase_t phase);
+void boot_phase_end(boot_phase_t phase);
+
+// Microseconds the phase took, -1 if it has not finished
+int64_t boot_phase_duration_us(boot_phase_t phase);
+
+const char *boot_phase_name(boot_phase_t phase);
+
+// How the wall clock was set at boot, "rtc" or "sntp" (wall_clock.h); a static string
+void boot_record_set_clock(const char *source);
+
+void boot_record_log(void);
+
+// Logs and publishes the record; only the first call publishes. Phases that have not finished
+// are left out.
+void boot_record_publish(esp_mqtt_client_handle_t client, const char *topic, const char *device);
+
+#endif  // SNOOPER_BOOT_RECORD_H
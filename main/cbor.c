@@ -0,0 +1,247 @@
+#include "cbor.h"
+
+#include <string.h>
+
+#define CBOR_FALSE 0xf4
+#define CBOR_TRUE 0xf5
+#define CBOR_MAX_NESTING 8
+
+void cbor_writer_init(cbor_writer_t *writer, uint8_t *buf, size_t cap) {
+    *writer = (cbor_writer_t){.buf = buf, .cap = cap};
+}
+
+static void put_bytes(cbor_writer_t *writer, const void *data, size_t len) {
+    if (writer->overflow || writer->cap - writer->len < len) {
+        writer->overflow = true;
+        return;
+    }
+    memcpy(&writer->buf[writer->len], data, len);
+    writer->len += len;
+}
+
+// Initial byte plus the shortest big-endian argument
+static void put_head(cbor_writer_t *writer, cbor_major_t major, uint64_t value) {
+    uint8_t head[9];
+    size_t len;
+
+    if (value < 24) {
+        head[0] = (major << 5) | value;
+        len = 1;
+    } else if (value <= UINT8_MAX) {
+        head[0] = (major << 5) | 24;
+        len = 2;
+    } else if (value <= UINT16_MAX) {
+        head[0] = (major << 5) | 25;
+        len = 3;
+    } else if (value <= UINT32_MAX) {
+        head[0] = (major << 5) | 26;
+        len = 5;
+    } else {
+        head[0] = (major << 5) | 27;
+        len = 9;
+    }
+    for (size_t i = len - 1; i > 0; i--) {
+        head[i] = value & 0xff;
+        value >>= 8;
+    }
+    put_bytes(writer, head, len);
+}
+
+void cbor_put_uint(cbor_writer_t *writer, uint64_t value) { put_head(writer, CBOR_UINT, value); }
+
+void cbor_put_int(cbor_writer_t *writer, int64_t value) {
+    if (value < 0) {
+        put_head(writer, CBOR_NEGINT, (uint64_t)(-1 - value));
+    } else {
+        put_head(writer, CBOR_UINT, (uint64_t)value);
+    }
+}
+
+void cbor_put_text(cbor_writer_t *writer, const char *text) { cbor_put_text_len(writer, text, strlen(text)); }
+
+void cbor_put_text_len(cbor_writer_t *writer, const char *text, size_t len) {
+    put_head(writer, CBOR_TEXT, len);
+    put_bytes(writer, text, len);
+}
+
+void cbor_put_bool(cbor_writer_t *writer, bool value) {
+    uint8_t byte = value ? CBOR_TRUE : CBOR_FALSE;
+    put_bytes(writer, &byte, 1);
+}
+
+void cbor_put_array(cbor_writer_t *writer, size_t count) { put_head(writer, CBOR_ARRAY, count); }
+
+void cbor_put_map(cbor_writer_t *writer, size_t pairs) { put_head(writer, CBOR_MAP, pairs); }
+
+void cbor_reader_init(cbor_reader_t *reader, const void *buf, size_t len) {
+    *reader = (cbor_reader_t){.buf = buf, .len = len};
+}
+
+bool cbor_at_end(const cbor_reader_t *reader) { return reader->pos >= reader->len; }
+
+bool cbor_peek_major(cbor_reader_t *reader, cbor_major_t *major) {
+    if (reader->error || reader->pos >= reader->len) {
+        return false;
+    }
+    *major = reader->buf[reader->pos] >> 5;
+    return true;
+}
+
+// Reads the initial byte and argument; indefinite lengths and reserved values are errors
+static bool get_head(cbor_reader_t *reader, cbor_major_t *major, uint8_t *info, uint64_t *value) {
+    if (reader->error || reader->pos >= reader->len) {
+        reader->error = true;
+        return false;
+    }
+    uint8_t initial = reader->buf[reader->pos++];
+    *major = initial >> 5;
+    *info = initial & 0x1f;
+    if (*info < 24) {
+        *value = *info;
+        return true;
+    }
+    if (*info > 27) {
+        reader->error = true;
+        return false;
+    }
+    size_t len = (size_t)1 << (*info - 24);
+    if (reader->len - reader->pos < len) {
+        reader->error = true;
+        return false;
+    }
+    *value = 0;
+    for (size_t i = 0; i < len; i++) {
+        *value = (*value << 8) | reader->buf[reader->pos++];
+    }
+    return true;
+}
+
+static bool expect(cbor_reader_t *reader, cbor_major_t wanted, uint64_t *value) {
+    size_t start = reader->pos;
+    cbor_major_t major;
+    uint8_t info;
+
+    if (!get_head(reader, &major, &info, value)) {
+        return false;
+    }
+    if (major != wanted) {
+        reader->pos = start;
+        return false;
+    }
+    return true;
+}
+
+bool cbor_get_int(cbor_reader_t *reader, int64_t *value) {
+    cbor_major_t major;
+    uint64_t arg;
+
+    if (!cbor_peek_major(reader, &major) || (major != CBOR_UINT && major != CBOR_NEGINT)) {
+        return false;
+    }
+    if (!expect(reader, major, &arg)) {
+        return false;
+    }
+    if (arg > INT64_MAX) {
+        reader->error = true;
+        return false;
+    }
+    *value = major == CBOR_UINT ? (int64_t)arg : -1 - (int64_t)arg;
+    return true;
+}
+
+bool cbor_get_text(cbor_reader_t *reader, const char **text, size_t *len) {
+    uint64_t arg;
+
+    if (!expect(reader, CBOR_TEXT, &arg)) {
+        return false;
+    }
+    if (reader->len - reader->pos < arg) {
+        reader->error = true;
+        return false;
+    }
+    *text = (const char *)&reader->buf[reader->pos];
+    *len = arg;
+    reader->pos += arg;
+    return true;
+}
+
+bool cbor_get_bool(cbor_reader_t *reader, bool *value) {
+    if (reader->error || reader->pos >= reader->len) {
+        return false;
+    }
+    uint8_t byte = reader->buf[reader->pos];
+    if (byte != CBOR_TRUE && byte != CBOR_FALSE) {
+        return false;
+    }
+    reader->pos++;
+    *value = byte == CBOR_TRUE;
+    return true;
+}
+
+// Every item takes at least a byte, so a count the rest of the input cannot hold is malformed.
+// Checked before the cast, which would truncate a 64-bit count on a 32-bit size_t.
+static bool items_fit(cbor_reader_t *reader, uint64_t items_per_entry, uint64_t entries) {
+    if (entries > (reader->len - reader->pos) / items_per_entry) {
+        reader->error = true;
+        return false;
+    }
+    return true;
+}
+
+bool cbor_get_array(cbor_reader_t *reader, size_t *count) {
+    uint64_t arg;
+    if (!expect(reader, CBOR_ARRAY, &arg) || !items_fit(reader, 1, arg)) {
+        return false;
+    }
+    *count = (size_t)arg;
+    return true;
+}
+
+bool cbor_get_map(cbor_reader_t *reader, size_t *pairs) {
+    uint64_t arg;
+    if (!expect(reader, CBOR_MAP, &arg) || !items_fit(reader, 2, arg)) {
+        return false;
+    }
+    *pairs = (size_t)arg;
+    return true;
+}
+
+static bool skip_item(cbor_reader_t *reader, int depth) {
+    cbor_major_t major;
+    uint8_t info;
+    uint64_t arg;
+
+    if (depth > CBOR_MAX_NESTING || !get_head(reader, &major, &info, &arg)) {
+        reader->error = true;
+        return false;
+    }
+    switch (major) {
+        case CBOR_BYTES:
+        case CBOR_TEXT:
+            if (reader->len - reader->pos < arg) {
+                reader->error = true;
+                return false;
+            }
+            reader->pos += arg;
+            return true;
+        case CBOR_ARRAY:
+        case CBOR_MAP: {
+            uint64_t items = major == CBOR_MAP ? arg * 2 : arg;
+            for (uint64_t i = 0; i < items; i++) {
+                if (!skip_item(reader, depth + 1)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case CBOR_TAG:
+            return skip_item(reader, depth + 1);
+        default:
+            // Integers and simple values (including floats) are just their head
+            return true;
+    }
+}
+
+bool cbor_skip(cbor_reader_t *reader) { return skip_item(reader, 0); }
+
+bool cbor_is_map(const void *buf, size_t len) { return len > 0 && (((const uint8_t *)buf)[0] >> 5) == CBOR_MAP; }
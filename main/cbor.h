@@ -0,0 +1,64 @@
+#ifndef SNOOPER_CBOR_H
+#define SNOOPER_CBOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Minimal CBOR (RFC 8949) encoder and decoder. Both work in place on caller buffers and never
+// allocate. Definite lengths only; floats, tags and other simple values can be skipped but not
+// read. scripts/cbor2json.py converts payloads on the host.
+//
+// Writer calls never fail individually: once the buffer is too small the writer stops writing
+// and sets overflow, so a message is built with a series of calls and checked once at the end.
+// Reader calls return false on a type mismatch or truncated input and set error.
+
+typedef enum {
+    CBOR_UINT = 0,
+    CBOR_NEGINT = 1,
+    CBOR_BYTES = 2,
+    CBOR_TEXT = 3,
+    CBOR_ARRAY = 4,
+    CBOR_MAP = 5,
+    CBOR_TAG = 6,
+    CBOR_SIMPLE = 7,
+} cbor_major_t;
+
+typedef struct {
+    uint8_t *buf;
+    size_t cap;
+    size_t len;
+    bool overflow;
+} cbor_writer_t;
+
+typedef struct {
+    const uint8_t *buf;
+    size_t len;
+    size_t pos;
+    bool error;
+} cbor_reader_t;
+
+void cbor_writer_init(cbor_writer_t *writer, uint8_t *buf, size_t cap);
+void cbor_put_uint(cbor_writer_t *writer, uint64_t value);
+void cbor_put_int(cbor_writer_t *writer, int64_t value);
+void cbor_put_text(cbor_writer_t *writer, const char *text);
+void cbor_put_text_len(cbor_writer_t *writer, const char *text, size_t len);
+void cbor_put_bool(cbor_writer_t *writer, bool value);
+void cbor_put_array(cbor_writer_t *writer, size_t count);
+void cbor_put_map(cbor_writer_t *writer, size_t pairs);
+
+void cbor_reader_init(cbor_reader_t *reader, const void *buf, size_t len);
+bool cbor_at_end(const cbor_reader_t *reader);
+bool cbor_peek_major(cbor_reader_t *reader, cbor_major_t *major);
+bool cbor_get_int(cbor_reader_t *reader, int64_t *value);
+// The text is not NUL terminated and points into the input buffer
+bool cbor_get_text(cbor_reader_t *reader, const char **text, size_t *len);
+bool cbor_get_bool(cbor_reader_t *reader, bool *value);
+bool cbor_get_array(cbor_reader_t *reader, size_t *count);
+bool cbor_get_map(cbor_reader_t *reader, size_t *pairs);
+bool cbor_skip(cbor_reader_t *reader);
+
+// True if the payload starts with a CBOR map; JSON objects start with '{'
+bool cbor_is_map(const void *buf, size_t len);
+
+#endif  // SNOOPER_CBOR_H
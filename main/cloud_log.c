@@ -0,0 +1,224 @@
+#include "cloud_log.h"
+
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "app_loop.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "log_ring.h"
+#include "lzss.h"
+#include "mqtt_publish.h"
+#include "static_alloc.h"
+
+static const char *TAG = "CLOUD_LOG";
+
+#define CLOUD_LOG_HEADER_MAX (4 + 255 + 4)
+
+static esp_mqtt_client_handle_t log_client = NULL;
+static const char *log_topic = NULL;
+static const char *log_device = NULL;
+static vprintf_like_t previous_vprintf = NULL;
+static SemaphoreHandle_t line_mutex = NULL;
+STATIC_SEMAPHORE_STORAGE(cloud_log_line);
+static volatile bool mqtt_connected = false;
+#if !APP_EVENT_LOOP
+static TaskHandle_t cloud_log_task_handle = NULL;
+STATIC_TASK_STORAGE(cloud_log, 4096);
+#endif
+
+// Producers push records into the ring without locking; the log task drains it into batch
+static uint32_t ring_storage[CLOUD_LOG_RING_BYTES / sizeof(uint32_t)];
+static log_ring_t ring = LOG_RING_INITIALIZER(ring_storage);
+static char batch[CLOUD_LOG_BATCH_BYTES];
+
+static uint8_t payload[CLOUD_LOG_HEADER_MAX + LZSS_BOUND(CLOUD_LOG_BATCH_BYTES)];
+static atomic_uint error_flushes;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static cloud_log_stats_t stats;
+
+static bool is_error_line(const char *line) {
+    // Skip the colour escape that CONFIG_LOG_COLORS puts in front of the level letter
+    if (line[0] == '\033') {
+        const char *end = strchr(line, 'm');
+        if (end == NULL) {
+            return false;
+        }
+        line = end + 1;
+    }
+    return line[0] == 'E' && line[1] == ' ';
+}
+
+// Runs on the stack of every task that logs, so the line is formatted into a static buffer.
+// Until the scheduler runs, and in interrupts, lines only go to the console.
+static int cloud_log_vprintf(const char *format, va_list args) {
+    static char line[CLOUD_LOG_LINE_MAX];
+    va_list copy;
+
+    if (xPortInIsrContext() || xTaskGetSchedulerState() != taskSCHEDULER_RUNNING) {
+        return previous_vprintf(format, args);
+    }
+
+    xSemaphoreTake(line_mutex, portMAX_DELAY);
+    va_copy(copy, args);
+    int len = vsnprintf(line, sizeof(line), format, copy);
+    va_end(copy);
+    if (len > 0) {
+        if (len >= (int)sizeof(line)) {
+            len = sizeof(line) - 1;
+            line[len - 1] = '\n';
+        }
+        cloud_log_append(line, len, is_error_line(line));
+    }
+    xSemaphoreGive(line_mutex);
+    return previous_vprintf(format, args);
+}
+
+// Asks whoever drains the ring to ship what is staged
+static void wake_drain(void) {
+#if APP_EVENT_LOOP
+    app_loop_post(APP_LOOP_LOG_FLUSH);
+#else
+    if (cloud_log_task_handle != NULL) {
+        xTaskNotifyGive(cloud_log_task_handle);
+    }
+#endif
+}
+
+void cloud_log_append(const void *data, size_t len, bool urgent) {
+    // A full ring drops the record (log_ring.h); ship what is there so it drains
+    bool flush = !log_ring_push(&ring, data, len) || urgent;
+    if (urgent) {
+        atomic_fetch_add_explicit(&error_flushes, 1, memory_order_relaxed);
+    }
+    // Ship before the ring is full so a burst does not start dropping lines
+    flush |= log_ring_used(&ring) >= CLOUD_LOG_RING_BYTES - 2 * CLOUD_LOG_LINE_MAX;
+
+    if (flush) {
+        wake_drain();
+    }
+}
+
+// Returns false once the ring is empty
+static bool ship_batch(void) {
+    const char *body = batch;
+    size_t body_len = 0;
+    uint16_t lines = 0;
+    const void *record;
+    size_t record_len;
+
+    while ((record_len = log_ring_peek(&ring, &record)) > 0 && body_len + record_len <= sizeof(batch)) {
+        memcpy(&batch[body_len], record, record_len);
+        body_len += record_len;
+        lines++;
+        log_ring_pop(&ring);
+    }
+    if (body_len == 0) {
+        return false;
+    }
+
+    size_t device_len = strlen(log_device);
+    if (device_len > 255) {
+        device_len = 255;
+    }
+    size_t pos = 0;
+    payload[pos++] = 'L';
+    payload[pos++] = CLOUD_LOG_FORMAT_VERSION;
+    size_t flags_pos = pos++;
+    payload[pos++] = (uint8_t)device_len;
+    memcpy(&payload[pos], log_device, device_len);
+    pos += device_len;
+    payload[pos++] = lines & 0xff;
+    payload[pos++] = lines >> 8;
+    payload[pos++] = body_len & 0xff;
+    payload[pos++] = body_len >> 8;
+
+    size_t packed = 0;
+#if CLOUD_LOG_COMPRESS
+    int64_t start_us = esp_timer_get_time();
+    packed = lzss_compress((const uint8_t *)body, body_len, &payload[pos], sizeof(payload) - pos);
+    int64_t compress_us = esp_timer_get_time() - start_us;
+#else
+    int64_t compress_us = 0;
+#endif
+    if (packed > 0 && packed < body_len) {
+        payload[flags_pos] = CLOUD_LOG_FLAG_COMPRESSED;
+        pos += packed;
+    } else {
+        // Incompressible (or compression disabled): send the text as is
+        payload[flags_pos] = 0;
+        memcpy(&payload[pos], body, body_len);
+        pos += body_len;
+    }
+
+    mqtt_publish(log_client, log_topic, (const char *)payload, pos, 0, 0);
+
+    taskENTER_CRITICAL(&stats_lock);
+    stats.batches++;
+    stats.sent_bytes += pos;
+    stats.compress_us += compress_us;
+    taskEXIT_CRITICAL(&stats_lock);
+    return true;
+}
+
+static void drain(void) {
+    while (mqtt_connected && ship_batch()) {
+    }
+}
+
+#if !APP_EVENT_LOOP
+static void cloud_log_task(void *param) {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CLOUD_LOG_FLUSH_INTERVAL_MS));
+        drain();
+    }
+}
+#endif
+
+void init_cloud_log_batcher(esp_mqtt_client_handle_t client, const char *topic, const char *device) {
+    log_client = client;
+    log_topic = topic;
+    log_device = device;
+#if APP_EVENT_LOOP
+    app_loop_register(APP_LOOP_LOG_FLUSH, drain);
+    app_loop_post_every(APP_LOOP_LOG_FLUSH, CLOUD_LOG_FLUSH_INTERVAL_MS);
+#else
+    cloud_log_task_handle = STATIC_TASK_CREATE(cloud_log, &cloud_log_task, "cloud_log_task", NULL, 4);
+#endif
+    line_mutex = STATIC_MUTEX_CREATE(cloud_log_line);
+    if (line_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to create log line mutex");
+        esp_restart();
+    }
+    previous_vprintf = esp_log_set_vprintf(cloud_log_vprintf);
+}
+
+void cloud_log_set_connected(bool connected) {
+    mqtt_connected = connected;
+    if (connected) {
+        wake_drain();
+    }
+}
+
+void cloud_log_flush(void) { wake_drain(); }
+
+void cloud_log_get_stats(cloud_log_stats_t *out) {
+    log_ring_stats_t ring_stats;
+
+    log_ring_get_stats(&ring, &ring_stats);
+    taskENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    taskEXIT_CRITICAL(&stats_lock);
+    out->lines = ring_stats.records;
+    out->dropped_lines = ring_stats.dropped_records;
+    out->dropped_bytes = ring_stats.dropped_bytes;
+    out->raw_bytes = ring_stats.bytes;
+    out->ring_high_water = ring_stats.high_water;
+    out->error_flushes = atomic_load_explicit(&error_flushes, memory_order_relaxed);
+}
@@ -0,0 +1,71 @@
+#ifndef SNOOPER_CLOUD_LOG_H
+#define SNOOPER_CLOUD_LOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mqtt_client.h"
+
+// Batched cloud logging. Log lines are staged in a lock-free ring (log_ring.h) and collected
+// into a batch that is shipped as one publish when the ring fills, when the flush interval
+// expires, or straight away after an error line.
+// Batches are LZSS compressed (lzss.h); scripts/decode_log_batch.py turns them back into text.
+//
+// Batch payload: 'L', version, flags (bit 0: compressed), device name length, device name,
+// record count (u16 LE), uncompressed length (u16 LE), body. The body is log text, with
+// binary deferred-log records (deferred_log.h) interleaved from version 2 on.
+
+#ifndef CLOUD_LOG_BATCHING
+#define CLOUD_LOG_BATCHING 1
+#endif
+
+#ifndef CLOUD_LOG_FLUSH_INTERVAL_MS
+#define CLOUD_LOG_FLUSH_INTERVAL_MS 30000
+#endif
+
+#ifndef CLOUD_LOG_BATCH_BYTES
+#define CLOUD_LOG_BATCH_BYTES 2048
+#endif
+
+// Lock-free staging ring between log producers and the log task; a power of two
+#ifndef CLOUD_LOG_RING_BYTES
+#define CLOUD_LOG_RING_BYTES 2048
+#endif
+
+#ifndef CLOUD_LOG_LINE_MAX
+#define CLOUD_LOG_LINE_MAX 192
+#endif
+
+#ifndef CLOUD_LOG_COMPRESS
+#define CLOUD_LOG_COMPRESS 1
+#endif
+
+#define CLOUD_LOG_FORMAT_VERSION 2
+#define CLOUD_LOG_FLAG_COMPRESSED 0x01
+
+typedef struct {
+    uint32_t lines;
+    uint32_t dropped_lines;  // Ring full while waiting for MQTT; the newest line is dropped
+    uint32_t dropped_bytes;
+    uint32_t ring_high_water;
+    uint32_t batches;
+    uint32_t error_flushes;
+    uint64_t raw_bytes;
+    uint64_t sent_bytes;
+    uint64_t compress_us;
+} cloud_log_stats_t;
+
+// Hooks esp_log output; console output is unchanged
+void init_cloud_log_batcher(esp_mqtt_client_handle_t client, const char *topic, const char *device);
+
+// Batches are held while MQTT is down and shipped after reconnect
+void cloud_log_set_connected(bool connected);
+
+// Add a record to the current batch; urgent records are shipped straight away
+void cloud_log_append(const void *data, size_t len, bool urgent);
+
+void cloud_log_flush(void);
+void cloud_log_get_stats(cloud_log_stats_t *stats);
+
+#endif  // SNOOPER_CLOUD_LOG_H
@@ -0,0 +1,44 @@
+#include "deferred_log.h"
+
+#if DEFERRED_LOGGING
+
+#include <stdarg.h>
+#include <string.h>
+
+#include "cloud_log.h"
+
+#if !CLOUD_LOG_BATCHING
+#error "DEFERRED_LOGGING ships records through the cloud log batcher; enable CLOUD_LOG_BATCHING"
+#endif
+
+static inline void put_u32(uint8_t *p, uint32_t value) {
+    p[0] = value & 0xff;
+    p[1] = (value >> 8) & 0xff;
+    p[2] = (value >> 16) & 0xff;
+    p[3] = value >> 24;
+}
+
+void deferred_log_write(esp_log_level_t level, const char *tag, const char *format, int nargs, ...) {
+    uint8_t record[DLOG_RECORD_HEADER_BYTES + DLOG_MAX_ARGS * sizeof(uint32_t)];
+    va_list args;
+
+    if (nargs > DLOG_MAX_ARGS) {
+        nargs = DLOG_MAX_ARGS;
+    }
+    record[0] = DLOG_RECORD_MARKER;
+    record[1] = (uint8_t)level;
+    record[2] = (uint8_t)nargs;
+    put_u32(&record[3], esp_log_timestamp());
+    put_u32(&record[7], (uint32_t)(uintptr_t)tag);
+    put_u32(&record[11], (uint32_t)(uintptr_t)format);
+
+    va_start(args, nargs);
+    for (int i = 0; i < nargs; i++) {
+        put_u32(&record[DLOG_RECORD_HEADER_BYTES + i * sizeof(uint32_t)], va_arg(args, uint32_t));
+    }
+    va_end(args);
+
+    cloud_log_append(record, DLOG_RECORD_HEADER_BYTES + nargs * sizeof(uint32_t), false);
+}
+
+#endif  // DEFERRED_LOGGING
@@ -0,0 +1,71 @@
+#ifndef SNOOPER_DEFERRED_LOG_H
+#define SNOOPER_DEFERRED_LOG_H
+
+#include <stdint.h>
+
+#include "esp_log.h"
+
+// Deferred logging. With DEFERRED_LOGGING set, DLOGI/DLOGD/DLOGV do not format on the device:
+// they queue a binary record holding the flash addresses of the tag and format string (fixed
+// by the linker, so each log site has a build-time ID), the timestamp and the raw arguments.
+// scripts/decode_log_batch.py --elf <firmware.elf> renders the records on the host.
+//
+// Arguments must be integers, pointers or string literals (%s is resolved from the ELF);
+// at most DLOG_MAX_ARGS of them, each 32 bits wide. Anything else must stay on ESP_LOGx.
+// Warnings and errors always use the text path so they reach the console and trigger an
+// immediate cloud flush.
+//
+// Without DEFERRED_LOGGING the macros are plain ESP_LOGx calls.
+
+#ifndef DEFERRED_LOGGING
+#define DEFERRED_LOGGING 0
+#endif
+
+#define DLOG_MAX_ARGS 6
+
+// Record marker; never appears in log text
+#define DLOG_RECORD_MARKER 0x1e
+
+// Record layout (little endian): marker, level, nargs, timestamp ms (u32), tag address (u32),
+// format address (u32), nargs x u32
+#define DLOG_RECORD_HEADER_BYTES 15
+
+#if DEFERRED_LOGGING
+
+#define DLOG_ARG(x) ((uint32_t)(uintptr_t)(x))
+#define DLOG_NARGS(...) DLOG_NARGS_(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define DLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, N, ...) N
+#define DLOG_MAP_0()
+#define DLOG_MAP_1(a) , DLOG_ARG(a)
+#define DLOG_MAP_2(a, b) , DLOG_ARG(a), DLOG_ARG(b)
+#define DLOG_MAP_3(a, b, c) , DLOG_ARG(a), DLOG_ARG(b), DLOG_ARG(c)
+#define DLOG_MAP_4(a, b, c, d) , DLOG_ARG(a), DLOG_ARG(b), DLOG_ARG(c), DLOG_ARG(d)
+#define DLOG_MAP_5(a, b, c, d, e) , DLOG_ARG(a), DLOG_ARG(b), DLOG_ARG(c), DLOG_ARG(d), DLOG_ARG(e)
+#define DLOG_MAP_6(a, b, c, d, e, f) \
+    , DLOG_ARG(a), DLOG_ARG(b), DLOG_ARG(c), DLOG_ARG(d), DLOG_ARG(e), DLOG_ARG(f)
+#define DLOG_MAP_(n, ...) DLOG_MAP_##n(__VA_ARGS__)
+#define DLOG_MAP(n, ...) DLOG_MAP_(n, ##__VA_ARGS__)
+
+#define DLOG_AT(level, tag, format, ...)                                                          \
+    do {                                                                                          \
+        if (LOG_LOCAL_LEVEL >= (level) && esp_log_level_get(tag) >= (level)) {                    \
+            deferred_log_write((level), (tag), (format),                                          \
+                               DLOG_NARGS(__VA_ARGS__) DLOG_MAP(DLOG_NARGS(__VA_ARGS__), ##__VA_ARGS__)); \
+        }                                                                                         \
+    } while (0)
+
+#define DLOGI(tag, format, ...) DLOG_AT(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define DLOGD(tag, format, ...) DLOG_AT(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define DLOGV(tag, format, ...) DLOG_AT(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+void deferred_log_write(esp_log_level_t level, const char *tag, const char *format, int nargs, ...);
+
+#else
+
+#define DLOGI(tag, format, ...) ESP_LOGI(tag, format, ##__VA_ARGS__)
+#define DLOGD(tag, format, ...) ESP_LOGD(tag, format, ##__VA_ARGS__)
+#define DLOGV(tag, format, ...) ESP_LOGV(tag, format, ##__VA_ARGS__)
+
+#endif  // DEFERRED_LOGGING
+
+#endif  // SNOOPER_DEFERRED_LOG_H
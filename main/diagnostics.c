@@ -0,0 +1,333 @@
+#include "diagnostics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cJSON.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "metrics.h"
+#include "mqtt_publish.h"
+
+static const char *TAG = "DIAGNOSTICS";
+
+#define STACK_METRIC_NAME_MAX 32
+// Only report stack gauges when they move by more than this, so deltas stay quiet
+#define STACK_METRIC_THRESHOLD 64
+#define HEAP_METRIC_THRESHOLD 1024
+#define DIAGNOSTICS_MAX_TASKS 24
+
+// Tasks with a stack.<name> gauge: those main/ creates, plus esp-mqtt's. Ones that do not exist
+// (yet) are skipped.
+static const char *watched_tasks[] = {
+    "mqtt_worker",   "mqtt_task",      "led_task",       "audio_player_task", "ota_task",
+    "recovery_task", "telemetry_task", "cloud_log_task", "app_loop",
+};
+#define WATCHED_TASK_COUNT (sizeof(watched_tasks) / sizeof(watched_tasks[0]))
+
+static const struct {
+    const char *name;
+    uint32_t caps;
+} heap_regions[] = {
+    {"default", MALLOC_CAP_DEFAULT},
+    {"internal", MALLOC_CAP_INTERNAL},
+    {"dma", MALLOC_CAP_DMA},
+};
+
+static char stack_metric_names[WATCHED_TASK_COUNT][STACK_METRIC_NAME_MAX];
+static metric_t *stack_metrics[WATCHED_TASK_COUNT];
+static bool stack_warned[WATCHED_TASK_COUNT];
+static metric_t *heap_free_metric;
+static metric_t *heap_min_free_metric;
+static metric_t *heap_largest_metric;
+static metric_t *heap_frag_metric;
+
+// Run-time counters need both options; without them the report has no "cpu" section
+#define DIAGNOSTICS_CPU_STATS (configGENERATE_RUN_TIME_STATS && configUSE_TRACE_FACILITY)
+
+#if DIAGNOSTICS_CPU_STATS
+#define CPU_ABSENT UINT16_MAX
+
+#ifdef configRUN_TIME_COUNTER_TYPE
+typedef configRUN_TIME_COUNTER_TYPE run_time_t;
+#else
+typedef uint32_t run_time_t;
+#endif
+
+// One slot per task seen in the stored windows, so a window is just a share per slot. A slot is
+// reused once its task has been gone for every stored window.
+typedef struct {
+    UBaseType_t number;  // xTaskNumber; unlike the handle it is never reused
+    char name[configMAX_TASK_NAME_LEN];
+    run_time_t run_time;  // Counter at the previous sample
+} cpu_slot_t;
+
+typedef struct {
+    uint32_t window_ms;
+    uint16_t permille[DIAGNOSTICS_MAX_TASKS];  // By slot, CPU_ABSENT if the task did not exist
+} cpu_window_t;
+
+static portMUX_TYPE cpu_lock = portMUX_INITIALIZER_UNLOCKED;
+static cpu_slot_t cpu_slots[DIAGNOSTICS_MAX_TASKS];
+static int cpu_slot_count = 0;
+static bool cpu_slots_full_warned = false;
+static cpu_window_t cpu_windows[DIAGNOSTICS_CPU_WINDOWS];
+static int cpu_window_count = 0;
+static int cpu_window_next = 0;
+static run_time_t cpu_total_run_time = 0;
+static int64_t cpu_sampled_us = 0;
+static esp_timer_handle_t cpu_timer = NULL;
+static metric_t *cpu_idle_metric;
+
+// A slot is free when its task is not in this sample and has no share in any stored window
+static bool cpu_slot_free(int slot, const TaskStatus_t *status, UBaseType_t count) {
+    for (UBaseType_t i = 0; i < count; i++) {
+        if (status[i].xTaskNumber == cpu_slots[slot].number) {
+            return false;
+        }
+    }
+    for (int w = 0; w < cpu_window_count; w++) {
+        if (cpu_windows[w].permille[slot] != CPU_ABSENT) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int cpu_slot(const TaskStatus_t *task, const TaskStatus_t *status, UBaseType_t count) {
+    for (int i = 0; i < cpu_slot_count; i++) {
+        if (cpu_slots[i].number == task->xTaskNumber) {
+            return i;
+        }
+    }
+    int index = cpu_slot_count;
+    for (int i = 0; index == DIAGNOSTICS_MAX_TASKS && i < cpu_slot_count; i++) {
+        if (cpu_slot_free(i, status, count)) {
+            index = i;
+        }
+    }
+    if (index == DIAGNOSTICS_MAX_TASKS) {
+        if (!cpu_slots_full_warned) {
+            cpu_slots_full_warned = true;
+            ESP_LOGW(TAG, "More than %d tasks in the CPU windows, %s not accounted", DIAGNOSTICS_MAX_TASKS,
+                     task->pcTaskName);
+        }
+        return -1;
+    }
+    // Created since the previous sample, so all its time is in this window
+    cpu_slot_t slot = {.number = task->xTaskNumber, .run_time = 0};
+    snprintf(slot.name, sizeof(slot.name), "%s", task->pcTaskName);
+    taskENTER_CRITICAL(&cpu_lock);
+    cpu_slots[index] = slot;
+    if (index == cpu_slot_count) {
+        cpu_slot_count++;
+    }
+    taskEXIT_CRITICAL(&cpu_lock);
+    return index;
+}
+
+// Runs on the esp_timer task every DIAGNOSTICS_CPU_WINDOW_S; the first call only sets the baseline
+static void sample_cpu(void *arg) {
+    static TaskStatus_t status[DIAGNOSTICS_MAX_TASKS];
+    run_time_t total = 0;
+    UBaseType_t count = uxTaskGetSystemState(status, DIAGNOSTICS_MAX_TASKS, &total);
+    int64_t now = esp_timer_get_time();
+    if (count == 0) {
+        return;
+    }
+
+    // Unsigned, so one wrap of the counter between samples is harmless
+    run_time_t elapsed = total - cpu_total_run_time;
+    cpu_window_t window = {.window_ms = (uint32_t)((now - cpu_sampled_us) / 1000)};
+    for (int i = 0; i < DIAGNOSTICS_MAX_TASKS; i++) {
+        window.permille[i] = CPU_ABSENT;
+    }
+    TaskHandle_t idle = xTaskGetIdleTaskHandle();
+    int idle_permille = -1;
+    for (UBaseType_t i = 0; i < count; i++) {
+        int slot = cpu_slot(&status[i], status, count);
+        if (slot < 0) {
+            continue;
+        }
+        run_time_t used = status[i].ulRunTimeCounter - cpu_slots[slot].run_time;
+        cpu_slots[slot].run_time = status[i].ulRunTimeCounter;
+        uint64_t permille = elapsed > 0 ? (uint64_t)used * 1000 / elapsed : 0;
+        window.permille[slot] = permille > 1000 ? 1000 : (uint16_t)permille;
+        if (status[i].xHandle == idle) {
+            idle_permille = window.permille[slot];
+        }
+    }
+
+    cpu_total_run_time = total;
+    if (cpu_sampled_us == 0) {
+        cpu_sampled_us = now;
+        return;
+    }
+    taskENTER_CRITICAL(&cpu_lock);
+    cpu_sampled_us = now;
+    cpu_windows[cpu_window_next] = window;
+    cpu_window_next = (cpu_window_next + 1) % DIAGNOSTICS_CPU_WINDOWS;
+    if (cpu_window_count < DIAGNOSTICS_CPU_WINDOWS) {
+        cpu_window_count++;
+    }
+    taskEXIT_CRITICAL(&cpu_lock);
+    if (idle_permille >= 0) {
+        metric_set(cpu_idle_metric, idle_permille / 10);
+    }
+}
+
+// "cpu": {"age_ms": n, "window_ms": [...], "tasks": {name: [permille or null per window]}}, oldest window
+// first; age_ms is how long ago the newest window ended
+static void add_cpu(cJSON *root) {
+    static cpu_window_t windows[DIAGNOSTICS_CPU_WINDOWS];
+    static cpu_slot_t slots[DIAGNOSTICS_MAX_TASKS];
+
+    taskENTER_CRITICAL(&cpu_lock);
+    int window_count = cpu_window_count;
+    int first = (cpu_window_next - window_count + DIAGNOSTICS_CPU_WINDOWS) % DIAGNOSTICS_CPU_WINDOWS;
+    for (int w = 0; w < window_count; w++) {
+        windows[w] = cpu_windows[(first + w) % DIAGNOSTICS_CPU_WINDOWS];
+    }
+    int slot_count = cpu_slot_count;
+    memcpy(slots, cpu_slots, sizeof(slots));
+    int64_t sampled_us = cpu_sampled_us;
+    taskEXIT_CRITICAL(&cpu_lock);
+
+    if (window_count == 0) {
+        return;
+    }
+    cJSON *cpu = cJSON_AddObjectToObject(root, "cpu");
+    cJSON_AddNumberToObject(cpu, "age_ms", (double)((esp_timer_get_time() - sampled_us) / 1000));
+    cJSON *window_ms = cJSON_AddArrayToObject(cpu, "window_ms");
+    for (int w = 0; w < window_count; w++) {
+        cJSON_AddItemToArray(window_ms, cJSON_CreateNumber(windows[w].window_ms));
+    }
+    cJSON *tasks = cJSON_AddObjectToObject(cpu, "tasks");
+    for (int slot = 0; slot < slot_count; slot++) {
+        bool seen = false;
+        for (int w = 0; w < window_count; w++) {
+            seen |= windows[w].permille[slot] != CPU_ABSENT;
+        }
+        if (!seen) {
+            continue;  // Gone before the oldest window
+        }
+        cJSON *shares = cJSON_AddArrayToObject(tasks, slots[slot].name);
+        for (int w = 0; w < window_count; w++) {
+            uint16_t permille = windows[w].permille[slot];
+            cJSON_AddItemToArray(shares, permille == CPU_ABSENT ? cJSON_CreateNull() : cJSON_CreateNumber(permille));
+        }
+    }
+}
+#endif  // DIAGNOSTICS_CPU_STATS
+
+void init_diagnostics(void) {
+    for (int i = 0; i < WATCHED_TASK_COUNT; i++) {
+        snprintf(stack_metric_names[i], sizeof(stack_metric_names[i]), "stack.%s", watched_tasks[i]);
+        stack_metrics[i] = metrics_gauge(stack_metric_names[i]);
+        metric_set_threshold(stack_metrics[i], STACK_METRIC_THRESHOLD);
+    }
+    heap_free_metric = metrics_gauge("heap.free");
+    heap_min_free_metric = metrics_gauge("heap.min_free");
+    heap_largest_metric = metrics_gauge("heap.largest");
+    heap_frag_metric = metrics_gauge("heap.frag_pct");
+    metric_set_threshold(heap_free_metric, HEAP_METRIC_THRESHOLD);
+    metric_set_threshold(heap_min_free_metric, HEAP_METRIC_THRESHOLD);
+    metric_set_threshold(heap_largest_metric, HEAP_METRIC_THRESHOLD);
+    metric_set_threshold(heap_frag_metric, 2);
+
+#if DIAGNOSTICS_CPU_STATS
+    cpu_idle_metric = metrics_gauge("cpu.idle_pct");
+    metric_set_threshold(cpu_idle_metric, 5);
+    sample_cpu(NULL);
+    const esp_timer_create_args_t args = {.callback = &sample_cpu, .name = "cpu_sample"};
+    ESP_ERROR_CHECK(esp_timer_create(&args, &cpu_timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(cpu_timer, DIAGNOSTICS_CPU_WINDOW_S * 1000000LL));
+#endif
+}
+
+// Share of free memory that is not in the largest block; high means fragmented
+static int fragmentation_pct(size_t free_bytes, size_t largest) {
+    return free_bytes > 0 ? (int)(100 - (uint64_t)largest * 100 / free_bytes) : 0;
+}
+
+void diagnostics_sample(void) {
+    for (int i = 0; i < WATCHED_TASK_COUNT; i++) {
+        TaskHandle_t task = xTaskGetHandle(watched_tasks[i]);
+        if (task == NULL) {
+            continue;
+        }
+        // Bytes on ESP-IDF, where StackType_t is a byte
+        UBaseType_t high_water = uxTaskGetStackHighWaterMark(task);
+        metric_set(stack_metrics[i], (int)high_water);
+        if (high_water < DIAGNOSTICS_STACK_WARN_BYTES && !stack_warned[i]) {
+            stack_warned[i] = true;
+            ESP_LOGW(TAG, "%s has only %u bytes of stack left", watched_tasks[i], (unsigned)high_water);
+        }
+    }
+
+    size_t free_bytes = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT);
+    metric_set(heap_free_metric, (int)free_bytes);
+    metric_set(heap_min_free_metric, (int)heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT));
+    metric_set(heap_largest_metric, (int)largest);
+    metric_set(heap_frag_metric, fragmentation_pct(free_bytes, largest));
+}
+
+static void add_tasks(cJSON *tasks) {
+#if configUSE_TRACE_FACILITY
+    static TaskStatus_t status[DIAGNOSTICS_MAX_TASKS];
+    UBaseType_t count = uxTaskGetSystemState(status, DIAGNOSTICS_MAX_TASKS, NULL);
+    if (count == 0) {
+        ESP_LOGW(TAG, "More than %d tasks, task list left out", DIAGNOSTICS_MAX_TASKS);
+    }
+    for (UBaseType_t i = 0; i < count; i++) {
+        cJSON *task = cJSON_AddObjectToObject(tasks, status[i].pcTaskName);
+        cJSON_AddNumberToObject(task, "stack_free_min", status[i].usStackHighWaterMark);
+        cJSON_AddNumberToObject(task, "priority", status[i].uxCurrentPriority);
+    }
+#else
+    for (int i = 0; i < WATCHED_TASK_COUNT; i++) {
+        TaskHandle_t handle = xTaskGetHandle(watched_tasks[i]);
+        if (handle != NULL) {
+            cJSON *task = cJSON_AddObjectToObject(tasks, watched_tasks[i]);
+            cJSON_AddNumberToObject(task, "stack_free_min", uxTaskGetStackHighWaterMark(handle));
+            cJSON_AddNumberToObject(task, "priority", uxTaskPriorityGet(handle));
+        }
+    }
+#endif
+}
+
+void handle_diagnostics_request_message(const mqtt_work_item_t *item) {
+    ESP_LOGI(TAG, "Diagnostics requested");
+    diagnostics_sample();
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "uptime_s", (double)(esp_timer_get_time() / 1000000));
+    add_tasks(cJSON_AddObjectToObject(root, "tasks"));
+#if DIAGNOSTICS_CPU_STATS
+    add_cpu(root);
+#endif
+    cJSON *heaps = cJSON_AddObjectToObject(root, "heap");
+    for (int i = 0; i < sizeof(heap_regions) / sizeof(heap_regions[0]); i++) {
+        size_t free_bytes = heap_caps_get_free_size(heap_regions[i].caps);
+        size_t largest = heap_caps_get_largest_free_block(heap_regions[i].caps);
+        cJSON *heap = cJSON_AddObjectToObject(heaps, heap_regions[i].name);
+        cJSON_AddNumberToObject(heap, "free", free_bytes);
+        cJSON_AddNumberToObject(heap, "min_free", heap_caps_get_minimum_free_size(heap_regions[i].caps));
+        cJSON_AddNumberToObject(heap, "largest", largest);
+        cJSON_AddNumberToObject(heap, "frag_pct", fragmentation_pct(free_bytes, largest));
+    }
+
+    char *json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (json == NULL) {
+        ESP_LOGE(TAG, "Could not encode diagnostics");
+        return;
+    }
+    mqtt_publish(item->client, DIAGNOSTICS_TOPIC, json, 0, 0, 0);
+    free(json);
+}
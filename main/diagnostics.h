@@ -0,0 +1,58 @@
+#ifndef SNOOPER_DIAGNOSTICS_H
+#define SNOOPER_DIAGNOSTICS_H
+
+#include "mqtt_worker.h"
+
+// Stack and heap diagnostics for sizing task stacks and spotting fragmentation before it turns
+// into an allocation failure.
+//
+// diagnostics_sample() runs with every telemetry frame and updates gauges in the metrics
+// registry: stack.<task> is the least free stack the task has ever had (its high-water mark,
+// in bytes), and heap.free, heap.min_free, heap.largest and heap.frag_pct describe the default
+// heap. Any message on DIAGNOSTICS_REQUEST_TOPIC gets a full JSON report on DIAGNOSTICS_TOPIC:
+// every task's high-water mark (only the tasks below without CONFIG_FREERTOS_USE_TRACE_FACILITY)
+// and free, minimum-ever-free and largest-free-block for each heap capability.
+//
+// With CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS and CONFIG_FREERTOS_USE_TRACE_FACILITY the
+// run-time counters are also sampled every DIAGNOSTICS_CPU_WINDOW_S. The report then carries
+// each task's share of the CPU, in tenths of a percent, for the last DIAGNOSTICS_CPU_WINDOWS
+// windows, oldest first, and cpu.idle_pct is the idle task's share of the latest window.
+// scripts/cpu_report.py renders the reports.
+
+#ifndef DIAGNOSTICS_REQUEST_TOPIC
+#ifdef CONFIG_MQTT_SUBSCRIBE_DIAGNOSTICS_TOPIC
+#define DIAGNOSTICS_REQUEST_TOPIC CONFIG_MQTT_SUBSCRIBE_DIAGNOSTICS_TOPIC
+#else
+#define DIAGNOSTICS_REQUEST_TOPIC "coop/snooper/diagnostics/request"
+#endif
+#endif
+
+#ifndef DIAGNOSTICS_TOPIC
+#ifdef CONFIG_MQTT_PUBLISH_DIAGNOSTICS_TOPIC
+#define DIAGNOSTICS_TOPIC CONFIG_MQTT_PUBLISH_DIAGNOSTICS_TOPIC
+#else
+#define DIAGNOSTICS_TOPIC "coop/snooper/diagnostics"
+#endif
+#endif
+
+// A task whose high-water mark drops below this is logged once as a warning
+#ifndef DIAGNOSTICS_STACK_WARN_BYTES
+#define DIAGNOSTICS_STACK_WARN_BYTES 256
+#endif
+
+#ifndef DIAGNOSTICS_CPU_WINDOW_S
+#define DIAGNOSTICS_CPU_WINDOW_S 10
+#endif
+
+#ifndef DIAGNOSTICS_CPU_WINDOWS
+#define DIAGNOSTICS_CPU_WINDOWS 6
+#endif
+
+// Registers the gauges and starts CPU sampling; call before the first telemetry frame
+void init_diagnostics(void);
+
+void diagnostics_sample(void);
+
+void handle_diagnostics_request_message(const mqtt_work_item_t *item);
+
+#endif  // SNOOPER_DIAGNOSTICS_H
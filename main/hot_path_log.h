@@ -0,0 +1,17 @@
+#ifndef SNOOPER_HOT_PATH_LOG_H
+#define SNOOPER_HOT_PATH_LOG_H
+
+// Included first by the files on the audio and message dispatch hot paths, ahead of anything
+// that pulls in esp_log.h. With LOG_STRIP_HOT_PATH set, their debug and verbose calls are
+// compiled out; otherwise those calls stay in and can be turned on per tag at runtime
+// (log_level.h).
+
+#ifndef LOG_STRIP_HOT_PATH
+#define LOG_STRIP_HOT_PATH 0
+#endif
+
+#if LOG_STRIP_HOT_PATH && !defined(LOG_LOCAL_LEVEL)
+#define LOG_LOCAL_LEVEL 3  // ESP_LOG_INFO
+#endif
+
+#endif  // SNOOPER_HOT_PATH_LOG_H
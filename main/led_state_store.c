@@ -0,0 +1,161 @@
+#include "led_state_store.h"
+
+#include <stddef.h>
+#include <time.h>
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+static const char *TAG = "LED_STATE";
+
+#define LED_STATE_MAGIC 0x4c454453  // "LEDS"
+#define LED_STATE_NAMESPACE "led_state"
+#define LED_STATE_KEY "last"
+#define VALID_EPOCH_SECONDS 1609459200  // 2021-01-01; anything earlier means the clock is not set
+
+// Stale indicator: the restored state for five ticks, then a white blip
+#define INDICATOR_TICK_US (500 * 1000)
+#define INDICATOR_PERIOD_TICKS 6
+
+typedef struct {
+    uint32_t magic;
+    uint32_t state;
+    int64_t saved_s;  // Wall clock when applied, 0 if it was not set
+    uint32_t crc;     // Over everything before this field
+} led_record_t;
+
+// Not cleared by the startup code, so it is still there after a warm reset
+static RTC_NOINIT_ATTR led_record_t rtc_record;
+static led_record_t flash_record;  // What NVS holds
+static bool flash_valid = false;
+static int64_t last_flash_write_us = 0;
+static esp_timer_handle_t flash_timer = NULL;
+
+static esp_timer_handle_t indicator_timer = NULL;
+static led_state_t restored_state;
+static bool indicator_running = false;
+static int indicator_tick = 0;
+
+static uint32_t record_crc(const led_record_t *r) {
+    return esp_rom_crc32_le(0, (const uint8_t *)r, offsetof(led_record_t, crc));
+}
+
+static bool record_ok(const led_record_t *r) { return r->magic == LED_STATE_MAGIC && r->crc == record_crc(r); }
+
+static int64_t wall_clock_s(void) {
+    time_t now = time(NULL);
+    return now >= VALID_EPOCH_SECONDS ? (int64_t)now : 0;
+}
+
+// Runs at the end of the batch window; writes the state it ends on if flash does not have it
+static void flush_to_flash(void *arg) {
+    int64_t now = esp_timer_get_time();
+    int64_t since_us = now - last_flash_write_us;
+
+    if (last_flash_write_us != 0 && since_us < LED_STATE_NVS_MIN_INTERVAL_S * 1000000LL) {
+        esp_timer_start_once(flash_timer, LED_STATE_NVS_MIN_INTERVAL_S * 1000000LL - since_us);
+        return;
+    }
+
+    led_record_t record = rtc_record;
+    if (!record_ok(&record) || (flash_valid && flash_record.state == record.state)) {
+        return;  // Settled back on the stored state
+    }
+
+    nvs_handle_t handle;
+    if (nvs_open(LED_STATE_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        ESP_LOGW(TAG, "Could not open NVS, LED state not persisted");
+        return;
+    }
+    if (nvs_set_blob(handle, LED_STATE_KEY, &record, sizeof(record)) == ESP_OK && nvs_commit(handle) == ESP_OK) {
+        flash_record = record;
+        flash_valid = true;
+        last_flash_write_us = now;
+        ESP_LOGD(TAG, "Persisted LED state %lu", (unsigned long)record.state);
+    } else {
+        ESP_LOGW(TAG, "Could not persist LED state");
+    }
+    nvs_close(handle);
+}
+
+static void indicator_tick_cb(void *arg) {
+    indicator_tick = (indicator_tick + 1) % INDICATOR_PERIOD_TICKS;
+    if (indicator_tick == INDICATOR_PERIOD_TICKS - 1) {
+        set_led(LED_FLASHING_WHITE);
+    } else if (indicator_tick == 0) {
+        set_led(restored_state);
+    }
+}
+
+bool led_state_restore(void) {
+    if (!LED_STATE_STORE_ENABLED) {
+        return false;
+    }
+    const esp_timer_create_args_t flash_args = {.callback = &flush_to_flash, .name = "led_flush"};
+    const esp_timer_create_args_t indicator_args = {.callback = &indicator_tick_cb, .name = "led_stale"};
+    ESP_ERROR_CHECK(esp_timer_create(&flash_args, &flash_timer));
+    ESP_ERROR_CHECK(esp_timer_create(&indicator_args, &indicator_timer));
+
+    nvs_handle_t handle;
+    if (nvs_open(LED_STATE_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+        size_t size = sizeof(flash_record);
+        flash_valid = nvs_get_blob(handle, LED_STATE_KEY, &flash_record, &size) == ESP_OK &&
+                      size == sizeof(flash_record) && record_ok(&flash_record);
+        nvs_close(handle);
+    }
+
+    // RTC memory holds garbage after power-on; the CRC catches that. It is never older than flash.
+    const char *source = "RTC";
+    if (!record_ok(&rtc_record)) {
+        if (!flash_valid) {
+            return false;
+        }
+        rtc_record = flash_record;
+        source = "NVS";
+    }
+
+    int64_t now = wall_clock_s();
+    int64_t age_s = now != 0 && rtc_record.saved_s != 0 ? now - rtc_record.saved_s : -1;
+    bool stale = age_s < 0 || age_s > LED_STATE_FRESH_S;
+
+    restored_state = (led_state_t)rtc_record.state;
+    set_led(restored_state);
+    if (stale) {
+        indicator_tick = 0;
+        indicator_running = true;
+        ESP_ERROR_CHECK(esp_timer_start_periodic(indicator_timer, INDICATOR_TICK_US));
+    }
+    ESP_LOGI(TAG, "Restored LED state %d from %s, age %lld s%s", restored_state, source, age_s,
+             stale ? ", marked stale" : "");
+    return true;
+}
+
+void led_state_save(led_state_t state) {
+    if (flash_timer == NULL) {
+        return;  // Store disabled
+    }
+    led_state_stop_indicator();
+    // The OTA indication means nothing after the reboot that ends it
+    if (state == LED_FLASHING_GREEN) {
+        return;
+    }
+
+    rtc_record = (led_record_t){.magic = LED_STATE_MAGIC, .state = state, .saved_s = wall_clock_s()};
+    rtc_record.crc = record_crc(&rtc_record);
+
+    if ((!flash_valid || flash_record.state != (uint32_t)state) && !esp_timer_is_active(flash_timer)) {
+        esp_timer_start_once(flash_timer, LED_STATE_NVS_DELAY_S * 1000000LL);
+    }
+}
+
+void led_state_stop_indicator(void) {
+    if (!indicator_running) {
+        return;
+    }
+    indicator_running = false;
+    esp_timer_stop(indicator_timer);
+    set_led(restored_state);
+}
@@ -0,0 +1,46 @@
+#ifndef SNOOPER_LED_STATE_STORE_H
+#define SNOOPER_LED_STATE_STORE_H
+
+#include <stdbool.h>
+
+#include "gecl-rgb-led-manager.h"
+
+// Last applied LED state, shown again at boot so the coop status is visible before MQTT is up.
+//
+// Every change goes to RTC memory, which survives esp_restart() and OTA reboots. Flash is
+// written lazily: the first change arms a LED_STATE_NVS_DELAY_S batch window and only the
+// state at its end is written, and then only if it differs from what is already stored, at
+// most once per LED_STATE_NVS_MIN_INTERVAL_S. A flapping door therefore costs at most one
+// write per interval, and none if it settles back where it was.
+//
+// A restored state older than LED_STATE_FRESH_S, or of unknown age, is shown with a white blip
+// every few seconds until the first status arrives.
+
+#ifndef LED_STATE_STORE_ENABLED
+#define LED_STATE_STORE_ENABLED 1
+#endif
+
+#ifndef LED_STATE_FRESH_S
+#define LED_STATE_FRESH_S (15 * 60)
+#endif
+
+#ifndef LED_STATE_NVS_DELAY_S
+#define LED_STATE_NVS_DELAY_S 60
+#endif
+
+#ifndef LED_STATE_NVS_MIN_INTERVAL_S
+#define LED_STATE_NVS_MIN_INTERVAL_S (10 * 60)
+#endif
+
+// Shows the saved state; NVS must be initialized and the LED task started. Returns false if
+// nothing was saved, leaving the LED alone.
+bool led_state_restore(void);
+
+// Records a state applied from a status message
+void led_state_save(led_state_t state);
+
+// Ends the stale indicator, leaving the restored state on; call before anything else drives
+// the LED
+void led_state_stop_indicator(void);
+
+#endif  // SNOOPER_LED_STATE_STORE_H
@@ -0,0 +1,112 @@
+#include "log_level.h"
+
+#include <string.h>
+
+#include "cJSON.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+
+static const char *TAG = "LOG_LEVEL";
+
+#define LOG_LEVEL_NAMESPACE "log_level"
+#define DEFAULT_TAG "*"
+
+static const char *level_names[] = {"none", "error", "warn", "info", "debug", "verbose"};
+
+static bool parse_level(const char *name, esp_log_level_t *level) {
+    for (int i = 0; i < sizeof(level_names) / sizeof(level_names[0]); i++) {
+        if (strcmp(name, level_names[i]) == 0) {
+            *level = (esp_log_level_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void init_log_levels(void) {
+    nvs_handle_t handle;
+    uint8_t level;
+
+    if (nvs_open(LOG_LEVEL_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return;  // Nothing saved yet
+    }
+    // The default first: setting "*" discards the per-tag levels set before it
+    if (nvs_get_u8(handle, DEFAULT_TAG, &level) == ESP_OK) {
+        esp_log_level_set(DEFAULT_TAG, (esp_log_level_t)level);
+    }
+    nvs_close(handle);
+
+    nvs_iterator_t it = NULL;
+    esp_err_t err = nvs_entry_find(NVS_DEFAULT_PART_NAME, LOG_LEVEL_NAMESPACE, NVS_TYPE_U8, &it);
+    while (err == ESP_OK) {
+        nvs_entry_info_t info;
+        nvs_entry_info(it, &info);
+        if (strcmp(info.key, DEFAULT_TAG) != 0 && nvs_open(LOG_LEVEL_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+            if (nvs_get_u8(handle, info.key, &level) == ESP_OK) {
+                esp_log_level_set(info.key, (esp_log_level_t)level);
+                ESP_LOGI(TAG, "Restored %s=%d", info.key, level);
+            }
+            nvs_close(handle);
+        }
+        err = nvs_entry_next(&it);
+    }
+    nvs_release_iterator(it);
+}
+
+static void apply_level(nvs_handle_t handle, const cJSON *entry) {
+    const char *tag = entry->string;
+    esp_log_level_t level;
+
+    if (strlen(tag) >= NVS_KEY_NAME_MAX_SIZE || !cJSON_IsString(entry)) {
+        ESP_LOGE(TAG, "Ignoring log level entry %s", tag);
+        return;
+    }
+    if (strcmp(entry->valuestring, "reset") == 0) {
+        esp_log_level_set(tag, esp_log_level_get(DEFAULT_TAG));
+        nvs_erase_key(handle, tag);
+        ESP_LOGI(TAG, "%s follows the default level again", tag);
+        return;
+    }
+    if (!parse_level(entry->valuestring, &level)) {
+        ESP_LOGE(TAG, "Unknown log level %s for %s", entry->valuestring, tag);
+        return;
+    }
+    esp_log_level_set(tag, level);
+    nvs_set_u8(handle, tag, (uint8_t)level);
+    ESP_LOGI(TAG, "Log level %s=%s", tag, level_names[level]);
+}
+
+void handle_log_level_message(const mqtt_work_item_t *item) {
+    nvs_handle_t handle;
+
+    cJSON *root = cJSON_Parse(item->data);
+    if (root == NULL || !cJSON_IsObject(root)) {
+        ESP_LOGE(TAG, "Log level command is not a JSON object");
+        cJSON_Delete(root);
+        return;
+    }
+    if (nvs_open(LOG_LEVEL_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        ESP_LOGE(TAG, "Could not open NVS namespace %s", LOG_LEVEL_NAMESPACE);
+        cJSON_Delete(root);
+        return;
+    }
+
+    // "*" first, for the same reason as in init_log_levels()
+    const cJSON *entry = cJSON_GetObjectItem(root, DEFAULT_TAG);
+    if (entry != NULL) {
+        apply_level(handle, entry);
+    }
+    cJSON_ArrayForEach(entry, root) {
+        if (strcmp(entry->string, DEFAULT_TAG) != 0) {
+            apply_level(handle, entry);
+        }
+    }
+
+    esp_err_t err = nvs_commit(handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Could not save log levels: %s", esp_err_to_name(err));
+    }
+    nvs_close(handle);
+    cJSON_Delete(root);
+}
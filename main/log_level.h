@@ -0,0 +1,26 @@
+#ifndef SNOOPER_LOG_LEVEL_H
+#define SNOOPER_LOG_LEVEL_H
+
+#include "mqtt_worker.h"
+
+// Runtime log levels per tag, set over MQTT and kept in NVS across reboots.
+//
+// Payload: a JSON object mapping tags to levels, e.g. {"MP3_PLAYER": "debug", "*": "warn"}.
+// Levels are none, error, warn, info, debug and verbose; "reset" drops a tag's override so it
+// follows "*" again. A level above what a file was compiled with (CONFIG_LOG_MAXIMUM_LEVEL,
+// LOG_STRIP_HOT_PATH) has no effect on that file.
+
+#ifndef LOG_LEVEL_TOPIC
+#ifdef CONFIG_MQTT_SUBSCRIBE_LOG_LEVEL_TOPIC
+#define LOG_LEVEL_TOPIC CONFIG_MQTT_SUBSCRIBE_LOG_LEVEL_TOPIC
+#else
+#define LOG_LEVEL_TOPIC "coop/snooper/log/level"
+#endif
+#endif
+
+// Restores the saved levels; NVS must be initialized
+void init_log_levels(void);
+
+void handle_log_level_message(const mqtt_work_item_t *item);
+
+#endif  // SNOOPER_LOG_LEVEL_H
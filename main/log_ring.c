@@ -0,0 +1,106 @@
+#include "log_ring.h"
+
+#include <string.h>
+
+#define HEADER_BYTES 4
+#define HEADER_PUBLISHED 0x80000000u
+#define HEADER_PADDING 0x40000000u
+#define HEADER_LENGTH_MASK 0x3fffffffu
+
+static inline uint32_t record_bytes(size_t len) { return (HEADER_BYTES + len + 3) & ~3u; }
+
+static inline _Atomic uint32_t *header_at(log_ring_t *ring, uint32_t pos) {
+    return (_Atomic uint32_t *)&ring->buf[(pos & ring->mask) / 4];
+}
+
+bool log_ring_push(log_ring_t *ring, const void *data, size_t len) {
+    uint32_t size = ring->mask + 1;
+    uint32_t need = record_bytes(len);
+    uint32_t head, pad, used;
+
+    if (len == 0) {
+        return true;
+    }
+    if (len > LOG_RING_MAX_RECORD || need > size / 2) {
+        atomic_fetch_add_explicit(&ring->dropped_records, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&ring->dropped_bytes, len, memory_order_relaxed);
+        return false;
+    }
+
+    head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    do {
+        uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        uint32_t contiguous = size - (head & ring->mask);
+        pad = need > contiguous ? contiguous : 0;
+        used = head + pad + need - tail;
+        if (used > size) {
+            atomic_fetch_add_explicit(&ring->dropped_records, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&ring->dropped_bytes, len, memory_order_relaxed);
+            return false;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&ring->head, &head, head + pad + need, memory_order_relaxed,
+                                                    memory_order_relaxed));
+
+    if (pad > 0) {
+        atomic_store_explicit(header_at(ring, head), HEADER_PUBLISHED | HEADER_PADDING | pad, memory_order_release);
+        head += pad;
+    }
+    memcpy((uint8_t *)ring->buf + (head & ring->mask) + HEADER_BYTES, data, len);
+    atomic_store_explicit(header_at(ring, head), HEADER_PUBLISHED | len, memory_order_release);
+
+    atomic_fetch_add_explicit(&ring->records, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&ring->bytes, len, memory_order_relaxed);
+    uint32_t high = atomic_load_explicit(&ring->high_water, memory_order_relaxed);
+    while (used > high &&
+           !atomic_compare_exchange_weak_explicit(&ring->high_water, &high, used, memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+    }
+    return true;
+}
+
+// Consumed bytes are cleared before the tail moves past them: the next record may start
+// anywhere in them, and until its producer publishes it the consumer must read a zero header
+static void release(log_ring_t *ring, uint32_t tail, uint32_t bytes) {
+    memset((uint8_t *)ring->buf + (tail & ring->mask), 0, bytes);
+    atomic_store_explicit(&ring->tail, tail + bytes, memory_order_release);
+}
+
+size_t log_ring_peek(log_ring_t *ring, const void **data) {
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    while (tail != atomic_load_explicit(&ring->head, memory_order_acquire)) {
+        uint32_t header = atomic_load_explicit(header_at(ring, tail), memory_order_acquire);
+        if (!(header & HEADER_PUBLISHED)) {
+            return 0;
+        }
+        if (header & HEADER_PADDING) {
+            release(ring, tail, header & HEADER_LENGTH_MASK);
+            tail += header & HEADER_LENGTH_MASK;
+            continue;
+        }
+        *data = (const uint8_t *)ring->buf + (tail & ring->mask) + HEADER_BYTES;
+        return header & HEADER_LENGTH_MASK;
+    }
+    return 0;
+}
+
+void log_ring_pop(log_ring_t *ring) {
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t header = atomic_load_explicit(header_at(ring, tail), memory_order_relaxed);
+    if (header & HEADER_PUBLISHED) {
+        release(ring, tail, record_bytes(header & HEADER_LENGTH_MASK));
+    }
+}
+
+size_t log_ring_used(log_ring_t *ring) {
+    return atomic_load_explicit(&ring->head, memory_order_relaxed) -
+           atomic_load_explicit(&ring->tail, memory_order_relaxed);
+}
+
+void log_ring_get_stats(log_ring_t *ring, log_ring_stats_t *stats) {
+    stats->records = atomic_load_explicit(&ring->records, memory_order_relaxed);
+    stats->bytes = atomic_load_explicit(&ring->bytes, memory_order_relaxed);
+    stats->dropped_records = atomic_load_explicit(&ring->dropped_records, memory_order_relaxed);
+    stats->dropped_bytes = atomic_load_explicit(&ring->dropped_bytes, memory_order_relaxed);
+    stats->high_water = atomic_load_explicit(&ring->high_water, memory_order_relaxed);
+    stats->used = log_ring_used(ring);
+}
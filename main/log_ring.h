@@ -0,0 +1,60 @@
+#ifndef SNOOPER_LOG_RING_H
+#define SNOOPER_LOG_RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Lock-free ring of variable-length records: any number of producers, one consumer.
+//
+// Producers reserve space by advancing the head with a compare-and-swap, copy their record
+// and then publish its header; no lock is taken and a producer never waits. A record only
+// takes a 4 byte header plus its length rounded up to 4 bytes. A record that would straddle
+// the end of the buffer is preceded by a padding record, so every record is contiguous and
+// the consumer can read it in place.
+//
+// Drop policy: when the ring does not have room, the new record is dropped (never blocks,
+// never overwrites unread records) and counted in dropped_records/dropped_bytes.
+//
+// The consumer stops at the first record whose producer has reserved but not yet published
+// it; later records wait until that producer resumes.
+
+#define LOG_RING_MAX_RECORD 0x3fff
+
+typedef struct {
+    uint32_t *buf;  // Size is a power of two, in bytes: mask + 1
+    uint32_t mask;
+    atomic_uint head;  // Free-running byte positions
+    atomic_uint tail;
+    atomic_uint records;
+    atomic_uint bytes;
+    atomic_uint dropped_records;
+    atomic_uint dropped_bytes;
+    atomic_uint high_water;
+} log_ring_t;
+
+typedef struct {
+    uint32_t records;
+    uint32_t bytes;
+    uint32_t dropped_records;
+    uint32_t dropped_bytes;
+    uint32_t high_water;
+    uint32_t used;
+} log_ring_stats_t;
+
+// storage must be a uint32_t array whose size in bytes is a power of two
+#define LOG_RING_INITIALIZER(storage) {.buf = (storage), .mask = sizeof(storage) - 1}
+
+// Returns false if the record was dropped
+bool log_ring_push(log_ring_t *ring, const void *data, size_t len);
+
+// Consumer side: returns the length of the oldest published record and points *data at it,
+// or 0 when there is none. The record stays valid until log_ring_pop().
+size_t log_ring_peek(log_ring_t *ring, const void **data);
+void log_ring_pop(log_ring_t *ring);
+
+size_t log_ring_used(log_ring_t *ring);
+void log_ring_get_stats(log_ring_t *ring, log_ring_stats_t *stats);
+
+#endif  // SNOOPER_LOG_RING_H
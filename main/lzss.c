@@ -0,0 +1,72 @@
+#include "lzss.h"
+
+#include <string.h>
+
+#define LZSS_HASH_BITS 8
+#define LZSS_HASH_SIZE (1 << LZSS_HASH_BITS)
+
+static inline uint32_t lzss_hash(const uint8_t *p) {
+    return ((p[0] << 5) ^ (p[1] << 2) ^ p[2]) & (LZSS_HASH_SIZE - 1);
+}
+
+size_t lzss_compress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_cap) {
+    int16_t head[LZSS_HASH_SIZE];
+    size_t in_pos = 0;
+    size_t out_pos = 0;
+    size_t flag_pos = 0;
+    int token = 8;  // Forces a new flag byte on the first token
+
+    memset(head, 0xff, sizeof(head));  // -1: no candidate
+
+    while (in_pos < in_len) {
+        if (token == 8) {
+            if (out_pos >= out_cap) {
+                return 0;
+            }
+            flag_pos = out_pos++;
+            out[flag_pos] = 0;
+            token = 0;
+        }
+
+        size_t best_len = 0;
+        size_t best_dist = 0;
+        if (in_pos + LZSS_MIN_MATCH <= in_len) {
+            uint32_t h = lzss_hash(&in[in_pos]);
+            int32_t candidate = head[h];
+            head[h] = (int16_t)(in_pos & 0x7fff);
+            // Positions are stored modulo 32K; anything beyond the window is rejected below
+            if (candidate >= 0 && (size_t)candidate < in_pos && in_pos - candidate <= LZSS_WINDOW) {
+                size_t limit = in_len - in_pos < LZSS_MAX_MATCH ? in_len - in_pos : LZSS_MAX_MATCH;
+                size_t len = 0;
+                while (len < limit && in[candidate + len] == in[in_pos + len]) {
+                    len++;
+                }
+                if (len >= LZSS_MIN_MATCH) {
+                    best_len = len;
+                    best_dist = in_pos - candidate;
+                }
+            }
+        }
+
+        if (best_len) {
+            if (out_pos + 2 > out_cap) {
+                return 0;
+            }
+            out[flag_pos] |= 1 << token;
+            out[out_pos++] = (best_dist - 1) & 0xff;
+            out[out_pos++] = (((best_dist - 1) >> 8) << 4) | (best_len - LZSS_MIN_MATCH);
+            // Index the positions covered by the match so later repeats can find them
+            for (size_t i = 1; i < best_len && in_pos + i + LZSS_MIN_MATCH <= in_len; i++) {
+                head[lzss_hash(&in[in_pos + i])] = (int16_t)((in_pos + i) & 0x7fff);
+            }
+            in_pos += best_len;
+        } else {
+            if (out_pos >= out_cap) {
+                return 0;
+            }
+            out[out_pos++] = in[in_pos++];
+        }
+        token++;
+    }
+    return out_pos;
+}
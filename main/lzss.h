@@ -0,0 +1,25 @@
+#ifndef SNOOPER_LZSS_H
+#define SNOOPER_LZSS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Small-RAM LZSS codec for log batches. The input buffer doubles as the dictionary, so the
+// only working memory is a 512 byte hash table on the caller's stack.
+//
+// Stream format: a flag byte precedes each group of up to 8 tokens, bit 0 first. A clear bit
+// is a literal byte. A set bit is a two byte match: b0 = (distance - 1) & 0xff,
+// b1 = ((distance - 1) >> 8) << 4 | (length - 3), giving distances 1..4096 and lengths 3..18.
+// scripts/decode_log_batch.py carries the matching decoder.
+
+#define LZSS_MIN_MATCH 3
+#define LZSS_MAX_MATCH 18
+#define LZSS_WINDOW 4096
+
+// Worst case: every token a literal, plus one flag byte per 8 literals
+#define LZSS_BOUND(n) ((n) + ((n) + 7) / 8)
+
+// in_len must be below 32K. Returns the compressed length, or 0 if out_cap is too small
+size_t lzss_compress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_cap);
+
+#endif  // SNOOPER_LZSS_H
@@ -1,6 +1,17 @@
+// Must come before anything that includes esp_log.h
+#include "hot_path_log.h"
+
+#include "app_loop.h"
+#include "boot.h"
+#include "boot_record.h"
 #include "cJSON.h"
+#include "cbor.h"
+#include "cloud_log.h"
+#include "deferred_log.h"
+#include "diagnostics.h"
 #include "esp_log.h"
 #include "esp_task_wdt.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
@@ -13,9 +24,23 @@
 #include "gecl-time-sync-manager.h"
 #include "gecl-versioning-manager.h"
 #include "gecl-wifi-manager.h"
+#include "led_state_store.h"
+#include "log_level.h"
 #include "mbedtls/debug.h"  // Add this to include mbedtls debug functions
-#include "mp3.h"            // Include the mp3 header
+#include "metrics.h"
+#include "mp3.h"  // Include the mp3 header
+#include "mqtt_publish.h"
+#include "mqtt_worker.h"
 #include "nvs_flash.h"
+#include "payload_encoding.h"
+#include "recovery.h"
+#include "rtc_journal.h"
+#include "static_alloc.h"
+#include "status_filter.h"
+#include "supervisor.h"
+#include "telemetry_schedule.h"
+#include "tls_session.h"
+#include "wifi_cache.h"
 
 static const char *TAG = "COOP_SNOOPER";
 const char *device_name = CONFIG_WIFI_HOSTNAME;
@@ -27,6 +52,83 @@ QueueHandle_t led_state_queue = NULL;
 
 TaskHandle_t ota_handler_task_handle = NULL;  // Task handle for OTA updating
 
+static TaskHandle_t audio_task_handle = NULL;
+static supervised_t *audio_supervised = NULL;
+
+STATIC_SEMAPHORE_STORAGE(audio);
+STATIC_SEMAPHORE_STORAGE(timer);
+STATIC_TASK_STORAGE(audio_player, 8192);
+STATIC_QUEUE_STORAGE(led_state, 10, sizeof(led_state_t));
+STATIC_TASK_STORAGE(led, 4096);
+
+// With a persistent session the broker queues QoS1 status messages while we are offline and
+// replays them after CONNACK, so the status_request round trip is only needed when the broker
+// has no session for us or we have not yet learned the door state since boot.
+#ifndef MQTT_PERSISTENT_SESSION
+#define MQTT_PERSISTENT_SESSION 1
+#endif
+
+// Supervisor deadlines. The gecl LED task is judged by its queue draining; it publishes through
+// the shared MQTT client, so a stuck one is never deleted, the device reboots.
+#ifndef LED_TASK_DEADLINE_MS
+#define LED_TASK_DEADLINE_MS 30000
+#endif
+
+#ifndef AUDIO_TASK_DEADLINE_MS
+#define AUDIO_TASK_DEADLINE_MS 30000
+#endif
+
+// A whole download; a hung OTA is not restarted, the reboot drops the half-written image
+#ifndef OTA_TASK_DEADLINE_MS
+#define OTA_TASK_DEADLINE_MS (15 * 60 * 1000)
+#endif
+
+// A SUBSCRIBE that could not even be queued is retried this often before the status request is
+// sent without waiting for the SUBACK; a refused status filter is resubscribed as often
+#ifndef MQTT_SUBSCRIBE_RETRIES
+#define MQTT_SUBSCRIBE_RETRIES 3
+#endif
+
+#ifndef MQTT_SUBSCRIBE_RETRY_MS
+#define MQTT_SUBSCRIBE_RETRY_MS 500
+#endif
+
+// Never subscribed; the connected handler posts it to the MQTT worker
+#define CONNECTED_WORK_TOPIC "$local/connected"
+// Never subscribed; the subscribe retry timer posts it to the MQTT worker
+#define SUBSCRIBE_WORK_TOPIC "$local/subscribe"
+
+#if MQTT_PERSISTENT_SESSION
+#define MQTT_STATUS_QOS 1
+#else
+#define MQTT_STATUS_QOS 0
+#endif
+
+static bool status_received = false;  // Set once a status message has been applied since boot
+
+// Stands in for the msg_id while the worker is queuing a retry, whose SUBACK can come first
+#define SUBSCRIBE_IN_FLIGHT -2
+
+// Connect sequence state, shared by the MQTT event task and the worker's subscribe retries
+static portMUX_TYPE subscribe_lock = portMUX_INITIALIZER_UNLOCKED;
+static int subscribe_msg_id = -1;
+static int subscribe_retries = 0;
+static bool subscribe_status_only = false;  // The retry is for the refused status filter alone
+static bool status_request_pending = false;
+static esp_mqtt_client_handle_t subscribe_client = NULL;
+static esp_timer_handle_t subscribe_timer = NULL;
+
+// CONNACK-to-first-status timing, shared with the MQTT worker task
+static portMUX_TYPE connect_timing_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t connack_us = 0;
+static bool first_status_pending = false;
+
+static metric_t *reconnect_metric;
+static metric_t *squawk_metric;
+static bool connected_before = false;
+
+#define VALID_EPOCH_SECONDS 1609459200  // 2021-01-01; anything earlier means SNTP has not synced
+
 #ifdef TENNIS_HOUSE
 extern const uint8_t coop_snooper_tennis_home_certificate_pem[];
 extern const uint8_t coop_snooper_tennis_home_private_pem_key[];
@@ -34,136 +136,430 @@ extern const uint8_t coop_snooper_tennis_home_private_pem_key[];
 extern const uint8_t coop_snooper_farmhouse_certificate_pem[];
 extern const uint8_t coop_snooper_farmhouse_private_pem_key[];
 #endif
+extern const uint8_t AmazonRootCA1_pem[];
+
+// Advertises CBOR; the backend picks the encoding by how it answers (payload_encoding.h)
+static int publish_status_request(esp_mqtt_client_handle_t client) {
+    if (payload_encoding(PAYLOAD_TOPIC_STATUS) == PAYLOAD_CBOR) {
+        uint8_t buf[48];
+        cbor_writer_t writer;
+        cbor_writer_init(&writer, buf, sizeof(buf));
+        cbor_put_map(&writer, 2);
+        cbor_put_text(&writer, "message");
+        cbor_put_text(&writer, "status_request");
+        cbor_put_text(&writer, "accept");
+        cbor_put_text(&writer, "cbor");
+        return mqtt_publish(client, CONFIG_MQTT_PUBLISH_STATUS_TOPIC, (const char *)buf, writer.len, 0, 0);
+    }
+#if PAYLOAD_CBOR_ENABLED
+    const char *request = "{\"message\":\"status_request\",\"accept\":\"cbor\"}";
+#else
+    const char *request = "{\"message\":\"status_request\"}";
+#endif
+    return mqtt_publish(client, CONFIG_MQTT_PUBLISH_STATUS_TOPIC, request, 0, 0, 0);
+}
+
+// One SUBSCRIBE for all topics; the status request waits for its SUBACK so the response cannot
+// race the status subscription
+static const esp_mqtt_topic_t subscribe_topics[] = {
+    {.filter = CONFIG_MQTT_SUBSCRIBE_STATUS_TOPIC, .qos = MQTT_STATUS_QOS},
+    {.filter = CONFIG_MQTT_SUBSCRIBE_OTA_UPDATE_SNOOPER_TOPIC, .qos = 0},
+    {.filter = CONFIG_MQTT_SUBSCRIBE_TELEMETRY_REQUEST_TOPIC, .qos = 0},
+    {.filter = LOG_LEVEL_TOPIC, .qos = 1},
+    {.filter = DIAGNOSTICS_REQUEST_TOPIC, .qos = 0},
+};
+
+static int send_subscribe(esp_mqtt_client_handle_t client, bool status_only) {
+    if (status_only) {
+        return esp_mqtt_client_subscribe_single(client, CONFIG_MQTT_SUBSCRIBE_STATUS_TOPIC, MQTT_STATUS_QOS);
+    }
+    return esp_mqtt_client_subscribe_multiple(client, subscribe_topics,
+                                              sizeof(subscribe_topics) / sizeof(subscribe_topics[0]));
+}
+
+// A SUBSCRIBE that could not be queued, or a refused status filter. Neither the esp-mqtt event
+// task nor the worker may sleep, so the retry is a one-shot timer that posts to the worker.
+static void subscribe_failed(esp_mqtt_client_handle_t client, bool status_only) {
+    taskENTER_CRITICAL(&subscribe_lock);
+    bool retry = subscribe_retries < MQTT_SUBSCRIBE_RETRIES;
+    if (retry) {
+        subscribe_retries++;
+        subscribe_status_only = status_only;
+        subscribe_client = client;
+    }
+    bool requesting = !retry && status_request_pending;
+    if (!retry) {
+        status_request_pending = false;
+    }
+    taskEXIT_CRITICAL(&subscribe_lock);
+
+    if (retry) {
+        esp_timer_stop(subscribe_timer);
+        esp_timer_start_once(subscribe_timer, MQTT_SUBSCRIBE_RETRY_MS * 1000LL);
+    } else if (status_only) {
+        ESP_LOGE(TAG, "Giving up on the status subscription until the next connect");
+    } else if (requesting) {
+        // No SUBACK will come; a resumed session may still hold the status subscription
+        ESP_LOGE(TAG, "Could not subscribe, requesting status without waiting for SUBACK");
+        publish_status_request(client);
+    }
+}
+
+static void subscribe_retry_expired(void *arg) {
+    taskENTER_CRITICAL(&subscribe_lock);
+    esp_mqtt_client_handle_t client = subscribe_client;
+    taskEXIT_CRITICAL(&subscribe_lock);
+    if (!mqtt_worker_post(client, SUBSCRIBE_WORK_TOPIC)) {
+        ESP_LOGE(TAG, "Could not queue the subscribe retry");
+    }
+}
+
+static void handle_subscribe_work(const mqtt_work_item_t *item) {
+    taskENTER_CRITICAL(&subscribe_lock);
+    bool status_only = subscribe_status_only;
+    int retry = subscribe_retries;
+    subscribe_msg_id = SUBSCRIBE_IN_FLIGHT;
+    taskEXIT_CRITICAL(&subscribe_lock);
+
+    ESP_LOGW(TAG, "Retrying %s subscription, %d/%d", status_only ? "status" : "topic", retry,
+             MQTT_SUBSCRIBE_RETRIES);
+    int msg_id = send_subscribe(item->client, status_only);
+    taskENTER_CRITICAL(&subscribe_lock);
+    if (subscribe_msg_id == SUBSCRIBE_IN_FLIGHT) {
+        subscribe_msg_id = msg_id;  // Unless its SUBACK has been handled already
+    }
+    taskEXIT_CRITICAL(&subscribe_lock);
+    if (msg_id < 0) {
+        subscribe_failed(item->client, status_only);
+    }
+}
 
 void custom_handle_mqtt_event_connected(esp_mqtt_event_handle_t event) {
     esp_mqtt_client_handle_t client = event->client;
-    ESP_LOGI(TAG, "Custom handler: MQTT_EVENT_CONNECTED");
-    int msg_id;
-
-    msg_id = esp_mqtt_client_subscribe(client, CONFIG_MQTT_SUBSCRIBE_STATUS_TOPIC, 0);
-    ESP_LOGI(TAG, "Subscribed to topic %s, msg_id=%d", CONFIG_MQTT_SUBSCRIBE_STATUS_TOPIC, msg_id);
+    DLOGI(TAG, "Custom handler: MQTT_EVENT_CONNECTED");
 
-    msg_id = esp_mqtt_client_subscribe(client, CONFIG_MQTT_SUBSCRIBE_OTA_UPDATE_SNOOPER_TOPIC, 0);
-    ESP_LOGI(TAG, "Subscribed to topic %s, msg_id=%d", CONFIG_MQTT_SUBSCRIBE_OTA_UPDATE_SNOOPER_TOPIC, msg_id);
+    taskENTER_CRITICAL(&connect_timing_lock);
+    connack_us = esp_timer_get_time();
+    first_status_pending = true;
+    taskEXIT_CRITICAL(&connect_timing_lock);
+    boot_phase_end(BOOT_PHASE_CONNACK);
+    boot_phase_begin(BOOT_PHASE_FIRST_STATUS);
 
-    msg_id = esp_mqtt_client_subscribe(client, CONFIG_MQTT_SUBSCRIBE_TELEMETRY_REQUEST_TOPIC, 0);
-    ESP_LOGI(TAG, "Subscribed to topic %s, msg_id=%d", CONFIG_MQTT_SUBSCRIBE_TELEMETRY_REQUEST_TOPIC, msg_id);
+    if (connected_before) {
+        metric_inc(reconnect_metric);
+    }
+    connected_before = true;
+    mqtt_worker_post(client, CONNECTED_WORK_TOPIC);
+    recovery_report_connected();
+    mqtt_publish_reset_aliases();
+    cloud_log_set_connected(true);
+    tls_session_log_stats();
+    wifi_cache_log_stats();
+    supervisor_log_stats();
+
+    taskENTER_CRITICAL(&subscribe_lock);
+    status_request_pending = !(MQTT_PERSISTENT_SESSION && event->session_present && status_received);
+    bool requesting = status_request_pending;
+    subscribe_retries = 0;
+    taskEXIT_CRITICAL(&subscribe_lock);
+    if (!requesting) {
+        DLOGI(TAG, "Session resumed, waiting for queued status instead of requesting it");
+    }
 
-    msg_id =
-        esp_mqtt_client_publish(client, CONFIG_MQTT_PUBLISH_STATUS_TOPIC, "{\"message\":\"status_request\"}", 0, 0, 0);
-    ESP_LOGI(TAG, "Published initial status request, msg_id=%d", msg_id);
+    // A retry left over from the last session would subscribe twice
+    esp_timer_stop(subscribe_timer);
+    int msg_id = send_subscribe(client, false);
+    taskENTER_CRITICAL(&subscribe_lock);
+    subscribe_msg_id = msg_id;
+    taskEXIT_CRITICAL(&subscribe_lock);
+    DLOGI(TAG, "Subscribed to %d topics, msg_id=%d", (int)(sizeof(subscribe_topics) / sizeof(subscribe_topics[0])),
+          msg_id);
+    if (msg_id < 0) {
+        subscribe_failed(client, false);
+    }
 }
 
-void custom_handle_mqtt_event_disconnected(esp_mqtt_event_handle_t event) {
-    ESP_LOGI(TAG, "Custom handler: MQTT_EVENT_DISCONNECTED");
-    if (ota_handler_task_handle != NULL) {
-        vTaskDelete(ota_handler_task_handle);
-        ota_handler_task_handle = NULL;
+void custom_handle_mqtt_event_subscribed(esp_mqtt_event_handle_t event) {
+    DLOGI(TAG, "Custom handler: MQTT_EVENT_SUBSCRIBED, msg_id=%d", event->msg_id);
+    taskENTER_CRITICAL(&subscribe_lock);
+    bool ours = event->msg_id == subscribe_msg_id || subscribe_msg_id == SUBSCRIBE_IN_FLIGHT;
+    if (ours) {
+        subscribe_msg_id = -1;
+    }
+    taskEXIT_CRITICAL(&subscribe_lock);
+    if (!ours) {
+        return;
+    }
+    // The event carries the SUBACK return codes, the status filter's first; 0x80 and up is a
+    // refusal under either protocol version
+    int code = event->data_len > 0 ? (uint8_t)event->data[0] : 0;
+    if (code >= 0x80) {
+        ESP_LOGE(TAG, "Broker refused the status subscription (0x%02x)", code);
+        subscribe_failed(event->client, true);
+        return;
     }
-    // Reconnect logic
-    int retry_count = 0;
-    const int max_retries = 5;
-    const int retry_delay_ms = 5000;
-    esp_err_t err;
-    esp_mqtt_client_handle_t client = event->client;
 
-    // Check if the network is connected before attempting reconnection
-    if (wifi_active()) {
-        do {
-            ESP_LOGI(TAG, "Attempting to reconnect, retry %d/%d", retry_count + 1, max_retries);
-            err = esp_mqtt_client_reconnect(client);
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to reconnect MQTT client, retrying in %d seconds...", retry_delay_ms / 1000);
-                vTaskDelay(pdMS_TO_TICKS(retry_delay_ms));  // Delay for 5 seconds
-                retry_count++;
-            }
-        } while (err != ESP_OK && retry_count < max_retries);
+    taskENTER_CRITICAL(&subscribe_lock);
+    bool requesting = status_request_pending;
+    status_request_pending = false;
+    taskEXIT_CRITICAL(&subscribe_lock);
+    if (requesting) {
+        int msg_id = publish_status_request(event->client);
+        DLOGI(TAG, "Published initial status request, msg_id=%d", msg_id);
+    }
+}
 
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to reconnect MQTT client after %d retries", retry_count);
-        }
-    } else {
-        ESP_LOGE(TAG, "Network not connected, skipping MQTT reconnection");
+// Called once a status has been accepted; reports CONNACK-to-valid-LED time for the first one
+static void record_first_status(esp_mqtt_client_handle_t client) {
+    int64_t elapsed_us = -1;
+
+    taskENTER_CRITICAL(&connect_timing_lock);
+    if (first_status_pending) {
+        first_status_pending = false;
+        elapsed_us = esp_timer_get_time() - connack_us;
+    }
+    taskEXIT_CRITICAL(&connect_timing_lock);
+
+    if (elapsed_us >= 0) {
+        ESP_LOGI(TAG, "CONNACK to first valid LED state: %lld ms", elapsed_us / 1000);
+        boot_phase_end(BOOT_PHASE_FIRST_STATUS);
+        boot_record_publish(client, CONFIG_MQTT_PUBLISH_TELEMETRY_TOPIC, device_name);
     }
 }
 
+void custom_handle_mqtt_event_disconnected(esp_mqtt_event_handle_t event) {
+    DLOGI(TAG, "Custom handler: MQTT_EVENT_DISCONNECTED");
+    cloud_log_set_connected(false);
+    // A running OTA task is left alone: it may hold the MQTT client or publish lock or heap of
+    // its own. It gives up on its own when the download fails; if it hangs instead, the
+    // supervisor's ota_task deadline reboots the device.
+
+    // recovery.c is the only thing that reconnects; this handler must not block the event task
+    recovery_report_disconnected();
+}
+
 void squawk(void) {
+    metric_inc(squawk_metric);
     set_audio_playback(true);
     set_volume(1.0f);
     set_gain(true);
     enable_amplifier(true);
 }
 
-void custom_handle_mqtt_event_data(esp_mqtt_event_handle_t event) {
-    ESP_LOGI(TAG, "Custom handler: MQTT_EVENT_DATA");
-    esp_mqtt_client_handle_t client = event->client;
-    if (strncmp(event->topic, CONFIG_MQTT_SUBSCRIBE_STATUS_TOPIC, event->topic_len) == 0) {
-        ESP_LOGW(TAG, "Received topic %s", CONFIG_MQTT_SUBSCRIBE_STATUS_TOPIC);
-        // Handle the status response
-        cJSON *json = cJSON_Parse(event->data);
-        if (json == NULL) {
-            ESP_LOGE(TAG, "Failed to parse JSON");
-        } else {
-            cJSON *state = cJSON_GetObjectItem(json, "LED");
-            if (cJSON_IsString(state)) {
-                ESP_LOGI(TAG, "Parsed state: %s", state->valuestring);
-                led_state_t led_state = convert_led_string_to_enum(state->valuestring);
-                static led_state_t current_led_state = LED_OFF;
-                // Only set the LED state if it's not LED_FLASHING_GREEN,
-                // or if the current state is not already LED_FLASHING_GREEN.
-                // Only a reboot breaks out of the LED_FLASHING_GREEN state.
-                //
-                // TODO - Add a check for LED_FLASHING_GREEN longer than a certain time
-                //
-                if (led_state != LED_FLASHING_GREEN || current_led_state != LED_FLASHING_GREEN) {
-                    if (led_state == LED_FLASHING_RED || led_state == LED_FLASHING_BLUE ||
-                        led_state == LED_FLASHING_YELLOW || led_state == LED_FLASHING_CYAN ||
-                        led_state == LED_FLASHING_MAGENTA || led_state == LED_FLASHING_ORANGE) {
-                        // Squawk if the LED is flashing
-                        squawk();
-                    }
-                    set_led(led_state);
-                    current_led_state = led_state;  // Update the current LED state
-                }
-            } else {
-                ESP_LOGE(TAG, "JSON state item is not a string");
+static bool parse_status_json(const mqtt_work_item_t *item, status_message_t *message, char *state, size_t size) {
+    cJSON *json = cJSON_Parse(item->data);
+    if (json == NULL) {
+        ESP_LOGE(TAG, "Failed to parse JSON");
+        return false;
+    }
+    cJSON *led = cJSON_GetObjectItem(json, "LED");
+    if (!cJSON_IsString(led)) {
+        ESP_LOGE(TAG, "JSON state item is not a string");
+        cJSON_Delete(json);
+        return false;
+    }
+    snprintf(state, size, "%s", led->valuestring);
+    cJSON *sequence = cJSON_GetObjectItem(json, "seq");
+    if (cJSON_IsNumber(sequence)) {
+        message->has_sequence = true;
+        message->sequence = (uint32_t)sequence->valuedouble;
+    }
+    cJSON *boot = cJSON_GetObjectItem(json, "boot");
+    if (cJSON_IsNumber(boot)) {
+        message->has_boot = true;
+        message->boot = (uint32_t)boot->valuedouble;
+    }
+    cJSON *timestamp = cJSON_GetObjectItem(json, "ts");
+    if (cJSON_IsNumber(timestamp)) {
+        message->has_timestamp = true;
+        message->timestamp = (int64_t)timestamp->valuedouble;
+    }
+    cJSON_Delete(json);
+    return true;
+}
+
+// Same fields as the JSON status, as a CBOR map
+static bool parse_status_cbor(const mqtt_work_item_t *item, status_message_t *message, char *state, size_t size) {
+    cbor_reader_t reader;
+    size_t pairs;
+    bool has_state = false;
+
+    cbor_reader_init(&reader, item->data, item->data_len);
+    if (!cbor_get_map(&reader, &pairs)) {
+        ESP_LOGE(TAG, "Failed to parse CBOR");
+        return false;
+    }
+    for (size_t i = 0; i < pairs && !reader.error; i++) {
+        const char *key;
+        size_t key_len;
+        int64_t number;
+
+        if (!cbor_get_text(&reader, &key, &key_len)) {
+            cbor_skip(&reader);
+        } else if (key_len == 3 && memcmp(key, "LED", 3) == 0) {
+            const char *text;
+            size_t text_len;
+            if (cbor_get_text(&reader, &text, &text_len)) {
+                snprintf(state, size, "%.*s", (int)text_len, text);
+                has_state = true;
+                continue;
             }
-            cJSON_Delete(json);
+        } else if (key_len == 3 && memcmp(key, "seq", 3) == 0 && cbor_get_int(&reader, &number)) {
+            message->has_sequence = true;
+            message->sequence = (uint32_t)number;
+            continue;
+        } else if (key_len == 4 && memcmp(key, "boot", 4) == 0 && cbor_get_int(&reader, &number)) {
+            message->has_boot = true;
+            message->boot = (uint32_t)number;
+            continue;
+        } else if (key_len == 2 && memcmp(key, "ts", 2) == 0 && cbor_get_int(&reader, &number)) {
+            message->has_timestamp = true;
+            message->timestamp = number;
+            continue;
         }
-    } else if (strncmp(event->topic, CONFIG_MQTT_SUBSCRIBE_OTA_UPDATE_SNOOPER_TOPIC, event->topic_len) == 0) {
-        ESP_LOGI(TAG, "Received topic %s", CONFIG_MQTT_SUBSCRIBE_OTA_UPDATE_SNOOPER_TOPIC);
-        cJSON *ota_root = cJSON_CreateObject();
-        cJSON_AddStringToObject(ota_root, device_name, "OTA update requested");
-        char const *ota_json_string = cJSON_Print(ota_root);
-        esp_mqtt_client_publish(client, CONFIG_MQTT_PUBLISH_OTA_PROGRESS_TOPIC, ota_json_string, 0, 0, 0);
-        cJSON_Delete(ota_root);
-        if (ota_handler_task_handle != NULL) {
-            eTaskState task_state = eTaskGetState(ota_handler_task_handle);
-            if (task_state != eDeleted) {
-                char log_message[256];  // Adjust the size according to your needs
-                snprintf(log_message, sizeof(log_message),
-                         "OTA task is already running or not yet cleaned up, skipping OTA update. task_state=%d",
-                         task_state);
-
-                ESP_LOGW(TAG, "%s", log_message);
-                cJSON *root = cJSON_CreateObject();
-                cJSON_AddStringToObject(root, device_name, log_message);
-                char const *json_string = cJSON_Print(root);
-                esp_mqtt_client_publish(client, CONFIG_MQTT_PUBLISH_OTA_PROGRESS_TOPIC, json_string, 0, 0, 0);
-                cJSON_Delete(root);
-                return;
-            }
-            // Clean up task handle if it has been deleted
-            ota_handler_task_handle = NULL;
+        cbor_skip(&reader);
+    }
+    if (reader.error || !has_state) {
+        ESP_LOGE(TAG, "CBOR status is malformed or has no LED state");
+        return false;
+    }
+    return true;
+}
+
+void handle_status_message(const mqtt_work_item_t *item) {
+    char state[32];
+    status_message_t message = {0};
+
+    DLOGD(TAG, "Received topic %s", CONFIG_MQTT_SUBSCRIBE_STATUS_TOPIC);
+    // Handle the status response
+    bool cbor = cbor_is_map(item->data, item->data_len);
+    if (!(cbor ? parse_status_cbor(item, &message, state, sizeof(state))
+               : parse_status_json(item, &message, state, sizeof(state)))) {
+        return;
+    }
+    payload_encoding_peer_used(cbor ? PAYLOAD_CBOR : PAYLOAD_JSON);
+
+    ESP_LOGD(TAG, "Parsed state: %s", state);
+    message.state = convert_led_string_to_enum(state);
+    time_t now = time(NULL);
+    status_filter_result_t result = status_filter_accept(&message, now >= VALID_EPOCH_SECONDS ? now : 0);
+    if (result != STATUS_FILTER_APPLY) {
+        ESP_LOGI(TAG, "Status %s not applied: %s", state, status_filter_result_name(result));
+        if (result == STATUS_FILTER_COALESCE) {
+            status_received = true;
+            led_state_stop_indicator();
+            record_first_status(item->client);
+        }
+        return;
+    }
+    status_received = true;
+    record_first_status(item->client);
+    led_state_t led_state = message.state;
+    static led_state_t current_led_state = LED_OFF;
+    // Only set the LED state if it's not LED_FLASHING_GREEN,
+    // or if the current state is not already LED_FLASHING_GREEN.
+    // Only a reboot breaks out of the LED_FLASHING_GREEN state.
+    //
+    // TODO - Add a check for LED_FLASHING_GREEN longer than a certain time
+    //
+    if (led_state != LED_FLASHING_GREEN || current_led_state != LED_FLASHING_GREEN) {
+        if (led_state == LED_FLASHING_RED || led_state == LED_FLASHING_BLUE || led_state == LED_FLASHING_YELLOW ||
+            led_state == LED_FLASHING_CYAN || led_state == LED_FLASHING_MAGENTA || led_state == LED_FLASHING_ORANGE) {
+            // Squawk if the LED is flashing
+            squawk();
+        }
+        led_state_save(led_state);
+        set_led(led_state);
+        current_led_state = led_state;  // Update the current LED state
+    }
+}
+
+static void publish_ota_progress(esp_mqtt_client_handle_t client, const char *message) {
+    if (payload_encoding(PAYLOAD_TOPIC_OTA_PROGRESS) == PAYLOAD_CBOR) {
+        uint8_t buf[320];
+        cbor_writer_t writer;
+        cbor_writer_init(&writer, buf, sizeof(buf));
+        cbor_put_map(&writer, 1);
+        cbor_put_text(&writer, device_name);
+        cbor_put_text(&writer, message);
+        if (!writer.overflow) {
+            mqtt_publish(client, CONFIG_MQTT_PUBLISH_OTA_PROGRESS_TOPIC, (const char *)buf, writer.len, 0, 0);
+        }
+        return;
+    }
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, device_name, message);
+    char *json_string = cJSON_Print(root);
+    mqtt_publish(client, CONFIG_MQTT_PUBLISH_OTA_PROGRESS_TOPIC, json_string, 0, 0, 0);
+    cJSON_Delete(root);
+    free(json_string);
+}
+
+void handle_ota_message(const mqtt_work_item_t *item) {
+    // ota_handler_task reads the triggering event after this handler returns, so it gets its own copy
+    static mqtt_work_item_t ota_item;
+    static esp_mqtt_event_t ota_event;
+    esp_mqtt_client_handle_t client = item->client;
+
+    DLOGI(TAG, "Received topic %s", CONFIG_MQTT_SUBSCRIBE_OTA_UPDATE_SNOOPER_TOPIC);
+    publish_ota_progress(client, "OTA update requested");
+    if (ota_handler_task_handle != NULL) {
+        eTaskState task_state = eTaskGetState(ota_handler_task_handle);
+        if (task_state != eDeleted) {
+            char log_message[256];  // Adjust the size according to your needs
+            snprintf(log_message, sizeof(log_message),
+                     "OTA task is already running or not yet cleaned up, skipping OTA update. task_state=%d",
+                     task_state);
+
+            ESP_LOGW(TAG, "%s", log_message);
+            publish_ota_progress(client, log_message);
+            return;
         }
-        set_led(LED_FLASHING_GREEN);
-        xTaskCreate(&ota_handler_task, "ota_task", 8192, event, 5, &ota_handler_task_handle);
-    } else if (strncmp(event->topic, CONFIG_MQTT_SUBSCRIBE_TELEMETRY_REQUEST_TOPIC, event->topic_len) == 0) {
-        ESP_LOGI(TAG, "Received topic %s", CONFIG_MQTT_SUBSCRIBE_TELEMETRY_REQUEST_TOPIC);
-        transmit_telemetry();
+        // Clean up task handle if it has been deleted
+        ota_handler_task_handle = NULL;
+    }
+    led_state_stop_indicator();
+    set_led(LED_FLASHING_GREEN);
+    ota_item = *item;
+    ota_event = (esp_mqtt_event_t){.event_id = MQTT_EVENT_DATA,
+                                   .client = client,
+                                   .topic = ota_item.topic,
+                                   .topic_len = strlen(ota_item.topic),
+                                   .data = ota_item.data,
+                                   .data_len = ota_item.data_len,
+                                   .total_data_len = ota_item.data_len};
+    // The reboot into the new image is a software reset; the journal says why
+    rtc_journal_event("OTA update started");
+    // Stays on the heap even with STATIC_ALLOCATION: the task deletes itself when an update fails,
+    // and a static TCB could not be reused until the idle task has finished with it
+    xTaskCreate(&ota_handler_task, "ota_task", 8192, &ota_event, 5, &ota_handler_task_handle);
+}
+
+// Connect-time publishes, on the worker: they build cJSON and take the publish and metrics
+// locks, which the esp-mqtt event task must not wait on
+static void handle_connected_work(const mqtt_work_item_t *item) {
+    static bool first_connect = true;
+
+    rtc_journal_drain(item->client, CONFIG_MQTT_PUBLISH_LOG_TOPIC);
+    if (first_connect) {
+        send_telemetry_keyframe(item->client, CONFIG_MQTT_PUBLISH_TELEMETRY_TOPIC);
     } else {
-        ESP_LOGW(TAG, "Received topic %.*s", event->topic_len, event->topic);
+        // The first session ended before a status arrived; publish what there is
+        boot_record_publish(item->client, CONFIG_MQTT_PUBLISH_TELEMETRY_TOPIC, device_name);
     }
+    first_connect = false;
+}
+
+void handle_telemetry_request_message(const mqtt_work_item_t *item) {
+    DLOGI(TAG, "Received topic %s", CONFIG_MQTT_SUBSCRIBE_TELEMETRY_REQUEST_TOPIC);
+    send_telemetry_keyframe(item->client, CONFIG_MQTT_PUBLISH_TELEMETRY_TOPIC);
+    boot_record_publish(item->client, CONFIG_MQTT_PUBLISH_TELEMETRY_TOPIC, device_name);
+}
+
+void custom_handle_mqtt_event_data(esp_mqtt_event_handle_t event) {
+    DLOGD(TAG, "Custom handler: MQTT_EVENT_DATA");
+    // Handlers run on the MQTT worker task, never on the esp-mqtt event task
+    mqtt_worker_submit(event);
 }
 
 void custom_handle_mqtt_event_error(esp_mqtt_event_handle_t event) {
@@ -177,36 +573,39 @@ void custom_handle_mqtt_event_error(esp_mqtt_event_handle_t event) {
     } else {
         ESP_LOGI(TAG, "Unknown error type: 0x%x", event->error_handle->error_type);
     }
-    esp_restart();
+    // Escalate through transport/MQTT/Wi-Fi recovery before falling back to a reboot
+    recovery_report_error(event->error_handle);
+}
+
+// Supervisor restart callback. The task is blocked or stuck, never running, when this is called,
+// so on this single core its static TCB and stack can be reused straight away. It is only
+// deleted inside the decoder or I2S writes, where it holds no lock anyone else takes.
+static bool restart_audio_player(void) {
+    if (!audio_player_restartable()) {
+        return false;
+    }
+    vTaskDelete(audio_task_handle);
+    audio_player_release();
+    audio_task_handle = STATIC_TASK_CREATE(audio_player, audio_player_task, "audio_player_task", audio_supervised, 5);
+    return audio_task_handle != NULL;
 }
 
 QueueHandle_t start_led_task(esp_mqtt_client_handle_t my_client) {
     ESP_LOGI("MISC_UTIL", "Initializing LED PWM");
     init_led_pwm();
 
-    led_state_queue = xQueueCreate(10, sizeof(led_state_t));
+    led_state_queue = STATIC_QUEUE_CREATE(led_state, 10, sizeof(led_state_t));
     if (led_state_queue == NULL) {
         ESP_LOGE("MISC_UTIL", "Could not initialize LED PWM");
         esp_restart();
     }
 
     ESP_LOGI("MISC_UTIL", "Creating LED task");
-    xTaskCreate(&led_task, "led_task", 4096, (void *)my_client, 5, NULL);
+    supervisor_watch_queue(supervisor_register("led_task", LED_TASK_DEADLINE_MS, NULL), led_state_queue);
+    STATIC_TASK_CREATE(led, &led_task, "led_task", (void *)my_client, 5);
     return led_state_queue;
 }
 
-QueueHandle_t start_logging(void) {
-    log_queue = xQueueCreate(LOG_QUEUE_LENGTH, sizeof(log_message_t));
-
-    if (log_queue == NULL) {
-        ESP_LOGE("MISC_UTIL", "Failed to create logger queue");
-        esp_restart();
-    }
-
-    xTaskCreate(&logger_task, "logger_task", 4096, NULL, 5, NULL);
-    return log_queue;
-}
-
 void setup_nvs_flash(void) {
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -216,17 +615,71 @@ void setup_nvs_flash(void) {
     ESP_ERROR_CHECK(ret);
 }
 
-esp_mqtt_client_handle_t start_mqtt(const mqtt_config_t *config) {
-    // Define the configuration
+static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data) {
+    esp_mqtt_event_handle_t event = event_data;
+    switch ((esp_mqtt_event_id_t)event_id) {
+        case MQTT_EVENT_CONNECTED:
+            custom_handle_mqtt_event_connected(event);
+            break;
+        case MQTT_EVENT_DISCONNECTED:
+            custom_handle_mqtt_event_disconnected(event);
+            break;
+        case MQTT_EVENT_SUBSCRIBED:
+            custom_handle_mqtt_event_subscribed(event);
+            break;
+        case MQTT_EVENT_DATA:
+            custom_handle_mqtt_event_data(event);
+            break;
+        case MQTT_EVENT_ERROR:
+            custom_handle_mqtt_event_error(event);
+            break;
+        default:
+            break;
+    }
+}
+
+// Builds the client without connecting; boot_start_mqtt() starts it once the network is up
+esp_mqtt_client_handle_t create_mqtt_client(const mqtt_config_t *config) {
+    // The client is built here rather than by mqtt_app_start() so that it can use the
+    // session-resuming TLS transport; the configuration mirrors the MQTT manager's.
+    tls_session_config_t tls_config = {.ca_cert = (const char *)AmazonRootCA1_pem,
+                                       .client_cert = (const char *)config->certificate,
+                                       .client_key = (const char *)config->private_key};
+    esp_transport_handle_t transport = tls_session_transport_init(&tls_config);
+    if (transport == NULL) {
+        ESP_LOGE(TAG, "Could not create MQTT transport");
+        esp_restart();
+    }
+
+    esp_mqtt_client_config_t mqtt_cfg = {
+        .broker.address.uri = config->broker_uri,
+        .network.transport = transport,
+#if MQTT_PERSISTENT_SESSION
+        // A persistent session is keyed on the client ID, so it must not change between boots
+        .credentials.client_id = device_name,
+        .session.disable_clean_session = true,
+#endif
+#if MQTT_PROTOCOL_V5
+        .session.protocol_ver = MQTT_PROTOCOL_V_5,
+#endif
+    };
+
+    esp_mqtt_client_handle_t client = esp_mqtt_client_init(&mqtt_cfg);
+    if (client == NULL) {
+        ESP_LOGE(TAG, "Could not initialize MQTT client");
+        esp_restart();
+    }
 
-    // Set the custom event handlers
-    mqtt_set_event_connected_handler(custom_handle_mqtt_event_connected);
-    mqtt_set_event_disconnected_handler(custom_handle_mqtt_event_disconnected);
-    mqtt_set_event_data_handler(custom_handle_mqtt_event_data);
-    mqtt_set_event_error_handler(custom_handle_mqtt_event_error);
+#if MQTT_PROTOCOL_V5
+    // In MQTT 5 a session ends at disconnect unless it is given an expiry interval
+    esp_mqtt5_connection_property_config_t connect_property = {
+        .session_expiry_interval = MQTT_PERSISTENT_SESSION ? MQTT5_SESSION_EXPIRY_S : 0,
+    };
+    esp_mqtt5_client_set_connect_property(client, &connect_property);
+#endif
 
-    // Start the MQTT client
-    esp_mqtt_client_handle_t client = mqtt_app_start(config);
+    // Route client events to the custom handlers
+    esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
 
     return client;
 }
@@ -251,49 +704,101 @@ void app_main(void) {
     printf("Configuration: UNKNOWN\n");
 #endif
 
+    // Before anything that can log an error, so it survives a restart
+    init_rtc_journal();
+
+    boot_phase_begin(BOOT_PHASE_VERSION_INFO);
     print_version_info();
+    boot_phase_end(BOOT_PHASE_VERSION_INFO);
 
+    boot_phase_begin(BOOT_PHASE_MAC_ADDRESS);
     show_mac_address();
+    boot_phase_end(BOOT_PHASE_MAC_ADDRESS);
 
+    boot_phase_begin(BOOT_PHASE_NVS);
     setup_nvs_flash();
+    boot_phase_end(BOOT_PHASE_NVS);
+    init_log_levels();
 
     show_system_info();
 
-    wifi_init_sta();
+    // Wi-Fi and SNTP come up in the background while the local subsystems start
+    boot_start_network();
+
+    reconnect_metric = metrics_counter("mqtt.reconnects");
+    squawk_metric = metrics_counter("squawks");
+    init_diagnostics();
 
-    synchronize_time();
+    mqtt_publish_init();
+    mqtt_publish_register_topic(CONFIG_MQTT_PUBLISH_TELEMETRY_TOPIC, 0);
+#if CLOUD_LOG_BATCHING
+    mqtt_publish_register_topic(CONFIG_MQTT_PUBLISH_LOG_TOPIC, 0);
+#endif
+    mqtt_publish_register_topic(CONFIG_MQTT_PUBLISH_OTA_PROGRESS_TOPIC, 0);
+    mqtt_publish_register_topic(CONFIG_MQTT_PUBLISH_STATUS_TOPIC, MQTT5_STATUS_REQUEST_EXPIRY_S);
+    mqtt_publish_register_topic(DIAGNOSTICS_TOPIC, 0);
+
+    mqtt_worker_register(CONFIG_MQTT_SUBSCRIBE_STATUS_TOPIC, MQTT_WORK_DROP_OLDEST, handle_status_message);
+    mqtt_worker_register(CONFIG_MQTT_SUBSCRIBE_OTA_UPDATE_SNOOPER_TOPIC, MQTT_WORK_REJECT, handle_ota_message);
+    mqtt_worker_register(CONFIG_MQTT_SUBSCRIBE_TELEMETRY_REQUEST_TOPIC, MQTT_WORK_REJECT,
+                         handle_telemetry_request_message);
+    mqtt_worker_register(LOG_LEVEL_TOPIC, MQTT_WORK_REJECT, handle_log_level_message);
+    mqtt_worker_register(DIAGNOSTICS_REQUEST_TOPIC, MQTT_WORK_REJECT, handle_diagnostics_request_message);
+    mqtt_worker_register(CONNECTED_WORK_TOPIC, MQTT_WORK_DROP_OLDEST, handle_connected_work);
+    mqtt_worker_register(SUBSCRIBE_WORK_TOPIC, MQTT_WORK_DROP_OLDEST, handle_subscribe_work);
+    const esp_timer_create_args_t subscribe_args = {.callback = &subscribe_retry_expired, .name = "mqtt_resub"};
+    ESP_ERROR_CHECK(esp_timer_create(&subscribe_args, &subscribe_timer));
+    start_mqtt_worker();
 
     mqtt_config_t config = {.certificate = cert, .private_key = key, .broker_uri = CONFIG_AWS_IOT_ENDPOINT};
 
-    esp_mqtt_client_handle_t client = start_mqtt(&config);
+    esp_mqtt_client_handle_t client = create_mqtt_client(&config);
+
+    start_recovery_task(client);
 
     led_state_queue = start_led_task(client);
 
-    set_led(LED_FLASHING_WHITE);
+    // The last known door state, if there is one, beats "connecting"
+    if (!led_state_restore()) {
+        set_led(LED_FLASHING_WHITE);
+    }
 
     // Initialize audio semaphore
-    audioSemaphore = xSemaphoreCreateBinary();
+    audioSemaphore = STATIC_BINARY_SEMAPHORE_CREATE(audio);
     if (audioSemaphore == NULL) {
         ESP_LOGE(TAG, "Failed to create audio semaphore");
         return;
     }
 
-    timer_semaphore = xSemaphoreCreateBinary();
+    timer_semaphore = STATIC_BINARY_SEMAPHORE_CREATE(timer);
     if (timer_semaphore == NULL) {
         ESP_LOGE(TAG, "Failed to create timer semaphore");
         return;
     }
 
-    xTaskCreate(audio_player_task, "audio_player_task", 8192, NULL, 5, NULL);
+    audio_supervised = supervisor_register("audio_player_task", AUDIO_TASK_DEADLINE_MS, restart_audio_player);
+    audio_task_handle = STATIC_TASK_CREATE(audio_player, audio_player_task, "audio_player_task", audio_supervised, 5);
+    supervisor_register("ota_task", OTA_TASK_DEADLINE_MS, NULL);
 
-    init_telemetry_manager(LOCATION, client, CONFIG_MQTT_PUBLISH_TELEMETRY_TOPIC);
+#if APP_EVENT_LOOP
+    // Telemetry scheduling and cloud log draining share this loop instead of a task each
+    app_loop_start();
+#endif
 
-    transmit_telemetry();
+    // The boot keyframe goes out on the first MQTT_EVENT_CONNECTED
+    init_telemetry_manager(LOCATION, client, CONFIG_MQTT_PUBLISH_TELEMETRY_TOPIC);
+#if TELEMETRY_SCHEDULED
+    start_telemetry_scheduler(client, CONFIG_MQTT_PUBLISH_TELEMETRY_TOPIC);
+#endif
 
+#if CLOUD_LOG_BATCHING
+    init_cloud_log_batcher(client, CONFIG_MQTT_PUBLISH_LOG_TOPIC, device_name);
+#else
     init_cloud_logger(client, CONFIG_MQTT_PUBLISH_LOG_TOPIC);
+#endif
 
-    // Infinite loop to prevent exiting app_main
-    while (true) {
-        vTaskDelay(pdMS_TO_TICKS(1000));  // Delay to allow other tasks to run
-    }
+    boot_start_mqtt(client);
+
+    // app_main never returns; it stays on as the supervisor
+    supervisor_run();
 }
@@ -0,0 +1,215 @@
+#include "metrics.h"
+
+#include <stdlib.h>
+
+#include "cJSON.h"
+#include "cbor.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "mqtt_publish.h"
+#include "static_alloc.h"
+
+static const char *TAG = "METRICS";
+
+static metric_t metrics[METRICS_MAX];
+static metric_histogram_t histograms[METRICS_MAX_HISTOGRAMS];
+static atomic_int metric_count;
+static int histogram_count = 0;
+static portMUX_TYPE registry_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Serializes frames, which share last_sent and the sequence number
+static SemaphoreHandle_t frame_mutex = NULL;
+STATIC_SEMAPHORE_STORAGE(metrics_frame);
+static uint32_t frame_seq = 0;
+static bool keyframe_needed = true;
+static uint8_t cbor_frame[METRICS_CBOR_FRAME_MAX];
+
+// Handed out when the registry is full so callers never need to check for NULL
+static metric_histogram_t scratch_histogram;
+static metric_t scratch = {.name = "scratch", .histogram = &scratch_histogram};
+
+static metric_t *register_metric(const char *name, metric_type_t type) {
+    metric_t *metric = &scratch;
+
+    taskENTER_CRITICAL(&registry_lock);
+    int count = atomic_load_explicit(&metric_count, memory_order_relaxed);
+    if (count < METRICS_MAX && (type != METRIC_HISTOGRAM || histogram_count < METRICS_MAX_HISTOGRAMS)) {
+        metric = &metrics[count];
+        metric->name = name;
+        metric->type = type;
+        if (type == METRIC_HISTOGRAM) {
+            metric->histogram = &histograms[histogram_count++];
+        }
+        // Publish the entry only once it is filled in; exporters read up to metric_count
+        atomic_store_explicit(&metric_count, count + 1, memory_order_release);
+    }
+    taskEXIT_CRITICAL(&registry_lock);
+
+    if (metric == &scratch) {
+        ESP_LOGE(TAG, "Metrics registry full, %s is not exported", name);
+    }
+    return metric;
+}
+
+metric_t *metrics_counter(const char *name) { return register_metric(name, METRIC_COUNTER); }
+
+metric_t *metrics_gauge(const char *name) { return register_metric(name, METRIC_GAUGE); }
+
+metric_t *metrics_histogram(const char *name) { return register_metric(name, METRIC_HISTOGRAM); }
+
+void metric_set_threshold(metric_t *metric, int threshold) { metric->threshold = threshold; }
+
+static void lock_frames(void) {
+    taskENTER_CRITICAL(&registry_lock);
+    if (frame_mutex == NULL) {
+        frame_mutex = STATIC_MUTEX_CREATE(metrics_frame);
+    }
+    taskEXIT_CRITICAL(&registry_lock);
+    xSemaphoreTake(frame_mutex, portMAX_DELAY);
+}
+
+static cJSON *histogram_to_json(const metric_t *metric) {
+    const metric_histogram_t *histogram = metric->histogram;
+    int used = METRIC_HISTOGRAM_BUCKETS;
+
+    while (used > 0 && atomic_load_explicit(&histogram->buckets[used - 1], memory_order_relaxed) == 0) {
+        used--;
+    }
+    cJSON *array = cJSON_CreateArray();
+    cJSON_AddItemToArray(array, cJSON_CreateNumber(atomic_load_explicit(&metric->value, memory_order_relaxed)));
+    cJSON_AddItemToArray(array, cJSON_CreateNumber(atomic_load_explicit(&histogram->sum, memory_order_relaxed)));
+    for (int i = 0; i < used; i++) {
+        cJSON_AddItemToArray(array,
+                             cJSON_CreateNumber(atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed)));
+    }
+    return array;
+}
+
+static void histogram_to_cbor(cbor_writer_t *writer, const metric_t *metric) {
+    const metric_histogram_t *histogram = metric->histogram;
+    int used = METRIC_HISTOGRAM_BUCKETS;
+
+    while (used > 0 && atomic_load_explicit(&histogram->buckets[used - 1], memory_order_relaxed) == 0) {
+        used--;
+    }
+    cbor_put_array(writer, 2 + used);
+    cbor_put_int(writer, atomic_load_explicit(&metric->value, memory_order_relaxed));
+    cbor_put_uint(writer, atomic_load_explicit(&histogram->sum, memory_order_relaxed));
+    for (int i = 0; i < used; i++) {
+        cbor_put_uint(writer, atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed));
+    }
+}
+
+// Same layout as the JSON frame; returns the payload length, 0 if it did not fit
+static size_t encode_cbor(bool keyframe, int count, const int *current, const bool *include, int included) {
+    cbor_writer_t writer;
+
+    cbor_writer_init(&writer, cbor_frame, sizeof(cbor_frame));
+    cbor_put_map(&writer, keyframe ? 3 : 2);
+    cbor_put_text(&writer, "seq");
+    cbor_put_uint(&writer, frame_seq);
+    if (keyframe) {
+        cbor_put_text(&writer, "kf");
+        cbor_put_uint(&writer, 1);
+    }
+    cbor_put_text(&writer, "metrics");
+    cbor_put_map(&writer, included);
+    for (int i = 0; i < count; i++) {
+        if (!include[i]) {
+            continue;
+        }
+        cbor_put_text(&writer, metrics[i].name);
+        if (metrics[i].type == METRIC_HISTOGRAM) {
+            histogram_to_cbor(&writer, &metrics[i]);
+        } else {
+            cbor_put_int(&writer, current[i]);
+        }
+    }
+    return writer.overflow ? 0 : writer.len;
+}
+
+static char *encode_json(bool keyframe, int count, const int *current, const bool *include) {
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "seq", frame_seq);
+    if (keyframe) {
+        cJSON_AddNumberToObject(root, "kf", 1);
+    }
+    cJSON *values = cJSON_AddObjectToObject(root, "metrics");
+    for (int i = 0; i < count; i++) {
+        if (!include[i]) {
+            continue;
+        }
+        if (metrics[i].type == METRIC_HISTOGRAM) {
+            cJSON_AddItemToObject(values, metrics[i].name, histogram_to_json(&metrics[i]));
+        } else {
+            cJSON_AddNumberToObject(values, metrics[i].name, current[i]);
+        }
+    }
+    char *json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return json;
+}
+
+// Returns false if nothing was sent
+static bool publish_frame(esp_mqtt_client_handle_t client, const char *topic, payload_encoding_t encoding,
+                          bool keyframe) {
+    int count = atomic_load_explicit(&metric_count, memory_order_acquire);
+    int current[METRICS_MAX];
+    bool include[METRICS_MAX];
+    int included = 0;
+
+    lock_frames();
+    keyframe |= keyframe_needed;
+
+    for (int i = 0; i < count; i++) {
+        current[i] = atomic_load_explicit(&metrics[i].value, memory_order_relaxed);
+        include[i] = keyframe || abs(current[i] - metrics[i].last_sent) > metrics[i].threshold;
+        included += include[i];
+    }
+    if (!keyframe && included == 0) {
+        xSemaphoreGive(frame_mutex);
+        return false;
+    }
+
+    bool sent = false;
+    if (encoding == PAYLOAD_CBOR) {
+        size_t len = encode_cbor(keyframe, count, current, include, included);
+        if (len == 0) {
+            ESP_LOGE(TAG, "Metrics frame does not fit in %d bytes", (int)sizeof(cbor_frame));
+        } else {
+            sent = mqtt_publish(client, topic, (const char *)cbor_frame, len, 0, 0) >= 0;
+        }
+    } else {
+        char *json = encode_json(keyframe, count, current, include);
+        if (json == NULL) {
+            ESP_LOGE(TAG, "Could not encode metrics");
+        } else {
+            sent = mqtt_publish(client, topic, json, 0, 0, 0) >= 0;
+            free(json);
+        }
+    }
+
+    if (sent) {
+        for (int i = 0; i < count; i++) {
+            if (include[i]) {
+                metrics[i].last_sent = current[i];
+            }
+        }
+        frame_seq++;
+        keyframe_needed = false;
+    } else {
+        // The receiver may have missed this frame; resynchronize with a keyframe
+        keyframe_needed = true;
+    }
+    xSemaphoreGive(frame_mutex);
+    return sent;
+}
+
+void metrics_publish(esp_mqtt_client_handle_t client, const char *topic, payload_encoding_t encoding) {
+    publish_frame(client, topic, encoding, true);
+}
+
+bool metrics_publish_delta(esp_mqtt_client_handle_t client, const char *topic, payload_encoding_t encoding) {
+    return publish_frame(client, topic, encoding, false);
+}
@@ -0,0 +1,95 @@
+#ifndef SNOOPER_METRICS_H
+#define SNOOPER_METRICS_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mqtt_client.h"
+#include "payload_encoding.h"
+
+// Metrics registry. Modules register their metrics once at init and keep the returned handle;
+// updates are single relaxed atomic operations, constant time and lock free, so they are safe
+// on any task. Registration is not meant for hot paths.
+//
+// Histograms use power-of-two buckets: bucket 0 counts zeros, bucket i counts values in
+// [2^(i-1), 2^i), and the last bucket also takes everything larger.
+//
+// Export: {"seq":<n>,"kf":1,"metrics":{"<name>":<value>,...,"<histogram>":[count,sum,b0,b1,...]}}
+// with trailing empty buckets left out; CBOR frames carry the same map. A keyframe ("kf")
+// carries every metric; a delta frame carries only the metrics that moved by more than their
+// threshold since they were last sent, at their current value. Receivers apply deltas on top
+// of the last keyframe and wait for the next keyframe after a gap in seq.
+
+#ifndef METRICS_MAX
+#define METRICS_MAX 32
+#endif
+
+#ifndef METRICS_MAX_HISTOGRAMS
+#define METRICS_MAX_HISTOGRAMS 4
+#endif
+
+#define METRIC_HISTOGRAM_BUCKETS 20
+
+#ifndef METRICS_CBOR_FRAME_MAX
+#define METRICS_CBOR_FRAME_MAX 1024
+#endif
+
+typedef enum {
+    METRIC_COUNTER = 0,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM,
+} metric_type_t;
+
+typedef struct {
+    atomic_uint sum;  // Wraps; consumers difference successive exports
+    atomic_uint buckets[METRIC_HISTOGRAM_BUCKETS];
+} metric_histogram_t;
+
+typedef struct {
+    const char *name;  // Not copied; use string literals
+    metric_type_t type;
+    atomic_int value;  // Counter or gauge value; histogram sample count
+    metric_histogram_t *histogram;
+    int threshold;  // Delta frames skip changes up to this size (histograms: in samples)
+    int last_sent;
+} metric_t;
+
+// Never return NULL: when the registry is full the handle is a shared scratch metric that is
+// not exported
+metric_t *metrics_counter(const char *name);
+metric_t *metrics_gauge(const char *name);
+metric_t *metrics_histogram(const char *name);
+
+static inline void metric_add(metric_t *metric, int delta) {
+    atomic_fetch_add_explicit(&metric->value, delta, memory_order_relaxed);
+}
+
+static inline void metric_inc(metric_t *metric) { metric_add(metric, 1); }
+
+static inline void metric_set(metric_t *metric, int value) {
+    atomic_store_explicit(&metric->value, value, memory_order_relaxed);
+}
+
+static inline void metric_observe(metric_t *metric, uint32_t value) {
+    metric_histogram_t *histogram = metric->histogram;
+    int bucket = value == 0 ? 0 : 32 - __builtin_clz(value);
+    if (bucket >= METRIC_HISTOGRAM_BUCKETS) {
+        bucket = METRIC_HISTOGRAM_BUCKETS - 1;
+    }
+    atomic_fetch_add_explicit(&histogram->buckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum, value, memory_order_relaxed);
+    atomic_fetch_add_explicit(&metric->value, 1, memory_order_relaxed);
+}
+
+// Changes of at most threshold are left out of delta frames; set at init
+void metric_set_threshold(metric_t *metric, int threshold);
+
+// Publishes a keyframe with all metrics
+void metrics_publish(esp_mqtt_client_handle_t client, const char *topic, payload_encoding_t encoding);
+
+// Publishes the metrics that changed past their thresholds; returns false if there were none
+// or the publish failed (the next frame is then a keyframe)
+bool metrics_publish_delta(esp_mqtt_client_handle_t client, const char *topic, payload_encoding_t encoding);
+
+#endif  // SNOOPER_METRICS_H
@@ -1,15 +1,21 @@
+// Must come before anything that includes esp_log.h
+#include "hot_path_log.h"
+
 #include "mp3.h"
 
+#include "deferred_log.h"
 #include "driver/gpio.h"
 #include "driver/i2s.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "metrics.h"
 #include "mp3dec.h"
 #include "sdkconfig.h"
 #include "squawk_mp3.h"  // Include the generated header file
 #include "string.h"
+#include "supervisor.h"
 
 static const char *TAG = "MP3_PLAYER";
 
@@ -24,6 +30,11 @@ static const char *TAG = "MP3_PLAYER";
 bool play_audio = false;
 float volume = 1.0f;          // Volume control (0.0 to 1.0)
 i2s_chan_handle_t tx_handle;  // Moved tx_handle to global scope
+static HMP3Decoder hMP3Decoder = NULL;  // File scope so a restart can free it
+static bool i2s_installed = false;
+// Set only around decoding and I2S writes, which take no lock other tasks share
+static volatile bool restartable = false;
+static metric_t *decode_errors = NULL;
 
 void configure_i2s() {
     i2s_config_t i2s_config = {.mode = I2S_MODE_MASTER | I2S_MODE_TX,
@@ -46,6 +57,7 @@ void configure_i2s() {
     // Configure and install I2S driver
     ESP_ERROR_CHECK(i2s_driver_install(I2S_NUM, &i2s_config, 0, NULL));
     ESP_ERROR_CHECK(i2s_set_pin(I2S_NUM, &pin_config));
+    i2s_installed = true;
 
     // Configure SD pin for controlling the amplifier
     gpio_reset_pin(I2S_SD_PIN);
@@ -60,21 +72,24 @@ void configure_i2s() {
 
 void set_gain(bool high_gain) {
     gpio_set_level(GAIN_PIN, high_gain ? 1 : 0);
-    ESP_LOGI(TAG, "Gain set to %s", high_gain ? "9dB" : "3dB");
+    DLOGI(TAG, "Gain set to %s", high_gain ? "9dB" : "3dB");
 }
 
 void enable_amplifier(bool enable) {
     gpio_set_level(I2S_SD_PIN, enable ? 1 : 0);
-    ESP_LOGI(TAG, "Amplifier %s", enable ? "enabled" : "disabled");
+    DLOGI(TAG, "Amplifier %s", enable ? "enabled" : "disabled");
 }
 
 void audio_player_task(void *param) {
+    supervised_t *supervised = param;
     ESP_LOGI(TAG, "Initializing audio player...");
+    if (decode_errors == NULL) {
+        decode_errors = metrics_counter("mp3.decode_errors");  // Once, not on every restart
+    }
 
     // Configure I2S
     configure_i2s();
 
-    HMP3Decoder hMP3Decoder;
     MP3FrameInfo mp3FrameInfo;
     hMP3Decoder = MP3InitDecoder();
     if (hMP3Decoder == NULL) {
@@ -93,27 +108,32 @@ void audio_player_task(void *param) {
     int offset;
 
     while (true) {
-        ESP_LOGI(TAG, "Waiting for semaphore");
-        if (xSemaphoreTake(audioSemaphore, portMAX_DELAY) == pdTRUE) {
-            ESP_LOGI(TAG, "Semaphore taken. Checking audio playback status");
+        supervisor_heartbeat(supervised);
+        if (xSemaphoreTake(audioSemaphore, pdMS_TO_TICKS(SUPERVISOR_HEARTBEAT_MS)) == pdTRUE) {
+            DLOGD(TAG, "Semaphore taken. Checking audio playback status");
             if (play_audio) {
                 for (int play_count = 0; play_count < 3; play_count++) {
-                    ESP_LOGI(TAG, "Starting MP3 playback #%d. MP3 size: %d", play_count + 1, mp3_size);
+                    DLOGI(TAG, "Starting MP3 playback #%d. MP3 size: %d", play_count + 1, mp3_size);
                     readPtr = mp3_data;
                     bytesLeft = mp3_size;
 
                     while (bytesLeft > 0) {
+                        supervisor_heartbeat(supervised);
                         offset = MP3FindSyncWord(readPtr, bytesLeft);
                         if (offset < 0) {
                             ESP_LOGE(TAG, "MP3 sync word not found");
+                            metric_inc(decode_errors);
                             break;
                         }
                         readPtr += offset;
                         bytesLeft -= offset;
 
+                        restartable = true;
                         int err = MP3Decode(hMP3Decoder, &readPtr, &bytesLeft, (short *)outputBuffer, 0);
+                        restartable = false;
                         if (err != ERR_MP3_NONE) {
                             ESP_LOGE(TAG, "MP3 decode error: %d", err);
+                            metric_inc(decode_errors);
                             break;
                         }
 
@@ -121,28 +141,42 @@ void audio_player_task(void *param) {
 
                         // Write PCM data to I2S with volume control
                         size_t bytes_written = 0;
+                        restartable = true;
                         for (int i = 0; i < mp3FrameInfo.outputSamps; i++) {
                             int16_t sample = ((short *)outputBuffer)[i];
                             sample = (int16_t)(sample * volume);  // Apply volume control
                             i2s_write(I2S_NUM, &sample, sizeof(sample), &bytes_written, portMAX_DELAY);
                         }
+                        restartable = false;
                     }
                 }
             }
-        } else {
-            ESP_LOGE(TAG, "Failed to take semaphore");
         }
     }
 
-    MP3FreeDecoder(hMP3Decoder);
+    audio_player_release();
     vTaskDelete(NULL);
 }
 
+bool audio_player_restartable(void) { return restartable; }
+
+void audio_player_release(void) {
+    restartable = false;
+    if (hMP3Decoder != NULL) {
+        MP3FreeDecoder(hMP3Decoder);
+        hMP3Decoder = NULL;
+    }
+    if (i2s_installed) {
+        i2s_driver_uninstall(I2S_NUM);
+        i2s_installed = false;
+    }
+}
+
 void set_audio_playback(bool status) {
     play_audio = status;
     if (play_audio) {
         if (audioSemaphore != NULL) {
-            ESP_LOGI(TAG, "Giving semaphore");
+            DLOGD(TAG, "Giving semaphore");
             xSemaphoreGive(audioSemaphore);
         } else {
             ESP_LOGE(TAG, "audioSemaphore is NULL");
@@ -63,9 +63,16 @@ esp_err_t bsp_i2s_reconfig_clk(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode_t
 // Function to write audio data to I2S
 esp_err_t bsp_i2s_write(void *audio_buffer, size_t len, size_t *bytes_written, uint32_t timeout_ms);
 
-// FreeRTOS task for MP3 playback
+// FreeRTOS task for MP3 playback; param is its supervised_t entry, or NULL
 void audio_player_task(void *param);
 
+// True while a stuck audio_player_task may be deleted: it is decoding or writing to I2S, not
+// logging or holding any other shared lock
+bool audio_player_restartable(void);
+
+// Frees the decoder and the I2S driver of a deleted audio_player_task so it can be started again
+void audio_player_release(void);
+
 // Function to set the audio playback status
 void set_audio_playback(bool status);
 
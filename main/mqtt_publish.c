@@ -0,0 +1,158 @@
+#include "mqtt_publish.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "static_alloc.h"
+
+static const char *TAG = "MQTT_PUBLISH";
+
+typedef struct {
+    const char *topic;
+    size_t topic_len;
+    uint32_t expiry_s;
+    uint16_t alias;   // 0 once the client has rejected it, or when none was left
+    bool alias_sent;  // Broker has seen topic + alias on this connection
+} mqtt_publish_topic_t;
+
+static mqtt_publish_topic_t topics[MQTT_PUBLISH_MAX_TOPICS];
+static int topic_count = 0;
+static SemaphoreHandle_t publish_mutex = NULL;
+STATIC_SEMAPHORE_STORAGE(publish_mutex);
+static mqtt_publish_stats_t stats;
+
+void mqtt_publish_init(void) {
+    publish_mutex = STATIC_MUTEX_CREATE(publish_mutex);
+    if (publish_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to create publish mutex");
+        esp_restart();
+    }
+}
+
+void mqtt_publish_register_topic(const char *topic, uint32_t expiry_s) {
+    if (topic_count >= MQTT_PUBLISH_MAX_TOPICS) {
+        ESP_LOGW(TAG, "Too many registered topics, cannot register %s", topic);
+        return;
+    }
+    // Aliases go to the topics registered first
+    uint16_t alias = topic_count < MQTT5_TOPIC_ALIAS_MAX ? topic_count + 1 : 0;
+    topics[topic_count++] =
+        (mqtt_publish_topic_t){.topic = topic, .topic_len = strlen(topic), .expiry_s = expiry_s, .alias = alias};
+}
+
+void mqtt_publish_reset_aliases(void) {
+    xSemaphoreTake(publish_mutex, portMAX_DELAY);
+    for (int i = 0; i < topic_count; i++) {
+        topics[i].alias_sent = false;
+    }
+    xSemaphoreGive(publish_mutex);
+}
+
+void mqtt_publish_lock(void) {
+#if MQTT_PROTOCOL_V5
+    xSemaphoreTake(publish_mutex, portMAX_DELAY);
+#endif
+}
+
+void mqtt_publish_unlock(void) {
+#if MQTT_PROTOCOL_V5
+    xSemaphoreGive(publish_mutex);
+#endif
+}
+
+static int find_topic(const char *topic) {
+    for (int i = 0; i < topic_count; i++) {
+        if (strcmp(topics[i].topic, topic) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+#if MQTT_PROTOCOL_V5
+// The publish property is client-wide; callers hold publish_mutex, and so does every publish
+// made outside this module (mqtt_publish_lock), so no other publish picks it up
+static int publish_with_property(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len,
+                                 int qos, int retain, uint16_t alias, uint32_t expiry_s) {
+    esp_mqtt5_publish_property_config_t property = {.topic_alias = alias, .message_expiry_interval = expiry_s};
+    esp_mqtt5_client_set_publish_property(client, &property);
+    int msg_id = esp_mqtt_client_publish(client, topic, data, len, qos, retain);
+    esp_mqtt5_client_set_publish_property(client, &(esp_mqtt5_publish_property_config_t){0});
+    return msg_id;
+}
+
+static int publish_registered(esp_mqtt_client_handle_t client, mqtt_publish_topic_t *entry, const char *data, int len,
+                              int qos, int retain) {
+    if (entry->alias == 0) {
+        stats.topic_bytes += entry->topic_len;
+        return publish_with_property(client, entry->topic, data, len, qos, retain, 0, entry->expiry_s);
+    }
+
+    int msg_id = publish_with_property(client, entry->alias_sent ? "" : entry->topic, data, len, qos, retain,
+                                       entry->alias, entry->expiry_s);
+    if (msg_id >= 0) {
+        stats.aliased++;
+        if (entry->alias_sent) {
+            stats.topic_bytes_saved += entry->topic_len;
+        } else {
+            stats.topic_bytes += entry->topic_len;
+        }
+        entry->alias_sent = true;
+        return msg_id;
+    }
+
+    // Publishes also fail while disconnected. Only if the same message goes out without the
+    // alias was the alias the problem: the broker's alias maximum is lower than ours.
+    stats.topic_bytes += entry->topic_len;
+    msg_id = publish_with_property(client, entry->topic, data, len, qos, retain, 0, entry->expiry_s);
+    if (msg_id >= 0) {
+        ESP_LOGW(TAG, "Topic alias %u rejected, publishing %s with the full topic", entry->alias, entry->topic);
+        stats.alias_fallbacks++;
+        entry->alias = 0;
+    }
+    return msg_id;
+}
+#endif
+
+int mqtt_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain) {
+    int payload_len = (len == 0 && data != NULL) ? strlen(data) : len;
+    int msg_id;
+
+    xSemaphoreTake(publish_mutex, portMAX_DELAY);
+    int index = find_topic(topic);
+#if MQTT_PROTOCOL_V5
+    if (index >= 0) {
+        msg_id = publish_registered(client, &topics[index], data, len, qos, retain);
+    } else {
+        msg_id = esp_mqtt_client_publish(client, topic, data, len, qos, retain);
+        stats.topic_bytes += strlen(topic);
+    }
+#else
+    (void)index;
+    msg_id = esp_mqtt_client_publish(client, topic, data, len, qos, retain);
+    stats.topic_bytes += strlen(topic);
+#endif
+    stats.publishes++;
+    stats.payload_bytes += payload_len;
+    xSemaphoreGive(publish_mutex);
+    return msg_id;
+}
+
+void mqtt_publish_get_stats(mqtt_publish_stats_t *out) {
+    xSemaphoreTake(publish_mutex, portMAX_DELAY);
+    *out = stats;
+    xSemaphoreGive(publish_mutex);
+}
+
+void mqtt_publish_log_stats(void) {
+    mqtt_publish_stats_t snapshot;
+    mqtt_publish_get_stats(&snapshot);
+
+    ESP_LOGI(TAG, "publishes=%lu aliased=%lu fallbacks=%lu payload=%llu B topic=%llu B topic_saved=%llu B",
+             (unsigned long)snapshot.publishes, (unsigned long)snapshot.aliased,
+             (unsigned long)snapshot.alias_fallbacks, snapshot.payload_bytes, snapshot.topic_bytes,
+             snapshot.topic_bytes_saved);
+}
@@ -0,0 +1,71 @@
+#ifndef SNOOPER_MQTT_PUBLISH_H
+#define SNOOPER_MQTT_PUBLISH_H
+
+#include <stdint.h>
+
+#include "mqtt_client.h"
+
+// Outbound publishes from this application go through mqtt_publish(). In MQTT 5 mode the first
+// MQTT5_TOPIC_ALIAS_MAX registered topics get a topic alias: the first publish after CONNACK
+// carries the topic and the alias, later ones carry only the alias. Registered topics can also
+// carry a message expiry so the broker discards them instead of delivering stale data.
+//
+// esp-mqtt applies alias and expiry to every publish on the client until they are cleared, so
+// code that publishes on the client directly (the gecl telemetry component) must do so under
+// mqtt_publish_lock().
+//
+// MQTT 5 needs CONFIG_MQTT_PROTOCOL_5 in the board sdkconfig.
+
+#ifndef MQTT_PROTOCOL_V5
+#define MQTT_PROTOCOL_V5 0
+#endif
+
+#if MQTT_PROTOCOL_V5 && !defined(CONFIG_MQTT_PROTOCOL_5)
+#error "MQTT_PROTOCOL_V5 requires CONFIG_MQTT_PROTOCOL_5"
+#endif
+
+// Must not exceed the broker's Topic Alias Maximum (8 on AWS IoT Core)
+#ifndef MQTT5_TOPIC_ALIAS_MAX
+#define MQTT5_TOPIC_ALIAS_MAX 4
+#endif
+
+#define MQTT_PUBLISH_MAX_TOPICS 8
+
+// How long the broker keeps our persistent session after a disconnect
+#ifndef MQTT5_SESSION_EXPIRY_S
+#define MQTT5_SESSION_EXPIRY_S 3600
+#endif
+
+// Message expiry for status requests; an unanswered request is useless after this
+#ifndef MQTT5_STATUS_REQUEST_EXPIRY_S
+#define MQTT5_STATUS_REQUEST_EXPIRY_S 30
+#endif
+
+typedef struct {
+    uint32_t publishes;
+    uint32_t aliased;
+    uint32_t alias_fallbacks;  // Alias rejected by the client, resent with the full topic from then on
+    uint64_t payload_bytes;
+    uint64_t topic_bytes;        // Topic bytes actually sent
+    uint64_t topic_bytes_saved;  // Topic bytes replaced by an alias
+} mqtt_publish_stats_t;
+
+void mqtt_publish_init(void);
+
+// Register a frequently used topic, most frequent first. expiry_s of 0 means no message expiry.
+void mqtt_publish_register_topic(const char *topic, uint32_t expiry_s);
+
+// Held around publishes made outside mqtt_publish() on the same client; no-ops without MQTT 5
+void mqtt_publish_lock(void);
+void mqtt_publish_unlock(void);
+
+// Aliases only live as long as the connection; call on every MQTT_EVENT_CONNECTED
+void mqtt_publish_reset_aliases(void);
+
+// Same contract as esp_mqtt_client_publish()
+int mqtt_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain);
+
+void mqtt_publish_get_stats(mqtt_publish_stats_t *stats);
+void mqtt_publish_log_stats(void);
+
+#endif  // SNOOPER_MQTT_PUBLISH_H
@@ -0,0 +1,235 @@
+// Must come before anything that includes esp_log.h
+#include "hot_path_log.h"
+
+#include "mqtt_worker.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "metrics.h"
+#include "static_alloc.h"
+#include "supervisor.h"
+
+static const char *TAG = "MQTT_WORKER";
+
+typedef struct {
+    const char *topic;
+    size_t topic_len;
+    mqtt_work_overflow_t overflow;
+    mqtt_work_handler_t handler;
+} mqtt_work_route_t;
+
+static mqtt_work_route_t routes[MQTT_WORK_MAX_TOPICS];
+static int route_count = 0;
+
+// Ring of queued items, oldest at queue_head
+static mqtt_work_item_t queue[MQTT_WORK_QUEUE_LENGTH];
+static int queue_head = 0;
+static int queue_count = 0;
+static SemaphoreHandle_t queue_mutex = NULL;
+static TaskHandle_t worker_task_handle = NULL;
+STATIC_SEMAPHORE_STORAGE(work_queue_mutex);
+STATIC_TASK_STORAGE(mqtt_worker, 6144);
+
+static mqtt_worker_stats_t stats;
+static metric_t *received_metric;
+static metric_t *dropped_metric;
+static metric_t *handler_metric;
+static supervised_t *worker_supervised;
+
+void mqtt_worker_register(const char *topic, mqtt_work_overflow_t overflow, mqtt_work_handler_t handler) {
+    if (route_count >= MQTT_WORK_MAX_TOPICS) {
+        ESP_LOGE(TAG, "Too many topics, cannot register %s", topic);
+        return;
+    }
+    routes[route_count++] =
+        (mqtt_work_route_t){.topic = topic, .topic_len = strlen(topic), .overflow = overflow, .handler = handler};
+}
+
+static int find_route(const char *topic, int topic_len) {
+    for (int i = 0; i < route_count; i++) {
+        if (routes[i].topic_len == (size_t)topic_len && memcmp(routes[i].topic, topic, topic_len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Remove the queued item at ring position pos (0 = oldest). Caller holds queue_mutex.
+static void remove_at(int pos) {
+    for (int i = pos; i > 0; i--) {
+        int dst = (queue_head + i) % MQTT_WORK_QUEUE_LENGTH;
+        int src = (queue_head + i - 1) % MQTT_WORK_QUEUE_LENGTH;
+        queue[dst] = queue[src];
+    }
+    queue_head = (queue_head + 1) % MQTT_WORK_QUEUE_LENGTH;
+    queue_count--;
+}
+
+bool mqtt_worker_submit(esp_mqtt_event_handle_t event) {
+    int index = find_route(event->topic, event->topic_len);
+    if (index < 0) {
+        ESP_LOGD(TAG, "Received topic %.*s", event->topic_len, event->topic);
+        return false;
+    }
+    if (queue_mutex == NULL) {
+        ESP_LOGE(TAG, "Worker not started, dropping %s", routes[index].topic);
+        return false;
+    }
+
+    metric_inc(received_metric);
+    xSemaphoreTake(queue_mutex, portMAX_DELAY);
+
+    // Fragmented or oversized payloads would be handed to cJSON truncated
+    if (event->data_len != event->total_data_len || event->data_len > MQTT_WORK_DATA_MAX ||
+        event->topic_len >= MQTT_WORK_TOPIC_MAX) {
+        xSemaphoreGive(queue_mutex);
+        metric_inc(dropped_metric);
+        ESP_LOGE(TAG, "Message on %s too large (%d bytes), dropping", routes[index].topic, event->total_data_len);
+        return false;
+    }
+
+    if (queue_count == MQTT_WORK_QUEUE_LENGTH) {
+        int victim = -1;
+        if (routes[index].overflow == MQTT_WORK_DROP_OLDEST) {
+            for (int i = 0; i < queue_count; i++) {
+                if (queue[(queue_head + i) % MQTT_WORK_QUEUE_LENGTH].topic_index == index) {
+                    victim = i;
+                    break;
+                }
+            }
+        }
+        if (victim < 0) {
+            xSemaphoreGive(queue_mutex);
+            metric_inc(dropped_metric);
+            ESP_LOGW(TAG, "Work queue full, rejecting message on %s", routes[index].topic);
+            return false;
+        }
+        remove_at(victim);
+        metric_inc(dropped_metric);
+    }
+
+    mqtt_work_item_t *item = &queue[(queue_head + queue_count) % MQTT_WORK_QUEUE_LENGTH];
+    item->client = event->client;
+    memcpy(item->topic, event->topic, event->topic_len);
+    item->topic[event->topic_len] = '\0';
+    memcpy(item->data, event->data, event->data_len);
+    item->data[event->data_len] = '\0';
+    item->data_len = event->data_len;
+    item->topic_index = index;
+    item->enqueued_us = esp_timer_get_time();
+    queue_count++;
+    stats.depth = queue_count;
+    if (stats.depth > stats.depth_high_water) {
+        stats.depth_high_water = stats.depth;
+    }
+    xSemaphoreGive(queue_mutex);
+
+    xTaskNotifyGive(worker_task_handle);
+    return true;
+}
+
+bool mqtt_worker_post(esp_mqtt_client_handle_t client, const char *topic) {
+    esp_mqtt_event_t event = {.event_id = MQTT_EVENT_DATA,
+                              .client = client,
+                              .topic = (char *)topic,
+                              .topic_len = strlen(topic),
+                              .data = "",
+                              .data_len = 0,
+                              .total_data_len = 0};
+    return mqtt_worker_submit(&event);
+}
+
+// Runs the oldest queued item; returns false when the queue was empty
+static bool handle_next(void) {
+    // Handlers run from a private copy so the producer never waits on a slow handler
+    static mqtt_work_item_t item;
+
+    xSemaphoreTake(queue_mutex, portMAX_DELAY);
+    if (queue_count == 0) {
+        xSemaphoreGive(queue_mutex);
+        return false;
+    }
+    item = queue[queue_head];
+    queue_head = (queue_head + 1) % MQTT_WORK_QUEUE_LENGTH;
+    queue_count--;
+    stats.depth = queue_count;
+    xSemaphoreGive(queue_mutex);
+
+    int64_t start_us = esp_timer_get_time();
+    routes[item.topic_index].handler(&item);
+    int64_t end_us = esp_timer_get_time();
+    supervisor_heartbeat(worker_supervised);
+
+    uint32_t handler_us = (uint32_t)(end_us - start_us);
+    uint32_t latency_us = (uint32_t)(end_us - item.enqueued_us);
+    metric_observe(handler_metric, handler_us);
+    xSemaphoreTake(queue_mutex, portMAX_DELAY);
+    if (handler_us > stats.handler_max_us) {
+        stats.handler_max_us = handler_us;
+    }
+    if (latency_us > stats.latency_max_us) {
+        stats.latency_max_us = latency_us;
+    }
+    xSemaphoreGive(queue_mutex);
+    return true;
+}
+
+static void mqtt_worker_task(void *param) {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SUPERVISOR_HEARTBEAT_MS));
+        supervisor_heartbeat(worker_supervised);
+        while (handle_next()) {
+        }
+    }
+}
+
+void start_mqtt_worker(void) {
+    received_metric = metrics_counter("mqtt.rx");
+    dropped_metric = metrics_counter("mqtt.rx_dropped");
+    handler_metric = metrics_histogram("mqtt.handler_us");
+    // Status traffic is steady; only report handler timings once a few more have been seen
+    metric_set_threshold(handler_metric, 4);
+
+    queue_mutex = STATIC_MUTEX_CREATE(work_queue_mutex);
+    if (queue_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to create work queue mutex");
+        esp_restart();
+    }
+    // No restart: a stuck handler may hold the publish or metrics lock, esp-mqtt's client lock or
+    // half-built cJSON, and deleting it would leak them all; the supervisor reboots instead
+    worker_supervised = supervisor_register("mqtt_worker", MQTT_WORKER_DEADLINE_MS, NULL);
+    worker_task_handle = STATIC_TASK_CREATE(mqtt_worker, &mqtt_worker_task, "mqtt_worker", NULL, 5);
+}
+
+void mqtt_worker_get_stats(mqtt_worker_stats_t *out) {
+    if (queue_mutex == NULL) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(queue_mutex, portMAX_DELAY);
+    *out = stats;
+    xSemaphoreGive(queue_mutex);
+    out->received = atomic_load_explicit(&received_metric->value, memory_order_relaxed);
+    out->dropped = atomic_load_explicit(&dropped_metric->value, memory_order_relaxed);
+    out->handled = atomic_load_explicit(&handler_metric->value, memory_order_relaxed);
+    out->handler_time_us = atomic_load_explicit(&handler_metric->histogram->sum, memory_order_relaxed);
+}
+
+void mqtt_worker_log_stats(void) {
+    mqtt_worker_stats_t snapshot;
+    mqtt_worker_get_stats(&snapshot);
+
+    ESP_LOGI(TAG,
+             "received=%lu handled=%lu dropped=%lu depth=%lu/%lu "
+             "handler_mean=%lu us handler_max=%lu us latency_max=%lu us",
+             (unsigned long)snapshot.received, (unsigned long)snapshot.handled, (unsigned long)snapshot.dropped,
+             (unsigned long)snapshot.depth, (unsigned long)snapshot.depth_high_water,
+             (unsigned long)(snapshot.handled ? snapshot.handler_time_us / snapshot.handled : 0),
+             (unsigned long)snapshot.handler_max_us, (unsigned long)snapshot.latency_max_us);
+}
@@ -0,0 +1,77 @@
+#ifndef SNOOPER_MQTT_WORKER_H
+#define SNOOPER_MQTT_WORKER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mqtt_client.h"
+
+// Inbound messages are copied out of the esp-mqtt event task into a bounded queue and handled
+// on a dedicated worker task, so slow handlers never stall keepalives or inbound traffic.
+
+#ifndef MQTT_WORK_QUEUE_LENGTH
+#define MQTT_WORK_QUEUE_LENGTH 8
+#endif
+
+#ifndef MQTT_WORK_TOPIC_MAX
+#define MQTT_WORK_TOPIC_MAX 64
+#endif
+
+#ifndef MQTT_WORK_DATA_MAX
+#define MQTT_WORK_DATA_MAX 768
+#endif
+
+#define MQTT_WORK_MAX_TOPICS 8
+
+// The supervisor reboots the device when a handler runs longer than this
+#ifndef MQTT_WORKER_DEADLINE_MS
+#define MQTT_WORKER_DEADLINE_MS 60000
+#endif
+
+// What to do with a new message when the queue is full
+typedef enum {
+    MQTT_WORK_DROP_OLDEST = 0,  // Evict the oldest queued message on the same topic, else reject
+    MQTT_WORK_REJECT,           // Drop the new message
+} mqtt_work_overflow_t;
+
+typedef struct {
+    esp_mqtt_client_handle_t client;
+    char topic[MQTT_WORK_TOPIC_MAX];
+    char data[MQTT_WORK_DATA_MAX + 1];  // NUL terminated so handlers can pass it straight to cJSON
+    int data_len;
+    int topic_index;
+    int64_t enqueued_us;
+} mqtt_work_item_t;
+
+typedef void (*mqtt_work_handler_t)(const mqtt_work_item_t *item);
+
+// received, dropped, handled and handler_time_us are read from the mqtt.rx, mqtt.rx_dropped and
+// mqtt.handler_us metrics, which are the only counts kept
+typedef struct {
+    uint32_t received;
+    uint32_t dropped;  // Evicted, rejected or oversized
+    uint32_t handled;
+    uint32_t handler_time_us;  // Cumulative time spent inside handlers; wraps like the histogram sum
+    uint32_t depth;
+    uint32_t depth_high_water;
+    uint32_t handler_max_us;
+    uint32_t latency_max_us;  // Enqueue to handler completion
+} mqtt_worker_stats_t;
+
+// Register before start_mqtt_worker(). Topics are matched exactly.
+void mqtt_worker_register(const char *topic, mqtt_work_overflow_t overflow, mqtt_work_handler_t handler);
+
+void start_mqtt_worker(void);
+
+// Called on the esp-mqtt event task. Returns false if the message was not queued.
+bool mqtt_worker_submit(esp_mqtt_event_handle_t event);
+
+// Queues the handler registered for topic as if a message without payload had arrived on it,
+// for work the esp-mqtt event task must not do itself. Use "$local/" topics, which no broker
+// can deliver. Returns false if it was not queued.
+bool mqtt_worker_post(esp_mqtt_client_handle_t client, const char *topic);
+
+void mqtt_worker_get_stats(mqtt_worker_stats_t *stats);
+void mqtt_worker_log_stats(void);
+
+#endif  // SNOOPER_MQTT_WORKER_H
@@ -0,0 +1,26 @@
+#include "payload_encoding.h"
+
+#include "esp_log.h"
+
+static const char *TAG = "PAYLOAD";
+
+static const bool topic_allows_cbor[PAYLOAD_TOPIC_COUNT] = {
+    [PAYLOAD_TOPIC_STATUS] = PAYLOAD_CBOR_STATUS,
+    [PAYLOAD_TOPIC_TELEMETRY] = PAYLOAD_CBOR_TELEMETRY,
+    [PAYLOAD_TOPIC_OTA_PROGRESS] = PAYLOAD_CBOR_OTA_PROGRESS,
+};
+
+// Written by the MQTT worker, read by any publisher
+static volatile payload_encoding_t peer_encoding = PAYLOAD_JSON;
+
+payload_encoding_t payload_encoding(payload_topic_t topic) {
+    return PAYLOAD_CBOR_ENABLED && topic_allows_cbor[topic] ? peer_encoding : PAYLOAD_JSON;
+}
+
+void payload_encoding_peer_used(payload_encoding_t encoding) {
+    if (!PAYLOAD_CBOR_ENABLED || encoding == peer_encoding) {
+        return;
+    }
+    peer_encoding = encoding;
+    ESP_LOGI(TAG, "Backend speaks %s, switching payload encoding", encoding == PAYLOAD_CBOR ? "CBOR" : "JSON");
+}
@@ -0,0 +1,45 @@
+#ifndef SNOOPER_PAYLOAD_ENCODING_H
+#define SNOOPER_PAYLOAD_ENCODING_H
+
+#include <stdbool.h>
+
+// Payload encoding negotiation. The status request advertises CBOR ("accept":"cbor"); a
+// backend that answers with a CBOR status switches the device's status, telemetry and OTA
+// progress publishes to CBOR (cbor.h). A JSON status switches them back. Each topic can be
+// pinned to JSON with its PAYLOAD_CBOR_* option; PAYLOAD_CBOR_ENABLED 0 disables CBOR entirely.
+
+#ifndef PAYLOAD_CBOR_ENABLED
+#define PAYLOAD_CBOR_ENABLED 1
+#endif
+
+#ifndef PAYLOAD_CBOR_STATUS
+#define PAYLOAD_CBOR_STATUS 1
+#endif
+
+#ifndef PAYLOAD_CBOR_TELEMETRY
+#define PAYLOAD_CBOR_TELEMETRY 1
+#endif
+
+#ifndef PAYLOAD_CBOR_OTA_PROGRESS
+#define PAYLOAD_CBOR_OTA_PROGRESS 1
+#endif
+
+typedef enum {
+    PAYLOAD_JSON = 0,
+    PAYLOAD_CBOR,
+} payload_encoding_t;
+
+typedef enum {
+    PAYLOAD_TOPIC_STATUS = 0,
+    PAYLOAD_TOPIC_TELEMETRY,
+    PAYLOAD_TOPIC_OTA_PROGRESS,
+    PAYLOAD_TOPIC_COUNT
+} payload_topic_t;
+
+// Encoding to publish with on a topic
+payload_encoding_t payload_encoding(payload_topic_t topic);
+
+// Called with the encoding of every status message from the backend
+void payload_encoding_peer_used(payload_encoding_t encoding);
+
+#endif  // SNOOPER_PAYLOAD_ENCODING_H
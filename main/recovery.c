@@ -0,0 +1,217 @@
+#include "recovery.h"
+
+#include <stdio.h>
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "gecl-wifi-manager.h"
+#include "rtc_journal.h"
+#include "static_alloc.h"
+#include "wifi_cache.h"
+
+static const char *TAG = "RECOVERY";
+
+#define RECOVERY_QUEUE_LENGTH 8
+#define RECOVERY_WIFI_POLL_MS 500
+
+typedef enum {
+    RECOVERY_EVENT_ERROR = 0,
+    RECOVERY_EVENT_CONNECTED,
+} recovery_event_type_t;
+
+typedef struct {
+    recovery_event_type_t type;
+    recovery_error_class_t error_class;
+    int64_t timestamp_us;
+} recovery_event_t;
+
+static const char *step_names[RECOVERY_STEP_COUNT] = {"transport", "mqtt", "wifi", "reboot"};
+static const char *error_names[RECOVERY_ERROR_COUNT] = {"tls", "refused", "other"};
+static const uint32_t step_windows_ms[RECOVERY_STEP_COUNT] = {RECOVERY_TRANSPORT_WINDOW_MS, RECOVERY_MQTT_WINDOW_MS,
+                                                              RECOVERY_WIFI_WINDOW_MS, 0};
+
+static QueueHandle_t recovery_queue = NULL;
+STATIC_QUEUE_STORAGE(recovery_queue, RECOVERY_QUEUE_LENGTH, sizeof(recovery_event_t));
+STATIC_TASK_STORAGE(recovery, 4096);
+static esp_mqtt_client_handle_t recovery_client = NULL;
+static recovery_stats_t stats;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static recovery_error_class_t classify_error(const esp_mqtt_error_codes_t *error) {
+    if (error == NULL) {
+        return RECOVERY_ERROR_OTHER;
+    }
+    if (error->error_type == MQTT_ERROR_TYPE_ESP_TLS) {
+        return RECOVERY_ERROR_TLS;
+    }
+    if (error->error_type == MQTT_ERROR_TYPE_CONNECTION_REFUSED) {
+        return RECOVERY_ERROR_CONNECTION_REFUSED;
+    }
+    return RECOVERY_ERROR_OTHER;
+}
+
+static void post_event(recovery_event_type_t type, recovery_error_class_t error_class) {
+    if (recovery_queue == NULL) {
+        return;
+    }
+    recovery_event_t event = {.type = type, .error_class = error_class, .timestamp_us = esp_timer_get_time()};
+    if (xQueueSend(recovery_queue, &event, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Recovery queue full, dropping event %d", type);
+    }
+}
+
+void recovery_report_error(const esp_mqtt_error_codes_t *error) {
+    post_event(RECOVERY_EVENT_ERROR, classify_error(error));
+}
+
+void recovery_report_disconnected(void) { post_event(RECOVERY_EVENT_ERROR, RECOVERY_ERROR_OTHER); }
+
+void recovery_report_connected(void) { post_event(RECOVERY_EVENT_CONNECTED, RECOVERY_ERROR_OTHER); }
+
+static void run_step(recovery_step_t step) {
+    esp_err_t err = ESP_OK;
+
+    ESP_LOGW(TAG, "Running recovery step: %s", step_names[step]);
+    switch (step) {
+        case RECOVERY_STEP_TRANSPORT:
+            err = esp_mqtt_client_reconnect(recovery_client);
+            break;
+        case RECOVERY_STEP_MQTT:
+            esp_mqtt_client_stop(recovery_client);
+            err = esp_mqtt_client_start(recovery_client);
+            break;
+        case RECOVERY_STEP_WIFI:
+            esp_wifi_disconnect();
+            if (!wifi_cache_connect(esp_timer_get_time())) {
+                err = esp_wifi_connect();
+            }
+            // Give the association a chance before poking the MQTT client again
+            for (int waited_ms = 0; !wifi_active() && waited_ms < RECOVERY_WIFI_WINDOW_MS / 2;
+                 waited_ms += RECOVERY_WIFI_POLL_MS) {
+                vTaskDelay(pdMS_TO_TICKS(RECOVERY_WIFI_POLL_MS));
+            }
+            if (wifi_active()) {
+                err = esp_mqtt_client_reconnect(recovery_client);
+            }
+            break;
+        case RECOVERY_STEP_REBOOT:
+        default:
+            recovery_log_stats();
+            esp_restart();
+            break;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Recovery step %s returned %s", step_names[step], esp_err_to_name(err));
+    }
+}
+
+// Ladder state, owned by the recovery task
+static bool fault_active = false;
+static recovery_error_class_t fault_class = RECOVERY_ERROR_OTHER;
+static recovery_step_t step = RECOVERY_STEP_TRANSPORT;
+static int64_t fault_start_us = 0;
+static int64_t step_start_us = 0;
+
+// How long to wait for the next event before the current rung has had its window
+static TickType_t step_wait(void) {
+    if (!fault_active) {
+        return portMAX_DELAY;
+    }
+    int64_t deadline_us = step_start_us + (int64_t)step_windows_ms[step] * 1000;
+    int64_t remaining_us = deadline_us - esp_timer_get_time();
+    return remaining_us > 0 ? pdMS_TO_TICKS(remaining_us / 1000) : 0;
+}
+
+static void handle_event(const recovery_event_t *event) {
+    if (event->type == RECOVERY_EVENT_ERROR && !fault_active) {
+        fault_active = true;
+        fault_class = event->error_class;
+        fault_start_us = event->timestamp_us;
+        step = RECOVERY_STEP_TRANSPORT;
+        taskENTER_CRITICAL(&stats_lock);
+        stats.faults[fault_class]++;
+        stats.step_attempts[step]++;
+        taskEXIT_CRITICAL(&stats_lock);
+        ESP_LOGW(TAG, "MQTT fault (%s), starting recovery", error_names[fault_class]);
+        step_start_us = esp_timer_get_time();
+        run_step(step);
+    } else if (event->type == RECOVERY_EVENT_CONNECTED && fault_active) {
+        int64_t recovery_us = event->timestamp_us - fault_start_us;
+        taskENTER_CRITICAL(&stats_lock);
+        stats.step_successes[step]++;
+        stats.step_time_us[step] += event->timestamp_us - step_start_us;
+        stats.recoveries[fault_class]++;
+        stats.recovery_time_us[fault_class] += recovery_us;
+        taskEXIT_CRITICAL(&stats_lock);
+        ESP_LOGI(TAG, "Recovered from %s fault at step %s in %lld ms", error_names[fault_class], step_names[step],
+                 recovery_us / 1000);
+        // The steps are journaled as warnings; close the fault there too
+        char event_text[RTC_JOURNAL_TEXT_MAX];
+        snprintf(event_text, sizeof(event_text), "recovered from %s at %s in %lld ms", error_names[fault_class],
+                 step_names[step], recovery_us / 1000);
+        rtc_journal_event(event_text);
+        fault_active = false;
+    }
+    // Errors raised while a fault is already being handled are part of the same fault
+}
+
+// The rung's window expired without a CONNECTED event
+static void escalate(void) {
+    taskENTER_CRITICAL(&stats_lock);
+    stats.step_time_us[step] += esp_timer_get_time() - step_start_us;
+    step++;
+    stats.step_attempts[step]++;
+    taskEXIT_CRITICAL(&stats_lock);
+    step_start_us = esp_timer_get_time();
+    run_step(step);
+}
+
+static void recovery_task(void *param) {
+    recovery_event_t event;
+
+    while (true) {
+        if (xQueueReceive(recovery_queue, &event, step_wait()) == pdTRUE) {
+            handle_event(&event);
+        } else {
+            escalate();
+        }
+    }
+}
+
+void start_recovery_task(esp_mqtt_client_handle_t client) {
+    recovery_client = client;
+    recovery_queue = STATIC_QUEUE_CREATE(recovery_queue, RECOVERY_QUEUE_LENGTH, sizeof(recovery_event_t));
+    if (recovery_queue == NULL) {
+        ESP_LOGE(TAG, "Failed to create recovery queue");
+        esp_restart();
+    }
+    STATIC_TASK_CREATE(recovery, &recovery_task, "recovery_task", NULL, 6);
+}
+
+void recovery_get_stats(recovery_stats_t *out) {
+    taskENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    taskEXIT_CRITICAL(&stats_lock);
+}
+
+void recovery_log_stats(void) {
+    recovery_stats_t snapshot;
+    recovery_get_stats(&snapshot);
+
+    for (int step = 0; step < RECOVERY_STEP_COUNT; step++) {
+        ESP_LOGI(TAG, "Step %-9s attempts=%lu successes=%lu time=%llu ms", step_names[step],
+                 (unsigned long)snapshot.step_attempts[step], (unsigned long)snapshot.step_successes[step],
+                 snapshot.step_time_us[step] / 1000);
+    }
+    for (int cls = 0; cls < RECOVERY_ERROR_COUNT; cls++) {
+        uint64_t mean_ms =
+            snapshot.recoveries[cls] ? snapshot.recovery_time_us[cls] / snapshot.recoveries[cls] / 1000 : 0;
+        ESP_LOGI(TAG, "Error %-7s faults=%lu recoveries=%lu mean_ttr=%llu ms", error_names[cls],
+                 (unsigned long)snapshot.faults[cls], (unsigned long)snapshot.recoveries[cls], mean_ms);
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef SNOOPER_RECOVERY_H
+#define SNOOPER_RECOVERY_H
+
+#include <stdint.h>
+
+#include "mqtt_client.h"
+
+// How long each rung of the ladder waits for MQTT_EVENT_CONNECTED before escalating
+#ifndef RECOVERY_TRANSPORT_WINDOW_MS
+#define RECOVERY_TRANSPORT_WINDOW_MS 10000
+#endif
+
+#ifndef RECOVERY_MQTT_WINDOW_MS
+#define RECOVERY_MQTT_WINDOW_MS 20000
+#endif
+
+#ifndef RECOVERY_WIFI_WINDOW_MS
+#define RECOVERY_WIFI_WINDOW_MS 30000
+#endif
+
+// Recovery ladder, cheapest first. Only the last rung reboots.
+typedef enum {
+    RECOVERY_STEP_TRANSPORT = 0,  // esp_mqtt_client_reconnect
+    RECOVERY_STEP_MQTT,           // esp_mqtt_client_stop + esp_mqtt_client_start
+    RECOVERY_STEP_WIFI,           // esp_wifi_disconnect + rejoin, via the cached AP if any
+    RECOVERY_STEP_REBOOT,         // esp_restart
+    RECOVERY_STEP_COUNT
+} recovery_step_t;
+
+typedef enum {
+    RECOVERY_ERROR_TLS = 0,
+    RECOVERY_ERROR_CONNECTION_REFUSED,
+    RECOVERY_ERROR_OTHER,
+    RECOVERY_ERROR_COUNT
+} recovery_error_class_t;
+
+typedef struct {
+    uint32_t step_attempts[RECOVERY_STEP_COUNT];
+    uint32_t step_successes[RECOVERY_STEP_COUNT];
+    uint64_t step_time_us[RECOVERY_STEP_COUNT];  // Cumulative time spent waiting on each rung
+    uint32_t faults[RECOVERY_ERROR_COUNT];
+    uint32_t recoveries[RECOVERY_ERROR_COUNT];
+    uint64_t recovery_time_us[RECOVERY_ERROR_COUNT];  // Cumulative fault-to-CONNECTED time
+} recovery_stats_t;
+
+// Start the task that walks the ladder. Must run after the MQTT client exists.
+void start_recovery_task(esp_mqtt_client_handle_t client);
+
+// Called from the MQTT event handlers. They only post to the recovery queue. A disconnect
+// starts the ladder like an error does; one following an error is part of the same fault.
+void recovery_report_error(const esp_mqtt_error_codes_t *error);
+void recovery_report_disconnected(void);
+void recovery_report_connected(void);
+
+void recovery_get_stats(recovery_stats_t *stats);
+void recovery_log_stats(void);
+
+#endif  // SNOOPER_RECOVERY_H
@@ -0,0 +1,268 @@
+#include "rtc_journal.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cloud_log.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "mqtt_publish.h"
+#include "static_alloc.h"
+
+static const char *TAG = "RTC_JOURNAL";
+
+#define JOURNAL_MAGIC 0x4a524e4c  // "JRNL"
+#define JOURNAL_LINE_MAX (RTC_JOURNAL_TEXT_MAX + 32)
+
+typedef struct {
+    uint32_t crc;  // Over everything after this field, up to the end of the text
+    uint32_t seq;  // Starts at 1; the record lives in slot seq % RTC_JOURNAL_RECORDS
+    uint32_t timestamp_ms;
+    uint16_t boot;
+    uint8_t kind;
+    uint8_t len;
+    char text[RTC_JOURNAL_TEXT_MAX];
+} journal_record_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t boot_count;
+    uint32_t drained_seq;  // Records up to here have been shipped
+    uint32_t crc;
+} journal_header_t;
+
+// Not cleared by the startup code, so the previous boot's records are still there
+static RTC_NOINIT_ATTR struct {
+    journal_header_t header;
+    journal_record_t records[RTC_JOURNAL_RECORDS];
+} journal;
+
+static uint32_t next_seq = 1;
+static uint32_t boot_start_seq = 1;  // First record of this boot
+static bool drained = false;
+static rtc_journal_stats_t stats;
+static vprintf_like_t previous_vprintf = NULL;
+static SemaphoreHandle_t line_mutex = NULL;
+STATIC_SEMAPHORE_STORAGE(journal_line);
+static portMUX_TYPE journal_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t header_crc(const journal_header_t *header) {
+    return esp_rom_crc32_le(0, (const uint8_t *)header, offsetof(journal_header_t, crc));
+}
+
+static uint32_t record_crc(const journal_record_t *record) {
+    size_t len = record->len <= RTC_JOURNAL_TEXT_MAX ? record->len : RTC_JOURNAL_TEXT_MAX;
+    return esp_rom_crc32_le(0, (const uint8_t *)&record->seq,
+                            offsetof(journal_record_t, text) - offsetof(journal_record_t, seq) + len);
+}
+
+static bool record_valid(const journal_record_t *record, uint32_t slot) {
+    return record->seq != 0 && record->seq % RTC_JOURNAL_RECORDS == slot && record->len <= RTC_JOURNAL_TEXT_MAX &&
+           record->crc == record_crc(record);
+}
+
+static void append(rtc_journal_kind_t kind, const char *text, size_t len) {
+    if (len > RTC_JOURNAL_TEXT_MAX) {
+        len = RTC_JOURNAL_TEXT_MAX;
+    }
+    taskENTER_CRITICAL(&journal_lock);
+    uint32_t seq = next_seq++;
+    journal_record_t *record = &journal.records[seq % RTC_JOURNAL_RECORDS];
+    record->seq = seq;
+    record->timestamp_ms = esp_log_timestamp();
+    record->boot = (uint16_t)journal.header.boot_count;
+    record->kind = kind;
+    record->len = (uint8_t)len;
+    memcpy(record->text, text, len);
+    record->crc = record_crc(record);
+    taskEXIT_CRITICAL(&journal_lock);
+}
+
+// Returns the level letter of an esp_log format string, skipping the colour escape
+static char format_level(const char *format) {
+    if (format[0] == '\033') {
+        const char *end = strchr(format, 'm');
+        return end != NULL ? end[1] : 0;
+    }
+    return format[0];
+}
+
+// Keeps "E TAG: message" of a formatted log line; the record has its own timestamp and no
+// colour codes. Compacts the line in place.
+static void journal_line(char *line, size_t len) {
+    char *text = line;
+    if (text[0] == '\033') {
+        char *colour_end = strchr(text, 'm');
+        if (colour_end == NULL) {
+            return;
+        }
+        text = colour_end + 1;
+    }
+    char *end = line + len;
+    if (end > text && end[-1] == '\n') {
+        end--;
+    }
+    if (end - text >= 4 && memcmp(end - 4, "\033[0m", 4) == 0) {
+        end -= 4;
+    }
+    // "E (1234) TAG: message" -> "E TAG: message"
+    char *stamp_end = end - text >= 3 && text[1] == ' ' && text[2] == '(' ? strstr(text, ") ") : NULL;
+    if (stamp_end != NULL && stamp_end < end) {
+        size_t tail = end - (stamp_end + 2);
+        memmove(text + 2, stamp_end + 2, tail);
+        end = text + 2 + tail;
+    }
+    append(RTC_JOURNAL_LOG, text, end - text);
+}
+
+// Runs on the stack of every task that logs, so the line is formatted into a static buffer.
+// Until the scheduler runs, and in interrupts, lines are not journaled.
+static int journal_vprintf(const char *format, va_list args) {
+    static char line[JOURNAL_LINE_MAX];
+    va_list copy;
+
+    char level = format_level(format);
+    if ((level != 'E' && level != 'W') || xPortInIsrContext() ||
+        xTaskGetSchedulerState() != taskSCHEDULER_RUNNING) {
+        return previous_vprintf(format, args);
+    }
+
+    xSemaphoreTake(line_mutex, portMAX_DELAY);
+    va_copy(copy, args);
+    int len = vsnprintf(line, sizeof(line), format, copy);
+    va_end(copy);
+    if (len > 0) {
+        if (len >= (int)sizeof(line)) {
+            len = sizeof(line) - 1;
+        }
+        journal_line(line, len);
+    }
+    xSemaphoreGive(line_mutex);
+    return previous_vprintf(format, args);
+}
+
+static const char *reset_reason_name(esp_reset_reason_t reason) {
+    switch (reason) {
+        case ESP_RST_POWERON:
+            return "power-on";
+        case ESP_RST_EXT:
+            return "external";
+        case ESP_RST_SW:
+            return "software";
+        case ESP_RST_PANIC:
+            return "panic";
+        case ESP_RST_INT_WDT:
+            return "interrupt watchdog";
+        case ESP_RST_TASK_WDT:
+            return "task watchdog";
+        case ESP_RST_WDT:
+            return "watchdog";
+        case ESP_RST_DEEPSLEEP:
+            return "deep sleep";
+        case ESP_RST_BROWNOUT:
+            return "brownout";
+        default:
+            return "unknown";
+    }
+}
+
+void init_rtc_journal(void) {
+    esp_reset_reason_t reason = esp_reset_reason();
+
+    // RTC memory holds garbage after power-on
+    if (reason == ESP_RST_POWERON || journal.header.magic != JOURNAL_MAGIC ||
+        journal.header.crc != header_crc(&journal.header)) {
+        memset(&journal, 0, sizeof(journal));
+        journal.header.magic = JOURNAL_MAGIC;
+    }
+
+    uint32_t max_seq = journal.header.drained_seq;
+    for (uint32_t slot = 0; slot < RTC_JOURNAL_RECORDS; slot++) {
+        const journal_record_t *record = &journal.records[slot];
+        if (record_valid(record, slot)) {
+            stats.records++;
+            if (record->seq > max_seq) {
+                max_seq = record->seq;
+            }
+        } else if (record->seq != 0 || record->crc != 0) {
+            stats.corrupt++;
+        }
+    }
+    next_seq = max_seq + 1;
+    boot_start_seq = next_seq;
+
+    journal.header.boot_count++;
+    journal.header.crc = header_crc(&journal.header);
+    stats.boot_count = journal.header.boot_count;
+
+    char text[RTC_JOURNAL_TEXT_MAX];
+    int len = snprintf(text, sizeof(text), "reset reason: %s (%d)", reset_reason_name(reason), reason);
+    append(RTC_JOURNAL_RESET, text, len);
+
+    line_mutex = STATIC_MUTEX_CREATE(journal_line);
+    if (line_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to create journal line mutex");
+        esp_restart();
+    }
+    previous_vprintf = esp_log_set_vprintf(journal_vprintf);
+    ESP_LOGI(TAG, "Boot %lu, %lu records from earlier boots, %lu corrupt", (unsigned long)stats.boot_count,
+             (unsigned long)stats.records, (unsigned long)stats.corrupt);
+}
+
+void rtc_journal_event(const char *text) { append(RTC_JOURNAL_EVENT, text, strlen(text)); }
+
+void rtc_journal_drain(esp_mqtt_client_handle_t client, const char *topic) {
+    static const char *kind_names[] = {"log", "reset", "event"};
+    char line[JOURNAL_LINE_MAX];
+
+    if (drained) {
+        return;
+    }
+    drained = true;
+
+    uint32_t first = journal.header.drained_seq + 1;
+    if (boot_start_seq > RTC_JOURNAL_RECORDS && first < boot_start_seq - RTC_JOURNAL_RECORDS) {
+        first = boot_start_seq - RTC_JOURNAL_RECORDS;
+    }
+    for (uint32_t seq = first; seq < boot_start_seq; seq++) {
+        journal_record_t record;
+        uint32_t slot = seq % RTC_JOURNAL_RECORDS;
+
+        taskENTER_CRITICAL(&journal_lock);
+        record = journal.records[slot];
+        taskEXIT_CRITICAL(&journal_lock);
+        // Overwritten by this boot's records, or corrupt
+        if (record.seq != seq || !record_valid(&record, slot)) {
+            continue;
+        }
+
+        int len = snprintf(line, sizeof(line), "J (%lu) boot %u %s: %.*s\n", (unsigned long)record.timestamp_ms,
+                           record.boot, kind_names[record.kind <= RTC_JOURNAL_EVENT ? record.kind : RTC_JOURNAL_EVENT],
+                           record.len, record.text);
+        if (len >= (int)sizeof(line)) {
+            len = sizeof(line) - 1;
+        }
+#if CLOUD_LOG_BATCHING
+        cloud_log_append(line, len, false);
+#else
+        mqtt_publish(client, topic, line, len, 0, 0);
+#endif
+        stats.drained++;
+    }
+#if CLOUD_LOG_BATCHING
+    cloud_log_flush();
+#endif
+
+    taskENTER_CRITICAL(&journal_lock);
+    journal.header.drained_seq = boot_start_seq - 1;
+    journal.header.crc = header_crc(&journal.header);
+    taskEXIT_CRITICAL(&journal_lock);
+}
+
+void rtc_journal_get_stats(rtc_journal_stats_t *out) { *out = stats; }
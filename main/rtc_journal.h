@@ -0,0 +1,51 @@
+#ifndef SNOOPER_RTC_JOURNAL_H
+#define SNOOPER_RTC_JOURNAL_H
+
+#include <stdint.h>
+
+#include "mqtt_client.h"
+
+// Crash-surviving journal. Warning and error log lines, plus the reset reason of every boot,
+// are kept in a small circular journal in RTC memory (RTC_NOINIT_ATTR). It survives software
+// resets, panics and watchdog resets but not power loss, and never touches flash. Records from
+// earlier boots are shipped to the log topic after the next MQTT connect, so the lines that
+// explain a restart are not lost with it.
+//
+// Each record has its own CRC; records that fail it (e.g. a reset in the middle of a write)
+// are skipped and counted.
+
+#ifndef RTC_JOURNAL_RECORDS
+#define RTC_JOURNAL_RECORDS 24
+#endif
+
+#ifndef RTC_JOURNAL_TEXT_MAX
+#define RTC_JOURNAL_TEXT_MAX 72
+#endif
+
+typedef enum {
+    RTC_JOURNAL_LOG = 0,  // Warning or error log line
+    RTC_JOURNAL_RESET,    // Reset reason, first record of each boot
+    RTC_JOURNAL_EVENT,
+} rtc_journal_kind_t;
+
+typedef struct {
+    uint32_t boot_count;
+    uint32_t records;  // Valid records found at boot
+    uint32_t corrupt;  // Records that failed their CRC at boot
+    uint32_t drained;  // Records from earlier boots shipped after connect
+} rtc_journal_stats_t;
+
+// Call first thing in app_main: validates the journal, records the reset reason and hooks
+// esp_log so later warnings and errors are journaled
+void init_rtc_journal(void);
+
+// Journals a milestone that is not logged as a warning, such as an OTA start or a completed
+// recovery, so the next boot can tell what led up to its reset
+void rtc_journal_event(const char *text);
+
+// Ship records from earlier boots; called on the MQTT worker once MQTT is connected
+void rtc_journal_drain(esp_mqtt_client_handle_t client, const char *topic);
+
+void rtc_journal_get_stats(rtc_journal_stats_t *stats);
+
+#endif  // SNOOPER_RTC_JOURNAL_H
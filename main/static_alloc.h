@@ -0,0 +1,76 @@
+#ifndef SNOOPER_STATIC_ALLOC_H
+#define SNOOPER_STATIC_ALLOC_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+// Static allocation mode. With STATIC_ALLOCATION the task stacks and TCBs, queue storage and
+// semaphores the snooper creates are reserved in .bss, so their RAM is accounted for at link
+// time, they cannot fail to allocate and they do not fragment the heap at boot. Without it they
+// come from the heap as before.
+//
+// Storage is declared at file scope with the *_STORAGE macros and used by the matching
+// *_CREATE macro. The symbols are named static_<tag>_<part>, which is what
+// scripts/memory_report.py looks for in the ELF to list them after each build.
+
+#ifndef STATIC_ALLOCATION
+#define STATIC_ALLOCATION 1
+#endif
+
+#if STATIC_ALLOCATION
+
+// ESP-IDF stack depths are in bytes and StackType_t is a byte
+#define STATIC_TASK_STORAGE(tag, stack_bytes)               \
+    static StackType_t static_##tag##_stack[(stack_bytes)]; \
+    static StaticTask_t static_##tag##_tcb
+
+#define STATIC_TASK_CREATE(tag, function, name, param, priority)                                                   \
+    xTaskCreateStatic((function), (name), sizeof(static_##tag##_stack), (param), (priority), static_##tag##_stack, \
+                      &static_##tag##_tcb)
+
+#define STATIC_QUEUE_STORAGE(tag, length, item_size)               \
+    static uint8_t static_##tag##_storage[(length) * (item_size)]; \
+    static StaticQueue_t static_##tag##_queue
+
+#define STATIC_QUEUE_CREATE(tag, length, item_size) \
+    xQueueCreateStatic((length), (item_size), static_##tag##_storage, &static_##tag##_queue)
+
+#define STATIC_SEMAPHORE_STORAGE(tag) static StaticSemaphore_t static_##tag##_semaphore
+
+#define STATIC_MUTEX_CREATE(tag) xSemaphoreCreateMutexStatic(&static_##tag##_semaphore)
+
+#define STATIC_BINARY_SEMAPHORE_CREATE(tag) xSemaphoreCreateBinaryStatic(&static_##tag##_semaphore)
+
+#define STATIC_EVENT_GROUP_STORAGE(tag) static StaticEventGroup_t static_##tag##_event_group
+
+#define STATIC_EVENT_GROUP_CREATE(tag) xEventGroupCreateStatic(&static_##tag##_event_group)
+
+#else
+
+#define STATIC_TASK_STORAGE(tag, stack_bytes) static const uint32_t static_##tag##_stack_bytes = (stack_bytes)
+
+static inline TaskHandle_t static_alloc_task_create(TaskFunction_t function, const char *name, uint32_t stack_bytes,
+                                                    void *param, UBaseType_t priority) {
+    TaskHandle_t handle = NULL;
+    return xTaskCreate(function, name, stack_bytes, param, priority, &handle) == pdPASS ? handle : NULL;
+}
+
+#define STATIC_TASK_CREATE(tag, function, name, param, priority) \
+    static_alloc_task_create((function), (name), static_##tag##_stack_bytes, (param), (priority))
+
+#define STATIC_QUEUE_STORAGE(tag, length, item_size) struct static_##tag##_unused
+#define STATIC_QUEUE_CREATE(tag, length, item_size) xQueueCreate((length), (item_size))
+
+#define STATIC_SEMAPHORE_STORAGE(tag) struct static_##tag##_unused
+#define STATIC_MUTEX_CREATE(tag) xSemaphoreCreateMutex()
+#define STATIC_BINARY_SEMAPHORE_CREATE(tag) xSemaphoreCreateBinary()
+
+#define STATIC_EVENT_GROUP_STORAGE(tag) struct static_##tag##_unused
+#define STATIC_EVENT_GROUP_CREATE(tag) xEventGroupCreate()
+
+#endif  // STATIC_ALLOCATION
+
+#endif  // SNOOPER_STATIC_ALLOC_H
@@ -0,0 +1,115 @@
+#include "status_filter.h"
+
+#include "freertos/FreeRTOS.h"
+
+static bool have_last = false;
+static led_state_t last_state = LED_OFF;
+static bool last_has_sequence = false;
+static uint32_t last_sequence = 0;
+static bool last_has_boot = false;
+static uint32_t last_boot = 0;
+static int64_t last_timestamp = 0;
+
+static status_filter_stats_t stats;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Only called when both messages have a sequence number
+static bool sender_restarted(const status_message_t *msg) {
+    if (msg->has_boot && last_has_boot) {
+        return msg->boot != last_boot;
+    }
+    return (int32_t)(msg->sequence - last_sequence) < -STATUS_SEQUENCE_WINDOW;
+}
+
+// True if the sequence says msg is not newer than the last accepted message
+static bool sequence_not_newer(const status_message_t *msg, bool *restarted) {
+    if (!msg->has_sequence || !last_has_sequence) {
+        return false;
+    }
+    if (sender_restarted(msg)) {
+        *restarted = true;
+        return false;
+    }
+    return (int32_t)(msg->sequence - last_sequence) <= 0;
+}
+
+static status_filter_result_t classify(const status_message_t *msg, time_t now, bool *restarted) {
+    if (msg->has_timestamp && STATUS_MAX_AGE_S > 0 && now > 0 && now - msg->timestamp > STATUS_MAX_AGE_S) {
+        return STATUS_FILTER_DROP_STALE;
+    }
+    if (have_last) {
+        if (msg->has_timestamp && last_timestamp != 0) {
+            if (msg->timestamp < last_timestamp) {
+                return STATUS_FILTER_DROP_STALE;
+            }
+            // A newer timestamp wins even if the sequence went backwards (sender restarted)
+            if (msg->timestamp == last_timestamp && sequence_not_newer(msg, restarted)) {
+                return STATUS_FILTER_DROP_OUT_OF_ORDER;
+            }
+        } else if (sequence_not_newer(msg, restarted)) {
+            return STATUS_FILTER_DROP_OUT_OF_ORDER;
+        }
+        if (msg->state == last_state) {
+            return STATUS_FILTER_COALESCE;
+        }
+    }
+    return STATUS_FILTER_APPLY;
+}
+
+status_filter_result_t status_filter_accept(const status_message_t *msg, time_t now) {
+    bool restarted = false;
+    status_filter_result_t result = classify(msg, now, &restarted);
+
+    if (result == STATUS_FILTER_APPLY || result == STATUS_FILTER_COALESCE) {
+        have_last = true;
+        last_state = msg->state;
+        last_has_sequence = msg->has_sequence;
+        last_sequence = msg->sequence;
+        last_has_boot = msg->has_boot;
+        last_boot = msg->boot;
+        if (msg->has_timestamp) {
+            last_timestamp = msg->timestamp;
+        }
+    }
+
+    taskENTER_CRITICAL(&stats_lock);
+    if (restarted && (result == STATUS_FILTER_APPLY || result == STATUS_FILTER_COALESCE)) {
+        stats.sender_restarts++;
+    }
+    switch (result) {
+        case STATUS_FILTER_APPLY:
+            stats.applied++;
+            break;
+        case STATUS_FILTER_COALESCE:
+            stats.coalesced++;
+            break;
+        case STATUS_FILTER_DROP_STALE:
+            stats.dropped_stale++;
+            break;
+        case STATUS_FILTER_DROP_OUT_OF_ORDER:
+            stats.dropped_out_of_order++;
+            break;
+    }
+    taskEXIT_CRITICAL(&stats_lock);
+    return result;
+}
+
+const char *status_filter_result_name(status_filter_result_t result) {
+    switch (result) {
+        case STATUS_FILTER_APPLY:
+            return "apply";
+        case STATUS_FILTER_COALESCE:
+            return "coalesce";
+        case STATUS_FILTER_DROP_STALE:
+            return "stale";
+        case STATUS_FILTER_DROP_OUT_OF_ORDER:
+            return "out-of-order";
+    }
+    return "unknown";
+}
+
+void status_filter_get_stats(status_filter_stats_t *out) {
+    taskENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    taskEXIT_CRITICAL(&stats_lock);
+}
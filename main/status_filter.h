@@ -0,0 +1,63 @@
+#ifndef SNOOPER_STATUS_FILTER_H
+#define SNOOPER_STATUS_FILTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "gecl-rgb-led-manager.h"
+
+// Status messages may carry "seq" (sender sequence number), "boot" (sender boot id) and "ts"
+// (Unix seconds). Messages that are older than the last accepted one are dropped, and a repeat
+// of the state already shown is coalesced so set_led() and the squawk path do not run again.
+// Messages without "seq" and "ts" are always treated as current.
+//
+// Sequence numbers only compare within one sender boot. A message with a different "boot", or
+// whose sequence went back by more than STATUS_SEQUENCE_WINDOW, comes from a sender that has
+// restarted and is accepted. Without "boot" or "ts", a sender that restarts within
+// STATUS_SEQUENCE_WINDOW of its last sequence is ignored until it passes that sequence again.
+
+// Drop messages whose "ts" is more than this many seconds in the past. 0 disables the check;
+// the status service only publishes on change, so an old message can still be the latest one.
+#ifndef STATUS_MAX_AGE_S
+#define STATUS_MAX_AGE_S 0
+#endif
+
+// Largest reordering or redelivery distance still treated as an old message
+#ifndef STATUS_SEQUENCE_WINDOW
+#define STATUS_SEQUENCE_WINDOW 64
+#endif
+
+typedef struct {
+    led_state_t state;
+    bool has_sequence;
+    uint32_t sequence;
+    bool has_boot;
+    uint32_t boot;
+    bool has_timestamp;
+    int64_t timestamp;
+} status_message_t;
+
+typedef enum {
+    STATUS_FILTER_APPLY = 0,
+    STATUS_FILTER_COALESCE,          // Same state as already shown
+    STATUS_FILTER_DROP_STALE,        // Timestamp older than the last accepted one, or past STATUS_MAX_AGE_S
+    STATUS_FILTER_DROP_OUT_OF_ORDER  // Same timestamp (or none), same sender boot and sequence not newer
+} status_filter_result_t;
+
+typedef struct {
+    uint32_t applied;
+    uint32_t coalesced;
+    uint32_t dropped_stale;
+    uint32_t dropped_out_of_order;
+    uint32_t sender_restarts;  // Sequence comparisons skipped for a new "boot" or a large backwards jump
+} status_filter_stats_t;
+
+// Decide what to do with msg and, unless it is dropped, remember it as the latest status.
+// now is the current Unix time, or 0 if the clock is not valid yet.
+status_filter_result_t status_filter_accept(const status_message_t *msg, time_t now);
+
+const char *status_filter_result_name(status_filter_result_t result);
+void status_filter_get_stats(status_filter_stats_t *stats);
+
+#endif  // SNOOPER_STATUS_FILTER_H
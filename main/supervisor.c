@@ -0,0 +1,180 @@
+#include "supervisor.h"
+
+#include <stdio.h>
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+
+static const char *TAG = "SUPERVISOR";
+
+static supervised_t supervised[SUPERVISOR_MAX_TASKS];
+static int supervised_count = 0;
+static portMUX_TYPE beat_lock = portMUX_INITIALIZER_UNLOCKED;
+static metric_t *restart_metric;
+
+supervised_t *supervisor_register(const char *task_name, uint32_t deadline_ms, supervisor_restart_t restart) {
+    if (supervised_count >= SUPERVISOR_MAX_TASKS) {
+        ESP_LOGE(TAG, "Too many supervised tasks, cannot register %s", task_name);
+        return NULL;
+    }
+    supervised_t *task = &supervised[supervised_count++];
+    *task = (supervised_t){.task_name = task_name, .deadline_ms = deadline_ms, .restart = restart};
+    snprintf(task->metric_name, sizeof(task->metric_name), "alive.%s", task_name);
+    task->gap_metric = metrics_gauge(task->metric_name);
+    metric_set_threshold(task->gap_metric, 1000);
+    return task;
+}
+
+void supervisor_watch_queue(supervised_t *task, QueueHandle_t queue) {
+    if (task != NULL) {
+        task->queue = queue;
+    }
+}
+
+static void beat(supervised_t *task, int64_t now) {
+    taskENTER_CRITICAL(&beat_lock);
+    uint32_t gap_ms = (uint32_t)((now - task->last_beat_us) / 1000);
+    if (gap_ms > task->worst_gap_ms) {
+        task->worst_gap_ms = gap_ms;
+    }
+    task->last_beat_us = now;
+    taskEXIT_CRITICAL(&beat_lock);
+}
+
+// Starts the deadline afresh without counting the time before as a gap
+static void start_watching(supervised_t *task) {
+    taskENTER_CRITICAL(&beat_lock);
+    task->last_beat_us = esp_timer_get_time();
+    taskEXIT_CRITICAL(&beat_lock);
+    task->queue_waiting = 0;
+    task->failed_us = 0;
+}
+
+void supervisor_heartbeat(supervised_t *task) {
+    if (task != NULL) {
+        beat(task, esp_timer_get_time());
+    }
+}
+
+static void give_up(supervised_t *task, int64_t now) {
+    if (task->failed_us == 0) {
+        task->failed_us = now;
+        ESP_LOGE(TAG, "Cannot restart %s, rebooting", task->task_name);
+        return;
+    }
+    // Normally the task watchdog has reset the device by now
+    if (now - task->failed_us >= SUPERVISOR_REBOOT_GRACE_MS * 1000LL) {
+        supervisor_log_stats();
+        esp_restart();
+    }
+}
+
+// Returns true while the task is healthy or not running, i.e. when its watchdog entry may be fed
+static bool check(supervised_t *task, int64_t now) {
+    if (xTaskGetHandle(task->task_name) == NULL) {
+        task->running = false;
+        return true;
+    }
+    if (!task->running) {
+        task->running = true;
+        start_watching(task);
+    }
+
+    if (task->queue != NULL) {
+        UBaseType_t waiting = uxQueueMessagesWaiting(task->queue);
+        if (waiting == 0 || waiting < task->queue_waiting) {
+            beat(task, now);
+        }
+        task->queue_waiting = waiting;
+    }
+
+    taskENTER_CRITICAL(&beat_lock);
+    int64_t silent_us = now - task->last_beat_us;
+    taskEXIT_CRITICAL(&beat_lock);
+    if (silent_us <= task->deadline_ms * 1000LL) {
+        return true;
+    }
+    if (task->failed_us != 0) {
+        give_up(task, now);
+        return false;
+    }
+
+    ESP_LOGE(TAG, "%s silent for %lld ms", task->task_name, silent_us / 1000);
+    if (task->window_start_us == 0 || now - task->window_start_us >= SUPERVISOR_RESTART_WINDOW_S * 1000000LL) {
+        task->window_start_us = now;
+        task->window_restarts = 0;
+    }
+    if (task->restart != NULL && task->window_restarts < SUPERVISOR_MAX_RESTARTS && task->restart()) {
+        task->window_restarts++;
+        task->restarts++;
+        metric_inc(restart_metric);
+        start_watching(task);
+        ESP_LOGW(TAG, "Restarted %s (%lu in this window)", task->task_name, (unsigned long)task->window_restarts);
+        return true;
+    }
+    give_up(task, now);
+    return false;
+}
+
+static void report_gaps(int64_t now) {
+    for (int i = 0; i < supervised_count; i++) {
+        supervised_t *task = &supervised[i];
+        taskENTER_CRITICAL(&beat_lock);
+        uint32_t worst_ms = task->worst_gap_ms;
+        uint32_t silent_ms = task->running ? (uint32_t)((now - task->last_beat_us) / 1000) : 0;
+        task->worst_gap_ms = 0;
+        taskEXIT_CRITICAL(&beat_lock);
+        // A task that has gone quiet has not closed its gap yet
+        metric_set(task->gap_metric, (int)(silent_ms > worst_ms ? silent_ms : worst_ms));
+    }
+}
+
+static void init_watchdog(void) {
+    esp_err_t err = esp_task_wdt_add(NULL);
+    if (err == ESP_ERR_INVALID_STATE) {
+        // CONFIG_ESP_TASK_WDT_INIT is off; bring it up without watching the idle task
+        esp_task_wdt_config_t config = {
+            .timeout_ms = SUPERVISOR_WDT_TIMEOUT_MS, .idle_core_mask = 0, .trigger_panic = true};
+        ESP_ERROR_CHECK(esp_task_wdt_init(&config));
+        err = esp_task_wdt_add(NULL);
+    }
+    ESP_ERROR_CHECK(err);
+    for (int i = 0; i < supervised_count; i++) {
+        ESP_ERROR_CHECK(esp_task_wdt_add_user(supervised[i].task_name, &supervised[i].wdt_user));
+    }
+}
+
+void supervisor_run(void) {
+    vTaskPrioritySet(NULL, SUPERVISOR_PRIORITY);
+    restart_metric = metrics_counter("supervisor.restarts");
+    init_watchdog();
+    ESP_LOGI(TAG, "Supervising %d tasks", supervised_count);
+
+    int64_t reported_us = esp_timer_get_time();
+    while (true) {
+        int64_t now = esp_timer_get_time();
+        for (int i = 0; i < supervised_count; i++) {
+            if (check(&supervised[i], now)) {
+                esp_task_wdt_reset_user(supervised[i].wdt_user);
+            }
+        }
+        esp_task_wdt_reset();
+
+        if (now - reported_us >= SUPERVISOR_REPORT_S * 1000000LL) {
+            reported_us = now;
+            report_gaps(now);
+        }
+        vTaskDelay(pdMS_TO_TICKS(SUPERVISOR_INTERVAL_MS));
+    }
+}
+
+void supervisor_log_stats(void) {
+    for (int i = 0; i < supervised_count; i++) {
+        const supervised_t *task = &supervised[i];
+        ESP_LOGI(TAG, "%s: %s, restarts=%lu worst_gap=%lu ms", task->task_name,
+                 task->failed_us ? "failed" : (task->running ? "running" : "stopped"),
+                 (unsigned long)task->restarts, (unsigned long)task->worst_gap_ms);
+    }
+}
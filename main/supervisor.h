@@ -0,0 +1,102 @@
+#ifndef SNOOPER_SUPERVISOR_H
+#define SNOOPER_SUPERVISOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_task_wdt.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "metrics.h"
+
+// Task supervisor, run by app_main once everything is started. Each supervised task sends a
+// heartbeat at least every deadline_ms while its task exists; tasks we cannot change (the gecl
+// LED task) are instead watched through their input queue, which counts as a
+// heartbeat whenever it is empty or shrinking. A task that misses its deadline is restarted on
+// its own through its restart callback, up to SUPERVISOR_MAX_RESTARTS per
+// SUPERVISOR_RESTART_WINDOW_S; past that, or without a callback, the device reboots. Only give
+// a callback to a task that can be deleted wherever it is stuck: a task that may hold a shared
+// mutex, the MQTT client or heap it has not handed over yet must reboot instead.
+//
+// Every supervised task is also a task watchdog user, fed by the supervisor only while the
+// task is healthy, and the supervisor subscribes itself. If the supervisor or a restart hangs,
+// the task watchdog names the culprit and resets the device.
+//
+// alive.<task> gauges report the longest gap between heartbeats over the last
+// SUPERVISOR_REPORT_S, in milliseconds.
+
+#ifndef SUPERVISOR_INTERVAL_MS
+#define SUPERVISOR_INTERVAL_MS 1000
+#endif
+
+// How often a supervised task that is waiting for work wakes up just to send a heartbeat
+#ifndef SUPERVISOR_HEARTBEAT_MS
+#define SUPERVISOR_HEARTBEAT_MS 5000
+#endif
+
+#ifndef SUPERVISOR_MAX_RESTARTS
+#define SUPERVISOR_MAX_RESTARTS 3
+#endif
+
+#ifndef SUPERVISOR_RESTART_WINDOW_S
+#define SUPERVISOR_RESTART_WINDOW_S 3600
+#endif
+
+// Only used when sdkconfig leaves the task watchdog uninitialized
+#ifndef SUPERVISOR_WDT_TIMEOUT_MS
+#define SUPERVISOR_WDT_TIMEOUT_MS 10000
+#endif
+
+// Reboot this long after giving up on a task, in case the task watchdog does not panic
+#ifndef SUPERVISOR_REBOOT_GRACE_MS
+#define SUPERVISOR_REBOOT_GRACE_MS 15000
+#endif
+
+#ifndef SUPERVISOR_REPORT_S
+#define SUPERVISOR_REPORT_S 60
+#endif
+
+// Above every application task, so a busy task cannot starve the supervisor
+#ifndef SUPERVISOR_PRIORITY
+#define SUPERVISOR_PRIORITY 10
+#endif
+
+#define SUPERVISOR_MAX_TASKS 8
+#define SUPERVISOR_METRIC_NAME_MAX 32
+
+// Deletes and recreates the task; returns false when that is not safe and only a reboot helps
+typedef bool (*supervisor_restart_t)(void);
+
+typedef struct {
+    const char *task_name;  // Not copied; use string literals
+    uint32_t deadline_ms;
+    supervisor_restart_t restart;
+    QueueHandle_t queue;  // Set for queue-watched tasks
+    UBaseType_t queue_waiting;
+    bool running;
+    int64_t last_beat_us;
+    uint32_t worst_gap_ms;  // Since the last report
+    uint32_t restarts;
+    int64_t window_start_us;
+    uint32_t window_restarts;
+    int64_t failed_us;  // When the supervisor gave up on the task, 0 while it is healthy
+    esp_task_wdt_user_handle_t wdt_user;
+    char metric_name[SUPERVISOR_METRIC_NAME_MAX];
+    metric_t *gap_metric;
+} supervised_t;
+
+// Watches the task named task_name while it exists; call before supervisor_run. Returns NULL
+// when the table is full; heartbeats on NULL are ignored.
+supervised_t *supervisor_register(const char *task_name, uint32_t deadline_ms, supervisor_restart_t restart);
+
+// Treats the queue draining as the task's heartbeat, for tasks that cannot send one
+void supervisor_watch_queue(supervised_t *task, QueueHandle_t queue);
+
+void supervisor_heartbeat(supervised_t *task);
+
+// The supervisor loop; never returns
+void supervisor_run(void);
+
+void supervisor_log_stats(void);
+
+#endif  // SNOOPER_SUPERVISOR_H
@@ -0,0 +1,63 @@
+#include "telemetry_schedule.h"
+
+#include "app_loop.h"
+#include "diagnostics.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "gecl-telemetry-manager.h"
+#include "metrics.h"
+#include "mqtt_publish.h"
+#include "payload_encoding.h"
+#include "static_alloc.h"
+
+static const char *TAG = "TELEMETRY";
+
+static esp_mqtt_client_handle_t schedule_client = NULL;
+static const char *schedule_topic = NULL;
+#if !APP_EVENT_LOOP
+STATIC_TASK_STORAGE(telemetry, 4096);
+#endif
+
+void send_telemetry_keyframe(esp_mqtt_client_handle_t client, const char *topic) {
+    // Publishes on the client directly
+    mqtt_publish_lock();
+    transmit_telemetry();
+    mqtt_publish_unlock();
+    diagnostics_sample();
+    metrics_publish(client, topic, payload_encoding(PAYLOAD_TOPIC_TELEMETRY));
+}
+
+// Runs every TELEMETRY_INTERVAL_S, on the telemetry task or on the app loop
+static void telemetry_tick(void) {
+    static uint32_t interval = 0;
+
+    if (++interval % TELEMETRY_KEYFRAME_INTERVALS == 0) {
+        send_telemetry_keyframe(schedule_client, schedule_topic);
+        return;
+    }
+    diagnostics_sample();
+    if (!metrics_publish_delta(schedule_client, schedule_topic, payload_encoding(PAYLOAD_TOPIC_TELEMETRY))) {
+        ESP_LOGD(TAG, "No metric changed past its threshold");
+    }
+}
+
+#if !APP_EVENT_LOOP
+static void telemetry_schedule_task(void *param) {
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(TELEMETRY_INTERVAL_S * 1000));
+        telemetry_tick();
+    }
+}
+#endif
+
+void start_telemetry_scheduler(esp_mqtt_client_handle_t client, const char *topic) {
+    schedule_client = client;
+    schedule_topic = topic;
+#if APP_EVENT_LOOP
+    app_loop_register(APP_LOOP_TELEMETRY, telemetry_tick);
+    app_loop_post_every(APP_LOOP_TELEMETRY, TELEMETRY_INTERVAL_S * 1000);
+#else
+    STATIC_TASK_CREATE(telemetry, &telemetry_schedule_task, "telemetry_task", NULL, 3);
+#endif
+}
@@ -0,0 +1,28 @@
+#ifndef SNOOPER_TELEMETRY_SCHEDULE_H
+#define SNOOPER_TELEMETRY_SCHEDULE_H
+
+#include "mqtt_client.h"
+
+// Scheduled telemetry. Every TELEMETRY_INTERVAL_S a delta frame with the metrics that changed
+// past their thresholds is published (nothing at all if none did); every
+// TELEMETRY_KEYFRAME_INTERVALS intervals a keyframe goes out instead: the full telemetry
+// snapshot plus every metric. Requests on the telemetry request topic still get a keyframe.
+
+#ifndef TELEMETRY_SCHEDULED
+#define TELEMETRY_SCHEDULED 1
+#endif
+
+#ifndef TELEMETRY_INTERVAL_S
+#define TELEMETRY_INTERVAL_S 300
+#endif
+
+#ifndef TELEMETRY_KEYFRAME_INTERVALS
+#define TELEMETRY_KEYFRAME_INTERVALS 12
+#endif
+
+// Sends a keyframe now
+void send_telemetry_keyframe(esp_mqtt_client_handle_t client, const char *topic);
+
+void start_telemetry_scheduler(esp_mqtt_client_handle_t client, const char *topic);
+
+#endif  // SNOOPER_TELEMETRY_SCHEDULE_H
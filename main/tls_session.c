@@ -0,0 +1,306 @@
+#include "tls_session.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/select.h>
+
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "esp_tls.h"
+#include "freertos/FreeRTOS.h"
+#include "mbedtls/ssl.h"
+
+static const char *TAG = "TLS_SESSION";
+
+typedef struct {
+    esp_tls_t *tls;
+    esp_tls_cfg_t cfg;
+} tls_session_transport_t;
+
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+#define RTC_SESSION_MAGIC 0x544c5353  // "TLSS"
+
+static esp_tls_client_session_t *cached_session = NULL;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t len;
+    uint8_t data[TLS_SESSION_RTC_BYTES];  // From mbedtls_ssl_session_save()
+    uint32_t crc;                         // Over everything before this field
+} rtc_session_t;
+
+// Not cleared by the startup code, so it survives esp_restart() and deep sleep; a power cycle
+// leaves garbage that fails the CRC
+static RTC_NOINIT_ATTR rtc_session_t rtc_session;
+
+static uint32_t rtc_session_crc(void) {
+    return esp_rom_crc32_le(0, (const uint8_t *)&rtc_session, offsetof(rtc_session_t, crc));
+}
+
+static void save_session(const esp_tls_client_session_t *session) {
+    size_t len = 0;
+    int ret = mbedtls_ssl_session_save(&session->saved_session, rtc_session.data, sizeof(rtc_session.data), &len);
+    if (ret != 0) {
+        // Most of a session is the peer certificate; CONFIG_MBEDTLS_SSL_KEEP_PEER_CERTIFICATE=n drops it
+        ESP_LOGW(TAG, "Session not kept across restarts (%d bytes needed, -0x%04x)", (int)len, -ret);
+        rtc_session.magic = 0;
+        return;
+    }
+    rtc_session.magic = RTC_SESSION_MAGIC;
+    rtc_session.len = len;
+    rtc_session.crc = rtc_session_crc();
+}
+
+static void restore_session(void) {
+    if (rtc_session.magic != RTC_SESSION_MAGIC || rtc_session.len > sizeof(rtc_session.data) ||
+        rtc_session.crc != rtc_session_crc()) {
+        return;
+    }
+    esp_tls_client_session_t *session = calloc(1, sizeof(esp_tls_client_session_t));
+    if (session == NULL) {
+        return;
+    }
+    mbedtls_ssl_session_init(&session->saved_session);
+    int ret = mbedtls_ssl_session_load(&session->saved_session, rtc_session.data, rtc_session.len);
+    if (ret != 0) {
+        // Saved by a build with a different mbedtls configuration
+        ESP_LOGW(TAG, "Discarding the session kept across the restart (-0x%04x)", -ret);
+        esp_tls_free_client_session(session);
+        rtc_session.magic = 0;
+        return;
+    }
+    cached_session = session;
+    ESP_LOGI(TAG, "Restored the previous TLS session (%lu bytes)", (unsigned long)rtc_session.len);
+}
+
+// An abbreviated TLS 1.2 handshake carries the resumed session's master secret over; when the
+// broker turns the ticket or session ID down, the full handshake derives a new one
+static bool session_resumed(const esp_tls_client_session_t *offered, const esp_tls_client_session_t *negotiated) {
+    return memcmp(offered->saved_session.MBEDTLS_PRIVATE(master), negotiated->saved_session.MBEDTLS_PRIVATE(master),
+                  sizeof(offered->saved_session.MBEDTLS_PRIVATE(master))) == 0;
+}
+#endif
+static tls_session_stats_t stats;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static int tls_session_poll(esp_transport_handle_t t, int timeout_ms, bool for_write) {
+    tls_session_transport_t *ctx = esp_transport_get_context_data(t);
+    int sockfd;
+    if (ctx->tls == NULL || esp_tls_get_conn_sockfd(ctx->tls, &sockfd) != ESP_OK) {
+        return -1;
+    }
+    // Data already decrypted and buffered inside mbedtls will not show up on the socket
+    if (!for_write && esp_tls_get_bytes_avail(ctx->tls) > 0) {
+        return 1;
+    }
+
+    fd_set fds;
+    fd_set errfds;
+    FD_ZERO(&fds);
+    FD_ZERO(&errfds);
+    FD_SET(sockfd, &fds);
+    FD_SET(sockfd, &errfds);
+    struct timeval timeout = {.tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000};
+    int ret = select(sockfd + 1, for_write ? NULL : &fds, for_write ? &fds : NULL, &errfds,
+                     timeout_ms < 0 ? NULL : &timeout);
+    if (ret > 0 && FD_ISSET(sockfd, &errfds)) {
+        return -1;
+    }
+    return ret;
+}
+
+static int tls_session_poll_read(esp_transport_handle_t t, int timeout_ms) {
+    return tls_session_poll(t, timeout_ms, false);
+}
+
+static int tls_session_poll_write(esp_transport_handle_t t, int timeout_ms) {
+    return tls_session_poll(t, timeout_ms, true);
+}
+
+static void tls_session_record(bool offered, bool resumed, int64_t handshake_us, int heap_bytes) {
+    taskENTER_CRITICAL(&stats_lock);
+    if (resumed) {
+        stats.resumed_handshakes++;
+        stats.resumed_handshake_us += handshake_us;
+    } else {
+        stats.resume_declined += offered;
+        stats.full_handshakes++;
+        stats.full_handshake_us += handshake_us;
+    }
+    stats.last_handshake_heap_bytes = heap_bytes > 0 ? heap_bytes : 0;
+    taskEXIT_CRITICAL(&stats_lock);
+}
+
+static int tls_session_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms) {
+    tls_session_transport_t *ctx = esp_transport_get_context_data(t);
+    bool resuming = false;
+
+    ctx->tls = esp_tls_init();
+    if (ctx->tls == NULL) {
+        return -1;
+    }
+    ctx->cfg.timeout_ms = timeout_ms;
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    ctx->cfg.client_session = cached_session;
+    resuming = cached_session != NULL;
+#endif
+    if (resuming) {
+        taskENTER_CRITICAL(&stats_lock);
+        stats.resume_attempts++;
+        taskEXIT_CRITICAL(&stats_lock);
+    }
+
+    // The minimum free heap is tracked from here on, so the handshake's peak use can be read off
+    // it; the connection's buffers that stay allocated afterwards are only part of it
+    size_t heap_before = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    bool heap_monitored = heap_caps_monitor_local_minimum_free_size_start() == ESP_OK;
+    int64_t start_us = esp_timer_get_time();
+    int connected = esp_tls_conn_new_sync(host, strlen(host), port, &ctx->cfg, ctx->tls);
+    size_t heap_low = heap_monitored ? heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT)
+                                     : heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    if (heap_monitored) {
+        heap_caps_monitor_local_minimum_free_size_stop();
+    }
+    if (connected <= 0) {
+        ESP_LOGE(TAG, "TLS connect to %s:%d failed%s", host, port, resuming ? " (resumed session)" : "");
+        if (resuming) {
+            // A session the broker no longer accepts must not poison every following attempt
+            taskENTER_CRITICAL(&stats_lock);
+            stats.resume_failures++;
+            taskEXIT_CRITICAL(&stats_lock);
+            tls_session_forget();
+        }
+        esp_tls_conn_destroy(ctx->tls);
+        ctx->tls = NULL;
+        return -1;
+    }
+    int64_t handshake_us = esp_timer_get_time() - start_us;
+    bool resumed = false;
+
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    // Keep the freshest session; a resumed connect may have been handed a new ticket
+    esp_tls_client_session_t *session = esp_tls_get_client_session(ctx->tls);
+    if (session != NULL) {
+        resumed = resuming && session_resumed(cached_session, session);
+        tls_session_forget();
+        cached_session = session;
+        save_session(session);
+    }
+#endif
+    tls_session_record(resuming, resumed, handshake_us, (int)heap_before - (int)heap_low);
+    ESP_LOGI(TAG, "%s handshake with %s took %lld ms%s", resumed ? "Resumed" : "Full", host, handshake_us / 1000,
+             resuming && !resumed ? " (resumption declined)" : "");
+    return 0;
+}
+
+static int tls_session_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms) {
+    tls_session_transport_t *ctx = esp_transport_get_context_data(t);
+    int poll = tls_session_poll_read(t, timeout_ms);
+    if (poll <= 0) {
+        return poll == 0 ? ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT : ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+    }
+    ssize_t ret = esp_tls_conn_read(ctx->tls, buffer, len);
+    if (ret == ESP_TLS_ERR_SSL_WANT_READ || ret == ESP_TLS_ERR_SSL_TIMEOUT) {
+        return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+    }
+    if (ret == 0) {
+        return ERR_TCP_TRANSPORT_CONNECTION_CLOSED_BY_FIN;
+    }
+    return ret < 0 ? ERR_TCP_TRANSPORT_CONNECTION_FAILED : ret;
+}
+
+static int tls_session_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms) {
+    tls_session_transport_t *ctx = esp_transport_get_context_data(t);
+    int poll = tls_session_poll_write(t, timeout_ms);
+    if (poll <= 0) {
+        ESP_LOGW(TAG, "Poll for write failed or timed out (%d)", poll);
+        return poll;
+    }
+    ssize_t ret = esp_tls_conn_write(ctx->tls, buffer, len);
+    if (ret == ESP_TLS_ERR_SSL_WANT_WRITE) {
+        return 0;
+    }
+    return ret;
+}
+
+static int tls_session_close(esp_transport_handle_t t) {
+    tls_session_transport_t *ctx = esp_transport_get_context_data(t);
+    int ret = 0;
+    if (ctx->tls != NULL) {
+        ret = esp_tls_conn_destroy(ctx->tls);
+        ctx->tls = NULL;
+    }
+    return ret;
+}
+
+static int tls_session_destroy(esp_transport_handle_t t) {
+    tls_session_close(t);
+    free(esp_transport_get_context_data(t));
+    return 0;
+}
+
+esp_transport_handle_t tls_session_transport_init(const tls_session_config_t *config) {
+    esp_transport_handle_t t = esp_transport_init();
+    tls_session_transport_t *ctx = calloc(1, sizeof(tls_session_transport_t));
+    if (t == NULL || ctx == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate TLS session transport");
+        free(ctx);
+        if (t != NULL) {
+            esp_transport_destroy(t);
+        }
+        return NULL;
+    }
+
+    // esp-tls wants the buffer length including the PEM terminator
+    ctx->cfg.cacert_buf = (const unsigned char *)config->ca_cert;
+    ctx->cfg.cacert_bytes = strlen(config->ca_cert) + 1;
+    ctx->cfg.clientcert_buf = (const unsigned char *)config->client_cert;
+    ctx->cfg.clientcert_bytes = strlen(config->client_cert) + 1;
+    ctx->cfg.clientkey_buf = (const unsigned char *)config->client_key;
+    ctx->cfg.clientkey_bytes = strlen(config->client_key) + 1;
+
+    esp_transport_set_context_data(t, ctx);
+    esp_transport_set_func(t, tls_session_connect, tls_session_read, tls_session_write, tls_session_close,
+                           tls_session_poll_read, tls_session_poll_write, tls_session_destroy);
+    esp_transport_set_default_port(t, 8883);
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    if (cached_session == NULL) {
+        restore_session();
+    }
+#endif
+    return t;
+}
+
+void tls_session_forget(void) {
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    if (cached_session != NULL) {
+        esp_tls_free_client_session(cached_session);
+        cached_session = NULL;
+    }
+    rtc_session.magic = 0;
+#endif
+}
+
+void tls_session_get_stats(tls_session_stats_t *out) {
+    taskENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    taskEXIT_CRITICAL(&stats_lock);
+}
+
+void tls_session_log_stats(void) {
+    tls_session_stats_t snapshot;
+    tls_session_get_stats(&snapshot);
+
+    ESP_LOGI(TAG,
+             "Full handshakes=%lu mean=%llu ms, resumed=%lu mean=%llu ms, resumes declined=%lu failed=%lu, "
+             "heap peak=%lu bytes",
+             (unsigned long)snapshot.full_handshakes,
+             snapshot.full_handshakes ? snapshot.full_handshake_us / snapshot.full_handshakes / 1000 : 0,
+             (unsigned long)snapshot.resumed_handshakes,
+             snapshot.resumed_handshakes ? snapshot.resumed_handshake_us / snapshot.resumed_handshakes / 1000 : 0,
+             (unsigned long)snapshot.resume_declined, (unsigned long)snapshot.resume_failures,
+             (unsigned long)snapshot.last_handshake_heap_bytes);
+}
@@ -0,0 +1,43 @@
+#ifndef SNOOPER_TLS_SESSION_H
+#define SNOOPER_TLS_SESSION_H
+
+#include <stdint.h>
+
+#include "esp_transport.h"
+
+// MQTT transport that resumes the previous TLS session (ticket or session ID) on reconnect
+// instead of repeating the full mutual-auth handshake. Needs CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS;
+// without it the transport still works but every connect is a full handshake.
+//
+// The session is also serialized into RTC memory, so the first connect after esp_restart() or
+// deep sleep can resume too. That copy holds the session's master secret in plain RAM.
+
+// Room for the serialized session; most of it is the broker's certificate
+#ifndef TLS_SESSION_RTC_BYTES
+#define TLS_SESSION_RTC_BYTES 2048
+#endif
+
+typedef struct {
+    const char *ca_cert;      // PEM, NUL terminated
+    const char *client_cert;  // PEM, NUL terminated
+    const char *client_key;   // PEM, NUL terminated
+} tls_session_config_t;
+
+typedef struct {
+    uint32_t full_handshakes;
+    uint32_t resumed_handshakes;
+    uint32_t resume_attempts;
+    uint32_t resume_declined;  // Resumption offered, but the broker ran a full handshake
+    uint32_t resume_failures;  // Resumption offered but the connect failed; the cached session is dropped
+    uint64_t full_handshake_us;
+    uint64_t resumed_handshake_us;
+    uint32_t last_handshake_heap_bytes;  // Peak heap use during the most recent handshake
+} tls_session_stats_t;
+
+esp_transport_handle_t tls_session_transport_init(const tls_session_config_t *config);
+
+void tls_session_forget(void);
+void tls_session_get_stats(tls_session_stats_t *stats);
+void tls_session_log_stats(void);
+
+#endif  // SNOOPER_TLS_SESSION_H
@@ -0,0 +1,185 @@
+#include "wall_clock.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_sntp.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "gecl-time-sync-manager.h"
+#include "nvs.h"
+
+static const char *TAG = "WALL_CLOCK";
+
+#define WALL_CLOCK_MAGIC 0x434c4f4b  // "CLOK"
+#define WALL_CLOCK_NAMESPACE "wall_clock"
+#define DRIFT_KEY "drift_ppb"
+#define VALID_EPOCH_US (1609459200LL * 1000000)  // 2021-01-01; anything earlier means the clock is not set
+
+// Syncs closer together than this say little about drift
+#define DRIFT_MIN_INTERVAL_US (10LL * 60 * 1000000)
+
+// SNTP keeps resyncing in the background (CONFIG_LWIP_SNTP_UPDATE_DELAY); checked this often
+#define SYNC_POLL_INTERVAL_US (60LL * 1000000)
+
+typedef struct {
+    uint32_t magic;
+    int32_t drift_ppb;
+    int64_t synced_us;     // Wall clock at the last SNTP sync
+    int64_t corrected_us;  // Wall clock up to which drift has been compensated for
+    int64_t applied_us;    // Drift corrections applied since the last sync
+    uint32_t crc;          // Over everything before this field
+} wall_clock_record_t;
+
+// Not cleared by the startup code, so it is still there after a warm reset
+static RTC_NOINIT_ATTR wall_clock_record_t record;
+static bool record_valid = false;
+static wall_clock_stats_t stats = {.uncertainty_ms = -1};
+static bool first_sync = true;
+static esp_timer_handle_t poll_timer = NULL;
+
+static uint32_t record_crc(const wall_clock_record_t *r) {
+    return esp_rom_crc32_le(0, (const uint8_t *)r, offsetof(wall_clock_record_t, crc));
+}
+
+static int64_t now_us(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void set_now_us(int64_t us) {
+    struct timeval tv = {.tv_sec = us / 1000000, .tv_usec = us % 1000000};
+    settimeofday(&tv, NULL);
+}
+
+static void save_record(void) {
+    record.magic = WALL_CLOCK_MAGIC;
+    record.crc = record_crc(&record);
+    record_valid = true;
+}
+
+static int32_t load_drift(void) {
+    nvs_handle_t handle;
+    int32_t drift_ppb = 0;
+
+    if (nvs_open(WALL_CLOCK_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+        nvs_get_i32(handle, DRIFT_KEY, &drift_ppb);
+        nvs_close(handle);
+    }
+    return drift_ppb;
+}
+
+static void persist_drift(int32_t drift_ppb) {
+    nvs_handle_t handle;
+
+    if (nvs_open(WALL_CLOCK_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        return;
+    }
+    if (nvs_set_i32(handle, DRIFT_KEY, drift_ppb) != ESP_OK || nvs_commit(handle) != ESP_OK) {
+        ESP_LOGW(TAG, "Could not persist drift estimate");
+    }
+    nvs_close(handle);
+}
+
+bool wall_clock_restore(void) {
+    // RTC memory holds garbage after power-on; the CRC catches that
+    record_valid = record.magic == WALL_CLOCK_MAGIC && record.crc == record_crc(&record);
+    if (!record_valid) {
+        stats.drift_ppb = load_drift();
+        return false;
+    }
+    stats.drift_ppb = record.drift_ppb;
+
+    int64_t now = now_us();
+    // The system time should have carried on from the last sync; if not, the RTC was reset
+    if (!WALL_CLOCK_RESTORE_ENABLED || now < VALID_EPOCH_US || now < record.synced_us) {
+        return false;
+    }
+
+    // A positive drift means the local clock loses time, so it is moved forward
+    int64_t correction_us = (now - record.corrected_us) / 1000 * record.drift_ppb / 1000000;
+    set_now_us(now + correction_us);
+    record.corrected_us = now + correction_us;
+    record.applied_us += correction_us;
+    save_record();
+
+    int64_t elapsed_s = (now - record.synced_us) / 1000000;
+    stats.uncertainty_ms = WALL_CLOCK_SYNC_ERROR_MS + elapsed_s * WALL_CLOCK_DRIFT_BOUND_PPM / 1000;
+    stats.restored = stats.uncertainty_ms <= WALL_CLOCK_MAX_UNCERTAINTY_MS;
+    ESP_LOGI(TAG, "Clock %s from RTC: synced %lld s ago, drift %ld ppb, corrected %lld ms, uncertainty %lld ms",
+             stats.restored ? "restored" : "too uncertain to restore", elapsed_s, (long)record.drift_ppb,
+             correction_us / 1000, stats.uncertainty_ms);
+    return stats.restored;
+}
+
+// The background syncs step the clock inside lwIP, so only the sync time is refreshed; the
+// drift is measured by the sync in wall_clock_synchronize()
+static void poll_sync(void *arg) {
+    if (sntp_get_sync_status() != SNTP_SYNC_STATUS_COMPLETED) {
+        return;
+    }
+    int64_t now = now_us();
+    record.synced_us = now;
+    record.corrected_us = now;
+    record.applied_us = 0;
+    save_record();
+    stats.syncs++;
+}
+
+void wall_clock_synchronize(void) {
+    int64_t before_us = now_us();
+    int64_t start_us = esp_timer_get_time();
+
+    synchronize_time();
+
+    if (poll_timer == NULL) {
+        const esp_timer_create_args_t args = {.callback = &poll_sync, .name = "clock_poll"};
+        ESP_ERROR_CHECK(esp_timer_create(&args, &poll_timer));
+        ESP_ERROR_CHECK(esp_timer_start_periodic(poll_timer, SYNC_POLL_INTERVAL_US));
+    }
+
+    // A restored clock is valid whether or not SNTP answered, so ask lwIP whether it did
+    int64_t after_us = now_us();
+    if (after_us < VALID_EPOCH_US || esp_sntp_getreachability(0) == 0) {
+        ESP_LOGW(TAG, "SNTP did not answer; the clock is %s", after_us < VALID_EPOCH_US ? "not set" : "unrefined");
+        return;
+    }
+
+    // Where the clock would be without SNTP; the difference is the step it applied
+    int64_t offset_us = before_us >= VALID_EPOCH_US ? after_us - (before_us + esp_timer_get_time() - start_us) : 0;
+    if (first_sync && before_us >= VALID_EPOCH_US) {
+        stats.correction_ms = offset_us / 1000;
+        ESP_LOGI(TAG, "SNTP moved the %s clock by %lld ms", stats.restored ? "restored" : "running",
+                 stats.correction_ms);
+    }
+    first_sync = false;
+
+    // The offset accumulated since the last sync gives the drift; smoothed, since one sync
+    // carries up to WALL_CLOCK_SYNC_ERROR_MS of network jitter
+    int64_t interval_us = record_valid ? before_us - record.synced_us : 0;
+    if (record_valid && before_us >= VALID_EPOCH_US && interval_us >= DRIFT_MIN_INTERVAL_US) {
+        // Corrections made at restore time were part of the drift too
+        int64_t drifted_us = offset_us + record.applied_us;
+        int32_t measured_ppb = (int32_t)(drifted_us * 1000000 / (interval_us / 1000));
+        int32_t drift_ppb = record.drift_ppb + (measured_ppb - record.drift_ppb) / 4;
+        if (abs(drift_ppb - record.drift_ppb) > 1000) {
+            persist_drift(drift_ppb);
+        }
+        record.drift_ppb = drift_ppb;
+        stats.drift_ppb = drift_ppb;
+    } else if (!record_valid) {
+        record.drift_ppb = stats.drift_ppb;
+    }
+    record.synced_us = after_us;
+    record.corrected_us = after_us;
+    record.applied_us = 0;
+    save_record();
+    stats.syncs++;
+}
+
+void wall_clock_get_stats(wall_clock_stats_t *out) { *out = stats; }
@@ -0,0 +1,51 @@
+#ifndef SNOOPER_WALL_CLOCK_H
+#define SNOOPER_WALL_CLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Wall clock carried across warm resets. The system time keeps running through esp_restart(),
+// panics and watchdog resets, but synchronize_time() still blocks until SNTP answers. After
+// each sync the sync time and a drift estimate are kept in RTC memory (and the drift in NVS,
+// so it survives power loss). On a warm reset the clock is drift-corrected and trusted straight
+// away, as long as its worst-case error stays under WALL_CLOCK_MAX_UNCERTAINTY_MS; SNTP then
+// refines it in the background. After power-on there is nothing to restore and boot waits for
+// SNTP as before.
+
+#ifndef WALL_CLOCK_RESTORE_ENABLED
+#define WALL_CLOCK_RESTORE_ENABLED 1
+#endif
+
+// Certificate dates are checked to the second; a few seconds off is harmless
+#ifndef WALL_CLOCK_MAX_UNCERTAINTY_MS
+#define WALL_CLOCK_MAX_UNCERTAINTY_MS 10000
+#endif
+
+// Error of an SNTP sync over Wi-Fi
+#ifndef WALL_CLOCK_SYNC_ERROR_MS
+#define WALL_CLOCK_SYNC_ERROR_MS 100
+#endif
+
+// Residual drift once the measured drift is compensated for
+#ifndef WALL_CLOCK_DRIFT_BOUND_PPM
+#define WALL_CLOCK_DRIFT_BOUND_PPM 50
+#endif
+
+typedef struct {
+    bool restored;           // The clock was trusted at boot without waiting for SNTP
+    int32_t drift_ppb;       // Measured drift, positive when the local clock runs slow
+    int64_t uncertainty_ms;  // Worst-case error at boot, -1 if there was nothing to restore
+    int64_t correction_ms;   // Step applied by the first SNTP sync after boot
+    uint32_t syncs;
+} wall_clock_stats_t;
+
+// Call early in app_main, after NVS is initialized. Returns true if the clock was restored and
+// can be used before SNTP.
+bool wall_clock_restore(void);
+
+// Runs synchronize_time() and records the correction SNTP made, for the drift estimate
+void wall_clock_synchronize(void);
+
+void wall_clock_get_stats(wall_clock_stats_t *stats);
+
+#endif  // SNOOPER_WALL_CLOCK_H
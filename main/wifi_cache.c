@@ -0,0 +1,417 @@
+#include "wifi_cache.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_attr.h"
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "metrics.h"
+#include "nvs.h"
+#include "static_alloc.h"
+
+static const char *TAG = "WIFI_CACHE";
+
+#define WIFI_CACHE_MAGIC 0x57464943  // "WFIC"
+#define WIFI_CACHE_NAMESPACE "wifi_cache"
+#define WIFI_CACHE_KEY "entry"
+#define VALID_EPOCH_SECONDS 1609459200  // 2021-01-01; anything earlier means the clock is not set
+
+#define JOINED_BIT (1 << 0)
+#define FAILED_BIT (1 << 1)
+
+typedef struct {
+    uint32_t magic;
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t reserved;
+    uint32_t ip;      // As in esp_ip4_addr_t, network order
+    int64_t saved_s;  // Wall clock when saved, 0 if it was not set
+    uint32_t crc;     // Over everything before this field
+} wifi_cache_entry_t;
+
+// Not cleared by the startup code, so it is still there after esp_restart()
+static RTC_NOINIT_ATTR wifi_cache_entry_t rtc_entry;
+// Written by on_got_ip() on the default event loop, read by whichever task joins
+static portMUX_TYPE entry_lock = portMUX_INITIALIZER_UNLOCKED;
+static wifi_cache_entry_t entry;
+static bool entry_valid = false;
+
+static EventGroupHandle_t join_events = NULL;
+STATIC_EVENT_GROUP_STORAGE(join_events);
+static bool handlers_registered = false;
+
+// Attempt in progress, shared with the event handlers on the default event loop
+static portMUX_TYPE attempt_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t attempt_start_us = 0;
+static int64_t associated_us = 0;
+static wifi_join_mode_t attempt_mode = WIFI_JOIN_SCAN;
+static bool cached_join_pending = false;
+static bool bssid_locked = false;
+// Set by wifi_cache_prepare() until wifi_init_sta() configures the station
+static bool boot_lock_armed = false;
+
+static wifi_cache_stats_t stats;
+static metric_t *assoc_metric;
+static metric_t *dhcp_metric;
+static metric_t *miss_metric;
+
+static const char *mode_names[WIFI_JOIN_COUNT] = {"scan", "cached"};
+
+static uint32_t entry_crc(const wifi_cache_entry_t *e) {
+    return esp_rom_crc32_le(0, (const uint8_t *)e, offsetof(wifi_cache_entry_t, crc));
+}
+
+static bool entry_ok(const wifi_cache_entry_t *e) { return e->magic == WIFI_CACHE_MAGIC && e->crc == entry_crc(e); }
+
+static int64_t wall_clock_s(void) {
+    time_t now = time(NULL);
+    return now >= VALID_EPOCH_SECONDS ? (int64_t)now : 0;
+}
+
+// Copies the entry, returning false if there is none
+static bool get_entry(wifi_cache_entry_t *out) {
+    taskENTER_CRITICAL(&entry_lock);
+    bool valid = entry_valid;
+    *out = entry;
+    taskEXIT_CRITICAL(&entry_lock);
+    return valid;
+}
+
+static bool entry_usable(void) {
+    wifi_cache_entry_t current;
+    if (!get_entry(&current)) {
+        return false;
+    }
+    int64_t now = wall_clock_s();
+    if (now == 0 || current.saved_s == 0) {
+        return true;  // Age unknown; a stale entry costs one failed join
+    }
+    return now - current.saved_s <= WIFI_CACHE_MAX_AGE_S;
+}
+
+static void save_entry(const uint8_t *bssid, uint8_t channel, uint32_t ip) {
+    wifi_cache_entry_t updated = {.magic = WIFI_CACHE_MAGIC, .channel = channel, .ip = ip, .saved_s = wall_clock_s()};
+    memcpy(updated.bssid, bssid, sizeof(updated.bssid));
+    updated.crc = entry_crc(&updated);
+
+    taskENTER_CRITICAL(&entry_lock);
+    bool changed = !entry_valid || memcmp(entry.bssid, bssid, sizeof(entry.bssid)) != 0 || entry.channel != channel;
+    entry = updated;
+    entry_valid = true;
+    rtc_entry = updated;
+    taskEXIT_CRITICAL(&entry_lock);
+    // Flash is only written when the AP changes. The RTC copy keeps the age and lease current
+    // across restarts, and after power loss the NVS age cannot be checked until SNTP has run.
+    if (!changed) {
+        return;
+    }
+
+    nvs_handle_t handle;
+    if (nvs_open(WIFI_CACHE_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        ESP_LOGW(TAG, "Could not open NVS, cache not persisted");
+        return;
+    }
+    if (nvs_set_blob(handle, WIFI_CACHE_KEY, &updated, sizeof(updated)) != ESP_OK || nvs_commit(handle) != ESP_OK) {
+        ESP_LOGW(TAG, "Could not persist cache");
+    }
+    nvs_close(handle);
+}
+
+static void invalidate(void) {
+    taskENTER_CRITICAL(&entry_lock);
+    entry_valid = false;
+    rtc_entry.magic = 0;
+    taskEXIT_CRITICAL(&entry_lock);
+
+    nvs_handle_t handle;
+    if (nvs_open(WIFI_CACHE_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK) {
+        nvs_erase_key(handle, WIFI_CACHE_KEY);
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+}
+
+// Pins the station to the cached BSSID and channel, which skips the all-channel scan
+static void apply_bssid_lock(wifi_config_t *config, const wifi_cache_entry_t *cached) {
+    config->sta.bssid_set = cached != NULL;
+    config->sta.channel = 0;
+    if (cached != NULL) {
+        memcpy(config->sta.bssid, cached->bssid, sizeof(cached->bssid));
+        config->sta.channel = cached->channel;
+    }
+}
+
+static void set_bssid_lock(bool lock) {
+    wifi_config_t config;
+    wifi_cache_entry_t cached;
+
+    if (esp_wifi_get_config(WIFI_IF_STA, &config) != ESP_OK) {
+        return;
+    }
+    if (lock && !get_entry(&cached)) {
+        return;
+    }
+    apply_bssid_lock(&config, lock ? &cached : NULL);
+    if (esp_wifi_set_config(WIFI_IF_STA, &config) == ESP_OK) {
+        taskENTER_CRITICAL(&attempt_lock);
+        bssid_locked = lock;
+        taskEXIT_CRITICAL(&attempt_lock);
+    }
+}
+
+static void begin_attempt(wifi_join_mode_t mode, int64_t started_us) {
+    taskENTER_CRITICAL(&attempt_lock);
+    attempt_mode = mode;
+    attempt_start_us = started_us;
+    associated_us = 0;
+    cached_join_pending = mode == WIFI_JOIN_CACHED;
+    taskEXIT_CRITICAL(&attempt_lock);
+    xEventGroupClearBits(join_events, JOINED_BIT | FAILED_BIT);
+}
+
+static void on_wifi_event(void *arg, esp_event_base_t base, int32_t id, void *data) {
+    int64_t now = esp_timer_get_time();
+
+    if (id == WIFI_EVENT_STA_CONNECTED) {
+        int64_t assoc_us = -1;
+        wifi_join_mode_t mode;
+        taskENTER_CRITICAL(&attempt_lock);
+        mode = attempt_mode;
+        if (attempt_start_us != 0 && associated_us == 0) {
+            associated_us = now;
+            assoc_us = now - attempt_start_us;
+            stats.joins[mode]++;
+            stats.assoc_ms[mode] += assoc_us / 1000;
+        }
+        taskEXIT_CRITICAL(&attempt_lock);
+        if (assoc_us >= 0) {
+            metric_set(assoc_metric, (int)(assoc_us / 1000));
+            ESP_LOGI(TAG, "Associated (%s) in %lld ms", mode_names[mode], assoc_us / 1000);
+        }
+        xEventGroupSetBits(join_events, JOINED_BIT);
+    } else if (id == WIFI_EVENT_STA_DISCONNECTED) {
+        const wifi_event_sta_disconnected_t *event = data;
+        if (event->reason == WIFI_REASON_ASSOC_LEAVE) {
+            return;  // Our own esp_wifi_disconnect()
+        }
+        taskENTER_CRITICAL(&attempt_lock);
+        bool pending = cached_join_pending;
+        bool locked = bssid_locked;
+        taskEXIT_CRITICAL(&attempt_lock);
+        if (pending) {
+            xEventGroupSetBits(join_events, FAILED_BIT);
+        } else if (locked) {
+            // Lost the cached AP after joining it; let later retries scan and roam
+            set_bssid_lock(false);
+        }
+    }
+}
+
+static void on_got_ip(void *arg, esp_event_base_t base, int32_t id, void *data) {
+    const ip_event_got_ip_t *event = data;
+    int64_t now = esp_timer_get_time();
+    int64_t dhcp_us = -1;
+    wifi_join_mode_t mode;
+
+    taskENTER_CRITICAL(&attempt_lock);
+    mode = attempt_mode;
+    if (attempt_start_us != 0 && associated_us != 0) {
+        dhcp_us = now - associated_us;
+        stats.dhcp_count[mode]++;
+        stats.dhcp_ms[mode] += dhcp_us / 1000;
+    }
+    attempt_start_us = 0;
+    taskEXIT_CRITICAL(&attempt_lock);
+
+    wifi_cache_entry_t cached;
+    bool reused = get_entry(&cached) && cached.ip == event->ip_info.ip.addr;
+    if (reused) {
+        taskENTER_CRITICAL(&attempt_lock);
+        stats.leases_reused++;
+        taskEXIT_CRITICAL(&attempt_lock);
+    }
+
+    if (dhcp_us >= 0) {
+        metric_set(dhcp_metric, (int)(dhcp_us / 1000));
+        ESP_LOGI(TAG, "Address (%s) in %lld ms, lease %s", mode_names[mode], dhcp_us / 1000,
+                 reused ? "reused" : "new");
+    }
+
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
+        save_entry(ap.bssid, ap.primary, event->ip_info.ip.addr);
+    }
+}
+
+void init_wifi_cache(void) {
+    const char *source = "RTC";
+
+    assoc_metric = metrics_gauge("wifi.assoc_ms");
+    dhcp_metric = metrics_gauge("wifi.dhcp_ms");
+    miss_metric = metrics_counter("wifi.cache_misses");
+
+#if WIFI_CACHE_ENABLED && !CONFIG_LWIP_DHCP_RESTORE_LAST_IP
+    // The cache does not request the old address itself; without this lwIP always runs discovery
+    ESP_LOGW(TAG, "CONFIG_LWIP_DHCP_RESTORE_LAST_IP is off, the IP address is not reused");
+#endif
+
+    join_events = STATIC_EVENT_GROUP_CREATE(join_events);
+    if (join_events == NULL) {
+        ESP_LOGE(TAG, "Failed to create join event group");
+        esp_restart();
+    }
+
+    // RTC memory holds garbage after power-on; the CRC catches that
+    if (entry_ok(&rtc_entry)) {
+        entry = rtc_entry;
+        entry_valid = true;
+    } else {
+        nvs_handle_t handle;
+        size_t size = sizeof(entry);
+        source = "NVS";
+        if (nvs_open(WIFI_CACHE_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+            entry_valid = nvs_get_blob(handle, WIFI_CACHE_KEY, &entry, &size) == ESP_OK && size == sizeof(entry) &&
+                          entry_ok(&entry);
+            nvs_close(handle);
+        }
+    }
+    if (entry_valid) {
+        ESP_LOGI(TAG, "Cached AP %02x:%02x:%02x:%02x:%02x:%02x channel %u from %s", entry.bssid[0], entry.bssid[1],
+                 entry.bssid[2], entry.bssid[3], entry.bssid[4], entry.bssid[5], entry.channel, source);
+    }
+}
+
+static void register_handlers(void) {
+    if (handlers_registered) {
+        return;
+    }
+    if (esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &on_wifi_event, NULL) == ESP_OK &&
+        esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &on_got_ip, NULL) == ESP_OK) {
+        handlers_registered = true;
+    }
+}
+
+// gecl-wifi-manager builds its own wifi_config_t, so the cached BSSID and channel are added on
+// the way through; its first esp_wifi_connect() then goes straight to the cached AP. Linked in
+// with -Wl,--wrap=esp_wifi_set_config.
+esp_err_t __real_esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf);
+
+esp_err_t __wrap_esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf) {
+    wifi_cache_entry_t cached;
+
+    taskENTER_CRITICAL(&attempt_lock);
+    bool armed = boot_lock_armed && interface == WIFI_IF_STA;
+    boot_lock_armed &= !armed;
+    taskEXIT_CRITICAL(&attempt_lock);
+    if (!armed || !get_entry(&cached)) {
+        return __real_esp_wifi_set_config(interface, conf);
+    }
+
+    // The default event loop exists by now and the station has not started
+    register_handlers();
+    wifi_config_t locked = *conf;
+    apply_bssid_lock(&locked, &cached);
+    esp_err_t err = __real_esp_wifi_set_config(interface, &locked);
+    taskENTER_CRITICAL(&attempt_lock);
+    bssid_locked = err == ESP_OK;
+    cached_join_pending = err == ESP_OK;
+    taskEXIT_CRITICAL(&attempt_lock);
+    return err;
+}
+
+void wifi_cache_prepare(int64_t started_us) {
+    if (!WIFI_CACHE_ENABLED || !entry_usable()) {
+        begin_attempt(WIFI_JOIN_SCAN, started_us);
+        return;
+    }
+    begin_attempt(WIFI_JOIN_CACHED, started_us);
+    taskENTER_CRITICAL(&attempt_lock);
+    // Pending once the lock is in the station config
+    cached_join_pending = false;
+    boot_lock_armed = true;
+    taskEXIT_CRITICAL(&attempt_lock);
+}
+
+bool wifi_cache_connect(int64_t started_us) {
+    // Usually done already by wifi_init_sta() going through the wrapper
+    register_handlers();
+    if (!handlers_registered) {
+        ESP_LOGE(TAG, "Failed to register event handlers");
+        return false;
+    }
+
+    esp_err_t err = ESP_OK;
+    taskENTER_CRITICAL(&attempt_lock);
+    boot_lock_armed = false;
+    bool joining = cached_join_pending;
+    taskEXIT_CRITICAL(&attempt_lock);
+    if (!joining) {
+        wifi_ap_record_t ap;
+        if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
+            return true;  // Already associated
+        }
+        if (!WIFI_CACHE_ENABLED || !entry_usable()) {
+            begin_attempt(WIFI_JOIN_SCAN, started_us);
+            return false;
+        }
+
+        begin_attempt(WIFI_JOIN_CACHED, started_us);
+        set_bssid_lock(true);
+        // Abandons any scan already under way
+        esp_wifi_disconnect();
+        err = esp_wifi_connect();
+    }
+    EventBits_t bits = err == ESP_OK ? xEventGroupWaitBits(join_events, JOINED_BIT | FAILED_BIT, pdFALSE, pdFALSE,
+                                                           pdMS_TO_TICKS(WIFI_CACHE_JOIN_TIMEOUT_MS))
+                                     : 0;
+    taskENTER_CRITICAL(&attempt_lock);
+    cached_join_pending = false;
+    taskEXIT_CRITICAL(&attempt_lock);
+    if (bits & JOINED_BIT) {
+        return true;
+    }
+
+    ESP_LOGW(TAG, "Cached AP did not answer, falling back to a full scan");
+    taskENTER_CRITICAL(&attempt_lock);
+    stats.cache_misses++;
+    taskEXIT_CRITICAL(&attempt_lock);
+    metric_inc(miss_metric);
+    invalidate();
+    set_bssid_lock(false);
+    begin_attempt(WIFI_JOIN_SCAN, esp_timer_get_time());
+    esp_wifi_disconnect();
+    err = esp_wifi_connect();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_wifi_connect failed: %s", esp_err_to_name(err));
+    }
+    return true;
+}
+
+void wifi_cache_get_stats(wifi_cache_stats_t *out) {
+    taskENTER_CRITICAL(&attempt_lock);
+    *out = stats;
+    taskEXIT_CRITICAL(&attempt_lock);
+}
+
+void wifi_cache_log_stats(void) {
+    wifi_cache_stats_t snapshot;
+    wifi_cache_get_stats(&snapshot);
+
+    for (int mode = 0; mode < WIFI_JOIN_COUNT; mode++) {
+        ESP_LOGI(TAG, "Join %-6s count=%lu mean_assoc=%llu ms mean_dhcp=%llu ms", mode_names[mode],
+                 (unsigned long)snapshot.joins[mode],
+                 snapshot.joins[mode] ? snapshot.assoc_ms[mode] / snapshot.joins[mode] : 0,
+                 snapshot.dhcp_count[mode] ? snapshot.dhcp_ms[mode] / snapshot.dhcp_count[mode] : 0);
+    }
+    ESP_LOGI(TAG, "cache_misses=%lu leases_reused=%lu", (unsigned long)snapshot.cache_misses,
+             (unsigned long)snapshot.leases_reused);
+}
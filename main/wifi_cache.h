@@ -0,0 +1,63 @@
+#ifndef SNOOPER_WIFI_CACHE_H
+#define SNOOPER_WIFI_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Fast reconnect cache. The BSSID, channel and IP address of the last successful connection
+// are kept in RTC memory (survives esp_restart) and NVS (survives power loss). Joins started
+// by the snooper go straight to that BSSID on that channel instead of scanning every channel;
+// if the cached AP does not answer within WIFI_CACHE_JOIN_TIMEOUT_MS the cache is dropped and
+// a full scan follows.
+//
+// Reusing the IP address is up to the DHCP client: with CONFIG_LWIP_DHCP_RESTORE_LAST_IP lwIP
+// asks for its previous lease directly (INIT-REBOOT) instead of going through discovery, and
+// init_wifi_cache() warns when it is off. The cache only records whether the lease came back the same.
+
+#ifndef WIFI_CACHE_ENABLED
+#define WIFI_CACHE_ENABLED 1
+#endif
+
+// Older entries are ignored; the AP may have changed channel. The age is only known once the
+// wall clock is valid, so right after power-on an NVS entry is tried whatever its age.
+#ifndef WIFI_CACHE_MAX_AGE_S
+#define WIFI_CACHE_MAX_AGE_S (24 * 60 * 60)
+#endif
+
+#ifndef WIFI_CACHE_JOIN_TIMEOUT_MS
+#define WIFI_CACHE_JOIN_TIMEOUT_MS 3000
+#endif
+
+typedef enum {
+    WIFI_JOIN_SCAN = 0,
+    WIFI_JOIN_CACHED,
+    WIFI_JOIN_COUNT,
+} wifi_join_mode_t;
+
+typedef struct {
+    uint32_t joins[WIFI_JOIN_COUNT];
+    uint64_t assoc_ms[WIFI_JOIN_COUNT];  // Cumulative connect-to-associated time
+    uint32_t dhcp_count[WIFI_JOIN_COUNT];
+    uint64_t dhcp_ms[WIFI_JOIN_COUNT];  // Cumulative associated-to-address time
+    uint32_t cache_misses;              // Cached joins that fell back to a scan
+    uint32_t leases_reused;             // Address matched the cached one
+} wifi_cache_stats_t;
+
+// Loads the cache; NVS must be initialized
+void init_wifi_cache(void);
+
+// Arms the boot join: when wifi_init_sta() next sets the station config, the cached BSSID and
+// channel are added to it, so the first connect skips the scan. Call just before wifi_init_sta().
+void wifi_cache_prepare(int64_t started_us);
+
+// Joins the cached AP, falling back to a full scan if it does not answer. wifi_init_sta() must
+// have run; after wifi_cache_prepare() this only waits for the join it started. started_us is
+// the esp_timer time the connection attempt began, for the timings.
+// Returns false, having done nothing, if there is no usable entry; true if the station is
+// already associated.
+bool wifi_cache_connect(int64_t started_us);
+
+void wifi_cache_get_stats(wifi_cache_stats_t *stats);
+void wifi_cache_log_stats(void);
+
+#endif  // SNOOPER_WIFI_CACHE_H
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""Aggregate snooper boot records (see main/boot_record.h) into per-phase percentiles.
+
+Input is one telemetry payload per line, as written by mosquitto_sub with or
+without -v; lines without a boot record are ignored, e.g.
+
+    mosquitto_sub -t coop/snooper/telemetry -v > telemetry.log
+    scripts/boot_report.py --limit total=20000 --limit sntp=5000 telemetry.log
+    scripts/boot_report.py --by clock telemetry.log
+
+--by splits the table on a record field, e.g. "clock" to compare warm resets
+that restored the wall clock from RTC memory with boots that waited for SNTP.
+
+Durations are in milliseconds. "total" runs from the first phase to the end of
+the last one. Boots exceeding a --limit are listed and the exit status is 1, so
+the script can gate a release on a staging fleet.
+"""
+
+import argparse
+import json
+import sys
+
+PHASES = ["version_info", "mac_address", "nvs", "wifi", "sntp", "connack", "first_status", "total"]
+PERCENTILES = [50, 90, 99]
+
+
+def parse_records(lines):
+    for line in lines:
+        start = line.find("{")
+        if start < 0 or "boot_record" not in line:
+            continue
+        try:
+            record = json.loads(line[start:])["boot_record"]
+        except (ValueError, KeyError, TypeError):
+            continue
+        phases = record.get("phases", {})
+        if not phases:
+            continue
+        durations = {name: (span[1] - span[0]) / 1000.0 for name, span in phases.items()}
+        spans = phases.values()
+        durations["total"] = (max(end for _, end in spans) - min(begin for begin, _ in spans)) / 1000.0
+        yield record, durations
+
+
+def percentile(values, pct):
+    """Nearest-rank percentile of a sorted list."""
+    rank = max(1, -(-pct * len(values) // 100))
+    return values[rank - 1]
+
+
+def print_table(records):
+    print("%-14s %6s %9s %9s %9s %9s" % ("phase", "count", "p50 ms", "p90 ms", "p99 ms", "max ms"))
+    for name in PHASES:
+        values = sorted(d[name] for _, d in records if name in d)
+        if not values:
+            continue
+        print("%-14s %6d %9.0f %9.0f %9.0f %9.0f" %
+              ((name, len(values)) + tuple(percentile(values, p) for p in PERCENTILES) + (values[-1],)))
+
+
+def parse_limit(text):
+    name, _, value = text.partition("=")
+    if name not in PHASES or not value:
+        raise argparse.ArgumentTypeError("expected PHASE=MS with PHASE one of %s" % ", ".join(PHASES))
+    return name, float(value)
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description="Aggregate snooper boot records into per-phase percentiles")
+    parser.add_argument("--limit", type=parse_limit, action="append", default=[], metavar="PHASE=MS",
+                        help="flag boots where PHASE took longer than MS; may be repeated")
+    parser.add_argument("--version", help="only include records from this firmware version")
+    parser.add_argument("--by", metavar="FIELD", help="one table per value of this record field, e.g. clock")
+    parser.add_argument("logs", nargs="*", default=["-"])
+    options = parser.parse_args(argv[1:])
+
+    records = []
+    for source in options.logs:
+        f = sys.stdin if source == "-" else open(source, errors="replace")
+        with f:
+            records.extend(r for r in parse_records(f) if options.version in (None, r[0].get("version")))
+    if not records:
+        print("no boot records found", file=sys.stderr)
+        return 0
+
+    if options.by:
+        groups = {}
+        for record in records:
+            groups.setdefault(str(record[0].get(options.by, "-")), []).append(record)
+        for value in sorted(groups):
+            print("%s=%s: %d boot records" % (options.by, value, len(groups[value])))
+            print_table(groups[value])
+            print()
+    else:
+        print("%d boot records" % len(records))
+        print_table(records)
+
+    slow = 0
+    for record, durations in records:
+        over = ["%s %.0f > %.0f ms" % (name, durations[name], limit)
+                for name, limit in options.limit if durations.get(name, 0) > limit]
+        if over:
+            slow += 1
+            print("SLOW %s %s reset=%s: %s" % (record.get("device", "?"), record.get("version", "?"),
+                                               record.get("reset", "?"), "; ".join(over)))
+    if slow:
+        print("%d of %d boots over limit" % (slow, len(records)))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+"""Convert snooper CBOR payloads (see main/cbor.h) to JSON and back.
+
+Each argument is a file holding one raw MQTT payload; with no arguments a
+single payload is read from stdin, e.g.
+
+    mosquitto_sub -t coop/snooper/telemetry -C 1 -N | scripts/cbor2json.py
+    echo '{"LED":"LED_GREEN","seq":7}' | scripts/cbor2json.py --encode > status.cbor
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+
+class CborError(ValueError):
+    pass
+
+
+def decode(data, pos=0, depth=0):
+    """Returns (value, next position) for the item at pos."""
+    if depth > 16:
+        raise CborError("nesting too deep")
+    if pos >= len(data):
+        raise CborError("truncated")
+    initial = data[pos]
+    major, info = initial >> 5, initial & 0x1F
+    pos += 1
+    if major == 7:
+        if info == 20:
+            return False, pos
+        if info == 21:
+            return True, pos
+        if info in (22, 23):
+            return None, pos
+        if info == 25:
+            return struct.unpack_from(">e", data, pos)[0], pos + 2
+        if info == 26:
+            return struct.unpack_from(">f", data, pos)[0], pos + 4
+        if info == 27:
+            return struct.unpack_from(">d", data, pos)[0], pos + 8
+        raise CborError("unsupported simple value %d" % info)
+    if info < 24:
+        arg = info
+    elif info <= 27:
+        size = 1 << (info - 24)
+        if pos + size > len(data):
+            raise CborError("truncated")
+        arg = int.from_bytes(data[pos:pos + size], "big")
+        pos += size
+    else:
+        raise CborError("indefinite lengths are not supported")
+
+    if major == 0:
+        return arg, pos
+    if major == 1:
+        return -1 - arg, pos
+    if major in (2, 3):
+        if pos + arg > len(data):
+            raise CborError("truncated")
+        raw = bytes(data[pos:pos + arg])
+        return (raw.hex() if major == 2 else raw.decode("utf-8", "replace")), pos + arg
+    if major == 4:
+        items = []
+        for _ in range(arg):
+            item, pos = decode(data, pos, depth + 1)
+            items.append(item)
+        return items, pos
+    if major == 5:
+        result = {}
+        for _ in range(arg):
+            key, pos = decode(data, pos, depth + 1)
+            value, pos = decode(data, pos, depth + 1)
+            result[str(key)] = value
+        return result, pos
+    # Tags: keep the content
+    return decode(data, pos, depth + 1)
+
+
+def head(major, arg):
+    if arg < 24:
+        return bytes([(major << 5) | arg])
+    for info, size in ((24, 1), (25, 2), (26, 4), (27, 8)):
+        if arg < 1 << (8 * size):
+            return bytes([(major << 5) | info]) + arg.to_bytes(size, "big")
+    raise CborError("integer too large")
+
+
+def encode(value):
+    if value is None:
+        return b"\xf6"
+    if value is True:
+        return b"\xf5"
+    if value is False:
+        return b"\xf4"
+    if isinstance(value, int):
+        return head(0, value) if value >= 0 else head(1, -1 - value)
+    if isinstance(value, float):
+        return b"\xfb" + struct.pack(">d", value)
+    if isinstance(value, str):
+        raw = value.encode("utf-8")
+        return head(3, len(raw)) + raw
+    if isinstance(value, list):
+        return head(4, len(value)) + b"".join(encode(v) for v in value)
+    if isinstance(value, dict):
+        return head(5, len(value)) + b"".join(encode(k) + encode(v) for k, v in value.items())
+    raise CborError("cannot encode %r" % type(value))
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description="Convert snooper CBOR payloads to JSON and back")
+    parser.add_argument("--encode", action="store_true", help="read JSON, write CBOR")
+    parser.add_argument("payloads", nargs="*", default=["-"])
+    options = parser.parse_args(argv[1:])
+    for source in options.payloads:
+        if source == "-":
+            payload = sys.stdin.buffer.read()
+        else:
+            with open(source, "rb") as f:
+                payload = f.read()
+        if options.encode:
+            sys.stdout.buffer.write(encode(json.loads(payload)))
+            continue
+        value, end = decode(payload)
+        if end != len(payload):
+            print("# %d trailing bytes" % (len(payload) - end), file=sys.stderr)
+        print(json.dumps(value))
+        print("# %d bytes CBOR, %d bytes as compact JSON" % (len(payload), len(json.dumps(value, separators=(",", ":")))),
+              file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+"""Render snooper CPU accounting (see main/diagnostics.h) as a table and a time series.
+
+Input is one diagnostics report per line, as written by mosquitto_sub with or
+without -v; reports without a "cpu" section are ignored. Each report carries
+the last few sampling windows, so requesting one every minute or so gives an
+unbroken series, e.g.
+
+    mosquitto_sub -t coop/snooper/diagnostics -v > diagnostics.log &
+    while sleep 50; do mosquitto_pub -t coop/snooper/diagnostics/request -n; done
+    scripts/cpu_report.py diagnostics.log
+    scripts/cpu_report.py --series --top 4 diagnostics.log
+
+Windows repeated across overlapping reports are counted once. Shares are
+percentages of each window; IDLE is the headroom left.
+"""
+
+import argparse
+import json
+import sys
+
+
+def parse_windows(lines):
+    """Yields (boot, end_s, window_ms, {task: percent}) for every distinct window."""
+    boot = 0
+    last_uptime = None
+    seen = set()
+    for line in lines:
+        start = line.find("{")
+        if start < 0 or '"cpu"' not in line:
+            continue
+        try:
+            report = json.loads(line[start:])
+            uptime = report["uptime_s"]
+            cpu = report["cpu"]
+            window_ms = cpu["window_ms"]
+            tasks = cpu["tasks"]
+        except (ValueError, KeyError, TypeError):
+            continue
+        if last_uptime is not None and uptime < last_uptime:
+            boot += 1
+        last_uptime = uptime
+
+        # Windows are oldest first and the newest one ended age_ms before the report
+        end_s = uptime - cpu.get("age_ms", 0) / 1000.0
+        ends = []
+        for ms in reversed(window_ms):
+            ends.append(end_s)
+            end_s -= ms / 1000.0
+        ends.reverse()
+        for index, ms in enumerate(window_ms):
+            key = (boot, round(ends[index]))
+            if key in seen:
+                continue
+            seen.add(key)
+            shares = {name: values[index] / 10.0 for name, values in tasks.items()
+                      if index < len(values) and values[index] is not None}
+            yield boot, ends[index], ms, shares
+
+
+def print_table(windows):
+    totals = {}
+    for _, _, _, shares in windows:
+        for name, percent in shares.items():
+            totals.setdefault(name, []).append(percent)
+    latest = windows[-1][3]
+    print("%-20s %8s %8s %8s %8s" % ("task", "windows", "last %", "mean %", "max %"))
+    for name in sorted(totals, key=lambda n: -sum(totals[n]) / len(totals[n])):
+        values = totals[name]
+        last = "%8.1f" % latest[name] if name in latest else "%8s" % "-"
+        print("%-20s %8d %s %8.1f %8.1f" % (name, len(values), last, sum(values) / len(values), max(values)))
+
+
+def print_series(windows, top):
+    means = {}
+    for _, _, _, shares in windows:
+        for name, percent in shares.items():
+            means[name] = means.get(name, 0.0) + percent
+    busiest = [n for n in sorted(means, key=lambda n: -means[n]) if n != "IDLE"][:top]
+    columns = ["IDLE"] + busiest
+    print("%-5s %9s  %s" % ("boot", "uptime_s", " ".join("%12.12s" % c for c in columns)))
+    for boot, end_s, _, shares in windows:
+        cells = " ".join("%12.1f" % shares[c] if c in shares else "%12s" % "-" for c in columns)
+        print("%-5d %9.0f  %s" % (boot, end_s, cells))
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description="Render snooper CPU accounting")
+    parser.add_argument("--series", action="store_true", help="print one row per window instead of the table")
+    parser.add_argument("--top", type=int, default=5, metavar="N",
+                        help="busiest tasks shown next to IDLE in --series (default 5)")
+    parser.add_argument("files", nargs="*", help="diagnostics logs (default: stdin)")
+    options = parser.parse_args(argv[1:])
+
+    windows = []
+    for path in options.files or ["-"]:
+        with (sys.stdin if path == "-" else open(path)) as f:
+            windows.extend(parse_windows(f))
+    if not windows:
+        print("No CPU windows found; is the firmware built with run-time stats?", file=sys.stderr)
+        return 1
+
+    if options.series:
+        print_series(windows, options.top)
+    else:
+        print_table(windows)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
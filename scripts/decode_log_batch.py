@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+"""Decode cloud log batches published by the snooper (see main/cloud_log.h).
+
+Each argument is a file holding one raw MQTT payload; with no arguments a
+single payload is read from stdin, e.g.
+
+    mosquitto_sub -t coop/snooper/log -C 1 -N > batch.bin
+    scripts/decode_log_batch.py --elf build/snooper.elf batch.bin
+
+Deferred-log records (main/deferred_log.h) carry flash addresses instead of
+text; --elf names the firmware image they came from so the tag and format
+strings can be looked up. Without it the records are printed raw.
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+FLAG_COMPRESSED = 0x01
+DLOG_RECORD_MARKER = 0x1E
+DLOG_RECORD_HEADER = struct.Struct("<BBBIII")
+LEVEL_LETTERS = {1: "E", 2: "W", 3: "I", 4: "D", 5: "V"}
+FORMAT_SPEC = re.compile(r"%([-+ #0]*\d*(?:\.\d+)?)(hh|h|ll|l|z|j|t)?([diouxXcsp%])")
+
+
+class ElfStrings:
+    """Reads NUL terminated strings out of the loadable sections of an ELF32 image."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.image = f.read()
+        if self.image[:4] != b"\x7fELF" or self.image[4] != 1:
+            raise ValueError("%s is not an ELF32 image" % path)
+        endian = "<" if self.image[5] == 1 else ">"
+        shoff, = struct.unpack_from(endian + "I", self.image, 0x20)
+        shentsize, shnum = struct.unpack_from(endian + "HH", self.image, 0x2E)
+        self.sections = []
+        for i in range(shnum):
+            (_, sh_type, _, addr, offset, size) = struct.unpack_from(
+                endian + "IIIIII", self.image, shoff + i * shentsize)
+            # SHT_PROGBITS only; NOBITS sections have no bytes in the file
+            if sh_type == 1 and addr != 0:
+                self.sections.append((addr, offset, size))
+
+    def string_at(self, address):
+        for addr, offset, size in self.sections:
+            if addr <= address < addr + size:
+                start = offset + address - addr
+                end = self.image.find(b"\0", start, offset + size)
+                if end < 0:
+                    end = offset + size
+                return self.image[start:end].decode("utf-8", "replace")
+        return None
+
+
+def lzss_decompress(data, expected_len):
+    out = bytearray()
+    pos = 0
+    while pos < len(data) and len(out) < expected_len:
+        flags = data[pos]
+        pos += 1
+        for bit in range(8):
+            if pos >= len(data) or len(out) >= expected_len:
+                break
+            if flags & (1 << bit):
+                b0, b1 = data[pos], data[pos + 1]
+                pos += 2
+                distance = (b0 | ((b1 >> 4) << 8)) + 1
+                length = (b1 & 0x0F) + 3
+                for _ in range(length):
+                    out.append(out[-distance])
+            else:
+                out.append(data[pos])
+                pos += 1
+    return bytes(out)
+
+
+def decode_batch(payload):
+    if len(payload) < 4 or payload[0:1] != b"L":
+        raise ValueError("not a log batch")
+    version, flags, device_len = payload[1], payload[2], payload[3]
+    if version not in (1, 2):
+        raise ValueError("unsupported batch version %d" % version)
+    pos = 4
+    device = payload[pos:pos + device_len].decode("utf-8", "replace")
+    pos += device_len
+    lines, body_len = struct.unpack_from("<HH", payload, pos)
+    pos += 4
+    body = payload[pos:]
+    if flags & FLAG_COMPRESSED:
+        body = lzss_decompress(body, body_len)
+    if len(body) != body_len:
+        raise ValueError("body length %d, header says %d" % (len(body), body_len))
+    return device, lines, body
+
+
+def format_record(fmt, args, elf):
+    """Render a printf format with 32-bit raw arguments; %s arguments are ELF addresses."""
+    values = iter(args)
+
+    def substitute(match):
+        flags, length, conv = match.groups()
+        if conv == "%":
+            return "%"
+        value = next(values, 0)
+        if conv == "s":
+            text = elf.string_at(value) if elf else None
+            return ("%" + flags + "s") % (text if text is not None else "<0x%08x>" % value)
+        if conv == "p":
+            return "0x%08x" % value
+        if conv in "di" and value & 0x80000000:
+            value -= 1 << 32
+        if conv == "u":
+            conv = "d"
+        return ("%" + flags + conv) % value
+
+    return FORMAT_SPEC.sub(substitute, fmt)
+
+
+def render_body(body, elf):
+    out = []
+    pos = 0
+    while pos < len(body):
+        if body[pos] != DLOG_RECORD_MARKER:
+            end = body.find(b"\n", pos)
+            end = len(body) if end < 0 else end + 1
+            out.append(body[pos:end].decode("utf-8", "replace"))
+            pos = end
+            continue
+        _, level, nargs, timestamp, tag_addr, fmt_addr = DLOG_RECORD_HEADER.unpack_from(body, pos)
+        pos += DLOG_RECORD_HEADER.size
+        args = struct.unpack_from("<%dI" % nargs, body, pos)
+        pos += 4 * nargs
+        tag = elf.string_at(tag_addr) if elf else None
+        fmt = elf.string_at(fmt_addr) if elf else None
+        letter = LEVEL_LETTERS.get(level, "?")
+        if tag is None or fmt is None:
+            message = "fmt@0x%08x %s" % (fmt_addr, " ".join("0x%08x" % a for a in args))
+            tag = tag or "tag@0x%08x" % tag_addr
+        else:
+            message = format_record(fmt, args, elf)
+        out.append("%s (%d) %s: %s\n" % (letter, timestamp, tag, message))
+    return "".join(out)
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description="Decode snooper cloud log batches")
+    parser.add_argument("--elf", help="firmware ELF used to resolve deferred-log records")
+    parser.add_argument("payloads", nargs="*", default=["-"])
+    options = parser.parse_args(argv[1:])
+    elf = ElfStrings(options.elf) if options.elf else None
+    for source in options.payloads:
+        if source == "-":
+            payload = sys.stdin.buffer.read()
+        else:
+            with open(source, "rb") as f:
+                payload = f.read()
+        device, lines, body = decode_batch(payload)
+        print("# %s: %d records, %d bytes on the wire" % (device, lines, len(payload)))
+        sys.stdout.write(render_body(body, elf))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""List the RAM the snooper reserves statically (see main/static_alloc.h).
+
+Reads the symbol table of the firmware ELF and prints every static_<tag>_<part>
+object, task stacks and TCBs, queue storage and semaphores, with its size and
+a total, e.g.
+
+    scripts/memory_report.py build/firmware.elf
+    scripts/memory_report.py --min-size 1024 build/firmware.elf
+
+--min-size also lists any other data or bss object at least that large, which
+is where the remaining big buffers show up. The build runs this after linking.
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+STT_OBJECT = 1
+SHN_UNDEF = 0
+SHN_LORESERVE = 0xFF00
+STATIC_SYMBOL = re.compile(r"^static_(\w+?)_(stack|tcb|storage|queue|semaphore|event_group)$")
+# GCC gives function-local statics a ".N" suffix
+LOCAL_SUFFIX = re.compile(r"\.\d+$")
+
+
+def read_objects(path):
+    """Returns (name, size, section name) for every sized object symbol in an ELF32 image."""
+    with open(path, "rb") as f:
+        image = f.read()
+    if image[:4] != b"\x7fELF" or image[4] != 1:
+        raise ValueError("%s is not an ELF32 image" % path)
+    endian = "<" if image[5] == 1 else ">"
+    shoff, = struct.unpack_from(endian + "I", image, 0x20)
+    shentsize, shnum, shstrndx = struct.unpack_from(endian + "HHH", image, 0x2E)
+    sections = [struct.unpack_from(endian + "IIIIIIIIII", image, shoff + i * shentsize) for i in range(shnum)]
+
+    def name_at(table, offset):
+        start = sections[table][4] + offset
+        return image[start:image.index(b"\0", start)].decode("utf-8", "replace")
+
+    section_names = [name_at(shstrndx, s[0]) for s in sections]
+    objects = []
+    for s in sections:
+        # SHT_SYMTAB; sh_link is its string table
+        if s[1] != 2:
+            continue
+        offset, size, link, entsize = s[4], s[5], s[6], s[9]
+        for pos in range(offset, offset + size, entsize):
+            st_name, _, st_size, st_info, _, st_shndx = struct.unpack_from(endian + "IIIBBH", image, pos)
+            if st_info & 0xF != STT_OBJECT or st_size == 0 or st_shndx == SHN_UNDEF or st_shndx >= SHN_LORESERVE:
+                continue
+            objects.append((LOCAL_SUFFIX.sub("", name_at(link, st_name)), st_size, section_names[st_shndx]))
+    return objects
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description="List the RAM the snooper reserves statically")
+    parser.add_argument("--min-size", type=int, default=0, metavar="BYTES",
+                        help="also list other RAM objects of at least this size")
+    parser.add_argument("elf")
+    options = parser.parse_args(argv[1:])
+
+    objects = read_objects(options.elf)
+    reserved = sorted(((STATIC_SYMBOL.match(name), size, section) for name, size, section in objects
+                       if STATIC_SYMBOL.match(name)), key=lambda o: (o[0].group(1), o[0].group(2)))
+    if not reserved:
+        print("No static_* objects; built without STATIC_ALLOCATION?")
+    else:
+        print("%-22s %-12s %8s  %s" % ("object", "part", "bytes", "section"))
+        totals = {}
+        for match, size, section in reserved:
+            print("%-22s %-12s %8d  %s" % (match.group(1), match.group(2), size, section))
+            totals[match.group(2)] = totals.get(match.group(2), 0) + size
+        print("%-22s %-12s %8d" % ("total", "", sum(totals.values())))
+        for part in sorted(totals):
+            print("%-22s %-12s %8d" % ("", part, totals[part]))
+
+    if options.min_size:
+        others = sorted(((size, name, section) for name, size, section in objects
+                         if not STATIC_SYMBOL.match(name) and size >= options.min_size and
+                         (".bss" in section or ".data" in section)), reverse=True)
+        print()
+        print("Other RAM objects of %d bytes or more" % options.min_size)
+        for size, name, section in others:
+            print("%-35s %8d  %s" % (name, size, section))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))